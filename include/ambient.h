@@ -0,0 +1,34 @@
+#ifndef AMBIENT_H
+#define AMBIENT_H
+
+#include <Arduino.h>
+
+#define AMBIENT_POWER_MS   40 // sensor supply on before sampling (LEDs still lit)
+#define AMBIENT_SETTLE_MS  2  // LEDs blanked before the ADC starts
+#define AMBIENT_FAST_S     2  // resample interval while the raw value disagrees with the state
+
+// Light sensor sampling from the 1 kHz ticker. The ADC is configured for one
+// conversion with 16x hardware averaging (12 bit, scaled to 0...1023) and a
+// window monitor on the dark/bright thresholds; the result arrives in the ADC
+// interrupt. The LEDs are only blanked for the settle time plus the conversion.
+void ambient_begin(uint8_t pin_sensor, uint8_t pin_power);
+
+// Thresholds in ADC counts (0...1023, dark < bright) and the sample interval.
+void ambient_config(uint16_t dark, uint16_t bright, uint16_t interval_s);
+
+// Starts or stops the periodic sampling. Stop it while the LEDs are written
+// without led_anim (menu, remote mode).
+void ambient_enable(bool on);
+
+// True while a sample is being taken (sensor powered, LEDs blanked or ADC running).
+bool ambient_busy(void);
+
+// Returns true once per finished sample with the smoothed value and the
+// dark state (hysteresis between the two thresholds).
+bool ambient_poll(uint16_t *value, bool *dark);
+
+// Blocking single measurement without LED blanking (self test).
+// Only while the periodic sampling is stopped.
+uint16_t ambient_read(void);
+
+#endif
@@ -0,0 +1,21 @@
+#ifndef BAND_STORE_H
+#define BAND_STORE_H
+
+#include <Arduino.h>
+
+#define BAND_STORE_ADDR   0x0003FF00UL // last flash row (256 bytes), behind the settings image
+#define BAND_STORE_SLOTS  64           // 32-bit entries per row, one row erase per 64 writes
+
+// Last displayed CO2 value in flash, so the traffic light can show its last
+// band right after a power loss instead of waiting for the first
+// measurement. Entries are appended to one flash row (co2 in the low half,
+// its complement in the high half); the row is only erased when it is full.
+
+// Returns the most recent stored value, false if there is none.
+bool band_store_read(uint16_t *co2);
+
+// Appends co2 (interrupts are disabled for about 3 ms, 9 ms when the row
+// has to be erased). The caller limits how often this happens.
+void band_store_write(uint16_t co2);
+
+#endif
@@ -0,0 +1,87 @@
+#ifndef BINFRAME_H
+#define BINFRAME_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Frame layer of the binary protocol (firmware and host tools).
+//
+// A frame is [type][seq][flags][payload...][crc16 lo][crc16 hi], COBS
+// encoded and terminated by a 0x00 byte. The CRC is CRC-16/CCITT-FALSE
+// (polynomial 0x1021, init 0xFFFF) over type, seq, flags and payload.
+// Replies carry the seq of the request; BF_FLAG_MORE marks that further
+// frames of the same reply follow. All integers are little-endian.
+//
+// The payload of GET/SET/DUMP is a list of TLVs [tag][len][value...].
+
+#define BINFRAME_MAX       256 // max. decoded frame incl. header and CRC
+#define BINFRAME_HDR       3
+#define BINFRAME_PAYLOAD   (BINFRAME_MAX - BINFRAME_HDR - 2)
+#define BINFRAME_ENC_MAX   (BINFRAME_MAX + (BINFRAME_MAX / 254) + 2) // COBS + delimiter
+#define BINFRAME_VERSION   1
+
+#define BF_FLAG_MORE       0x01
+
+typedef enum
+{
+  BF_HELLO      = 0x01, // -> BF_HELLO | 0x80: [proto u8][items u16][version string]
+  BF_GET        = 0x02, // [T_KEY]... -> [T_KEY][value or T_ERR]...
+  BF_SET        = 0x03, // [T_KEY][value]... -> [T_KEY][T_ERR, empty = OK]...
+  BF_DUMP       = 0x04, // -> [T_KEY][value]... in several frames
+  BF_CMD        = 0x05, // text command (begin, commit, abort, save) -> text reply
+  BF_HISTORY    = 0x06, // [from seq u32][max u16] -> records in several frames
+  BF_MODE_TEXT  = 0x07, // -> reply, then back to the text protocol
+  BF_REPLY      = 0x80, // reply type = request type | BF_REPLY
+  BF_SAMPLE     = 0x90, // unsolicited: one record per new measurement
+  BF_ERROR      = 0xFF  // [message]: frame could not be handled
+} binframe_type_t;
+
+typedef enum
+{
+  T_KEY  = 0x01, // key string (without 0)
+  T_U32  = 0x02, // CFG_U8, CFG_U16, CFG_U32, CFG_COLOR
+  T_BOOL = 0x03,
+  T_STR  = 0x04,
+  T_IP   = 0x05, // 4 bytes a.b.c.d
+  T_ERR  = 0x06  // error message, empty = OK
+} binframe_tag_t;
+
+// History record on the wire (BF_HISTORY replies and BF_SAMPLE).
+#define BINFRAME_REC_LEN   16
+
+typedef struct
+{
+  uint32_t seq;
+  uint32_t time;  // Unix seconds UTC, 0 = clock was not set
+  uint16_t co2;   // ppm
+  int16_t temp;   // 0.01 deg C
+  uint16_t humi;  // 0.01 %
+  uint16_t pres;  // 0.1 hPa, 0 = no pressure sensor
+} binframe_rec_t;
+
+uint16_t binframe_crc16(const uint8_t *data, size_t len);
+
+// COBS encodes len bytes and appends the 0x00 delimiter. out must hold
+// BINFRAME_ENC_MAX bytes for a full frame. Returns the encoded length.
+size_t binframe_encode(const uint8_t *in, size_t len, uint8_t *out);
+
+// Decodes one COBS block (without delimiter). in and out may be the same
+// buffer. Returns the decoded length, 0 if the block is malformed.
+size_t binframe_decode(const uint8_t *in, size_t len, uint8_t *out);
+
+// Appends the CRC to a frame of len bytes (header + payload), returns the
+// new length. binframe_check() verifies it and returns the payload length,
+// or -1 if the frame is too short or the CRC does not match.
+size_t binframe_seal(uint8_t *frame, size_t len);
+int binframe_check(const uint8_t *frame, size_t len);
+
+// Appends a TLV at *pos. Returns false (and leaves *pos) if it does not fit.
+bool binframe_tlv_put(uint8_t *buf, size_t cap, size_t *pos, uint8_t tag, const void *value, size_t len);
+
+// Reads the next TLV at *pos. Returns false at the end or on a truncated TLV.
+bool binframe_tlv_next(const uint8_t *buf, size_t len, size_t *pos, uint8_t *tag, const uint8_t **value, uint8_t *vlen);
+
+void binframe_put_rec(uint8_t *out, const binframe_rec_t *rec);
+void binframe_get_rec(const uint8_t *in, binframe_rec_t *rec);
+
+#endif
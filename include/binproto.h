@@ -0,0 +1,31 @@
+#ifndef BINPROTO_H
+#define BINPROTO_H
+
+#include <Arduino.h>
+#include "binframe.h"
+#include "history.h"
+#include "serial_settings.h"
+
+#define BINPROTO_FRAMES_PER_POLL  4 // history frames sent per binproto_poll()
+#define BINPROTO_IDLE_MS  300000UL  // back to text after 5 min without a received frame
+
+// Binary framed protocol (frame format in binframe.h) as an alternative to
+// the text commands, entered with "mode binary". It is left with BF_MODE_TEXT,
+// binproto_end() or after BINPROTO_IDLE_MS without a received frame (a tool
+// that only listens for BF_SAMPLE sends e.g. an empty GET now and then).
+// GET/SET/DUMP work on the same cfg_item_t table and checks as the text
+// protocol; BF_CMD runs the text settings commands (begin, commit, ...).
+void binproto_begin(Stream *io);
+bool binproto_active(void);
+
+// Back to text without a reply, e.g. when the host closed the port.
+void binproto_end(void);
+
+// Handles all complete frames received so far and continues a running
+// history export. ctx->out is not used. Never waits for input.
+void binproto_poll(const serial_settings_ctx_t *ctx, const cfg_item_t *items, size_t item_count);
+
+// Sends one BF_SAMPLE frame for a new measurement.
+void binproto_sample(uint32_t seq, const history_rec_t *rec);
+
+#endif
@@ -0,0 +1,54 @@
+#ifndef BUTTON_H
+#define BUTTON_H
+
+#include <Arduino.h>
+
+#define BUTTON_DEBOUNCE_MS  20   // level must be stable this long
+#define BUTTON_HOLD_MS      2000 // BUTTON_HOLD is reported after this time
+#define BUTTON_DOUBLE_MS    300  // max. gap between two short presses
+#define BUTTON_QUEUE_LEN    8    // power of two
+
+typedef enum
+{
+  BUTTON_DOWN,   // debounced press
+  BUTTON_HOLD,   // still pressed after BUTTON_HOLD_MS (once per press)
+  BUTTON_SHORT,  // released before BUTTON_HOLD_MS
+  BUTTON_DOUBLE, // short press released within BUTTON_DOUBLE_MS after a short press (replaces the second BUTTON_SHORT)
+  BUTTON_LONG    // released after BUTTON_HOLD_MS
+} button_event_type_t;
+
+typedef struct
+{
+  uint8_t type;         // button_event_type_t
+  uint16_t duration_ms; // press duration (release events and BUTTON_HOLD)
+  uint32_t time_ms;     // millis() when the event was queued
+} button_event_t;
+
+typedef struct
+{
+  uint32_t events;
+  uint32_t dropped;        // queue full
+  uint32_t latency_max_us; // edge interrupt -> debounced event
+  uint32_t latency_avg_us;
+  uint32_t wait_max_ms;    // queued -> taken by the main loop
+} button_stats_t;
+
+// Sets up the EIC interrupt on pin (active low) and the debounce tick.
+// A press that is already active at this point is not reported.
+void button_begin(uint8_t pin);
+
+// Takes the oldest event from the queue. Returns false if the queue is empty.
+bool button_get(button_event_t *ev);
+
+// Drops all queued events.
+void button_flush(void);
+
+// Debounced button level.
+bool button_pressed(void);
+
+// True if the button is released and no edge is being debounced.
+bool button_idle(void);
+
+void button_get_stats(button_stats_t *stats);
+
+#endif
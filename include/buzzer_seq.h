@@ -0,0 +1,33 @@
+#ifndef BUZZER_SEQ_H
+#define BUZZER_SEQ_H
+
+#include <Arduino.h>
+
+#define BUZZER_SEQ_HZ     732 // default tone, same as the former analogWrite() PWM
+#define BUZZER_SEQ_QUEUE  16  // power of two
+
+typedef struct
+{
+  uint16_t freq_hz; // 0 = pause
+  uint8_t duty;     // 0...100 %
+  uint16_t ms;      // 0 = until the next step is queued or buzzer_seq_stop()
+} buzzer_step_t;
+
+// Drives the pin from TCC0/WO[1] (PA05, peripheral E). Steps are timed by the
+// 1 kHz ticker, so no caller ever waits for a tone to finish.
+void buzzer_seq_begin(uint8_t pin);
+
+// Appends one step to the queue. Returns false if the queue is full.
+bool buzzer_seq_add(uint16_t freq_hz, uint8_t duty, uint16_t ms);
+
+// Replaces the queue with steps. With loop set, played steps are queued again
+// so the sequence repeats until buzzer_seq_stop().
+void buzzer_seq_play(const buzzer_step_t *steps, uint8_t count, bool loop);
+
+// Silences the buzzer and drops all queued steps.
+void buzzer_seq_stop(void);
+
+// True while a step is playing or queued.
+bool buzzer_seq_busy(void);
+
+#endif
@@ -0,0 +1,79 @@
+#ifndef CFG_KEYS_H
+#define CFG_KEYS_H
+
+#include <stddef.h>
+#include <string.h>
+#include <strings.h>
+
+// Key lookup for tables of structs with a "const char *key" member that are
+// sorted by key (ASCII, case-insensitive). The order is checked at compile
+// time, e.g.
+//   static_assert(cfg_keys_sorted(items, 0, count), "items not sorted");
+// which also rejects duplicate keys. Lookups are a binary search, so a get or
+// set costs about log2(count) string compares instead of count. With exact =
+// true keys are compared case-sensitively (strcmp() order), e.g. URL paths;
+// the table must then be checked and searched with exact = true.
+
+constexpr char cfg_key_lower(char c)
+{
+  return ((c >= 'A') && (c <= 'Z')) ? (char)(c - 'A' + 'a') : c;
+}
+
+constexpr unsigned char cfg_key_char(char c, bool exact)
+{
+  return (unsigned char)(exact ? c : cfg_key_lower(c));
+}
+
+// Same order as strcasecmp() for ASCII keys, strcmp() with exact.
+constexpr int cfg_key_cmp(const char *a, const char *b, bool exact = false)
+{
+  return (cfg_key_char(*a, exact) != cfg_key_char(*b, exact)) ?
+           ((int)cfg_key_char(*a, exact) - (int)cfg_key_char(*b, exact)) :
+           ((*a == 0) ? 0 : cfg_key_cmp(a + 1, b + 1, exact));
+}
+
+// True if items[lo..hi) is strictly ascending. Splits the range in halves so
+// the constexpr recursion depth stays at log2(count) for large tables.
+template <typename T>
+constexpr bool cfg_keys_sorted(const T *items, size_t lo, size_t hi, bool exact = false)
+{
+  return ((hi - lo) < 2) ? true :
+         (cfg_keys_sorted(items, lo, lo + (hi - lo) / 2, exact) &&
+          cfg_keys_sorted(items, lo + (hi - lo) / 2, hi, exact) &&
+          (cfg_key_cmp(items[lo + (hi - lo) / 2 - 1].key, items[lo + (hi - lo) / 2].key, exact) < 0));
+}
+
+// Index of the first item whose key is not less than key.
+template <typename T>
+size_t cfg_key_lower_bound(const T *items, size_t count, const char *key, bool exact = false)
+{
+  size_t lo = 0, hi = count;
+
+  while(lo < hi)
+  {
+    size_t mid = lo + (hi - lo) / 2;
+    if((exact ? strcmp(items[mid].key, key) : strcasecmp(items[mid].key, key)) < 0)
+    {
+      lo = mid + 1;
+    }
+    else
+    {
+      hi = mid;
+    }
+  }
+  return lo;
+}
+
+template <typename T>
+const T *cfg_key_find(const T *items, size_t count, const char *key, bool exact = false)
+{
+  size_t i = cfg_key_lower_bound(items, count, key, exact);
+
+  if((i < count) && ((exact ? strcmp(items[i].key, key) : strcasecmp(items[i].key, key)) == 0))
+  {
+    return &items[i];
+  }
+  return NULL;
+}
+
+#endif
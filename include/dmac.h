@@ -0,0 +1,32 @@
+#ifndef DMAC_H
+#define DMAC_H
+
+#include <Arduino.h>
+
+// Number of DMA channels managed by the firmware (size of the descriptor table):
+// WS2812 TX, I2C TX/RX for SERCOM0 and SERCOM2.
+#define DMAC_CHANNELS 6
+
+// Called from the DMAC interrupt when a transfer has finished.
+typedef void (*dmac_done_fn)(uint8_t channel, bool error);
+
+// Enables the DMA controller. Safe to call more than once.
+void dmac_begin(void);
+
+// Reserves a channel that is triggered by the given peripheral (e.g. SERCOM3_DMAC_ID_TX).
+// Returns the channel number or -1 if all channels are in use.
+int dmac_channel_alloc(uint8_t trigsrc, dmac_done_fn done);
+
+// Starts a single-block byte transfer of count beats in the background.
+// Source/destination addresses are incremented when src_inc/dst_inc are set.
+// Returns false if the channel is still busy.
+bool dmac_transfer(uint8_t channel, const volatile void *src, volatile void *dst,
+                   uint16_t count, bool src_inc, bool dst_inc);
+
+// Returns true while a transfer on the channel is pending or running.
+bool dmac_busy(uint8_t channel);
+
+// Stops a running transfer without calling the done callback.
+void dmac_abort(uint8_t channel);
+
+#endif
@@ -0,0 +1,24 @@
+#ifndef DNS_CAPTIVE_H
+#define DNS_CAPTIVE_H
+
+#include <Arduino.h>
+#include <WiFi101.h>
+
+#define DNS_CAPTIVE_PORT  53
+#define DNS_CAPTIVE_TTL   60  // s, short so phones ask again after leaving the AP
+#define DNS_CAPTIVE_BUF   128 // longer queries are ignored
+#define DNS_CAPTIVE_POLL  4   // queries answered per dns_captive_service() call
+
+// Minimal DNS server for the access point: every A query is answered with
+// ip, so any host name opens the web interface and the captive portal
+// detection of phones and laptops finds it. Other query types get an empty
+// NOERROR answer (no AAAA, so clients fall back to IPv4).
+void dns_captive_begin(IPAddress ip);
+void dns_captive_stop(void);
+
+// Answers received queries without waiting.
+void dns_captive_service(void);
+
+uint32_t dns_captive_queries(void);
+
+#endif
@@ -0,0 +1,31 @@
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include <Arduino.h>
+
+#define HISTORY_LEN  512 // records in RAM (6 KB), oldest are overwritten
+
+typedef struct
+{
+  uint32_t mono_s; // rtc_clock_mono_ms() / 1000 of the measurement
+  uint16_t co2;    // ppm
+  int16_t temp;    // 0.01 deg C
+  uint16_t humi;   // 0.01 %
+  uint16_t pres;   // 0.1 hPa, 0 = no pressure sensor
+} history_rec_t;
+
+// Ring buffer of the last HISTORY_LEN measurements. Every record gets a
+// sequence number counting up from 0 since boot, so readers can resume
+// where they stopped and notice records that were overwritten.
+void history_add(const history_rec_t *rec);
+
+// Sequence number of the oldest stored record and of the next record to be
+// added; history_first() == history_next() if the buffer is empty.
+uint32_t history_first(void);
+uint32_t history_next(void);
+
+// Copies the record with sequence number seq. Returns false if it was
+// overwritten or does not exist yet.
+bool history_get(uint32_t seq, history_rec_t *rec);
+
+#endif
@@ -0,0 +1,19 @@
+#ifndef HISTORY_HTTP_H
+#define HISTORY_HTTP_H
+
+#include <Arduino.h>
+#include "httpd.h"
+
+#define HISTORY_HTTP_LINE  96 // max. length of one formatted record
+
+// GET /history?from=&to=&res=&seq=&fmt=csv|json|bin
+//  from, to  Unix seconds UTC, inclusive (needs the clock set)
+//  res       min. seconds between two records, 0 = all
+//  seq       first sequence number, to resume after the last record read
+//  fmt       csv (default), json or bin (BINFRAME_REC_LEN byte records)
+// The records are streamed from the history in parts of up to HTTPD_BUF
+// bytes, one part per httpd_service(). X-History-First and X-History-Next
+// give the stored range; the export ends before X-History-Next.
+void history_http(httpd_conn_t *c, const httpd_req_t *req);
+
+#endif
@@ -0,0 +1,122 @@
+#ifndef HTTPD_H
+#define HTTPD_H
+
+#include <Arduino.h>
+#include <WiFi101.h>
+
+#define HTTPD_CONNS     3     // parallel connections (WINC1500: 7 TCP sockets, 1472 bytes RX buffer each)
+#define HTTPD_IDLE_MS   15000 // keep-alive idle timeout
+#define HTTPD_HEAD_MS   5000  // time to receive a complete request head, max. pause in a body
+#define HTTPD_BODY_MS   500   // max. wait for request body bytes in httpd_read_body()
+#define HTTPD_MAX_REQS  500   // requests per connection, then "Connection: close"
+#define HTTPD_STREAMS   2     // stream connections (httpd_stream()), the rest stays free for requests
+#define HTTPD_PIPELINE  4     // requests answered per connection and httpd_service() call
+#define HTTPD_LINE      128   // request line and header lines, longer ones are answered with 414/431
+#define HTTPD_RX        64    // receive staging per connection
+#define HTTPD_HDR       256   // room for the response head in front of the body buffer
+#define HTTPD_BUF       1024  // response body buffer; larger bodies are sent chunked
+#define HTTPD_CTX       24    // per-connection state of a httpd_body_fn
+
+typedef struct
+{
+  char method[8];
+  char path[HTTPD_LINE]; // request target without the query
+  const char *query;     // after '?', "" if none
+  bool http11;
+  bool keep_alive;       // HTTP/1.1 without "Connection: close" or "Connection: keep-alive"
+  uint32_t content_length;
+} httpd_req_t;
+
+typedef struct httpd_conn httpd_conn_t;
+
+#define HTTPD_GET   0x01
+#define HTTPD_POST  0x02
+
+// Called once per complete request. The handler answers with
+// httpd_respond() and the write functions; a handler that does not respond
+// produces a 404. Request body bytes it does not read are skipped.
+typedef void (*httpd_handler_fn)(httpd_conn_t *c, const httpd_req_t *req);
+
+typedef struct
+{
+  const char *key;   // path without query; table sorted by key (cfg_keys.h, case-sensitive)
+  uint8_t methods;   // HTTPD_GET | HTTPD_POST
+  const char *type;  // 200 with this Content-Type is started before fn, NULL = fn responds
+  httpd_handler_fn fn;
+} httpd_route_t;
+
+// Generates a response body step by step, called once per httpd_service()
+// with the HTTPD_CTX bytes returned by httpd_body(). Writes up to
+// httpd_space() bytes, so each part is a single send, and returns false when
+// the body is complete.
+typedef bool (*httpd_body_fn)(httpd_conn_t *c, void *ctx);
+
+typedef struct
+{
+  uint32_t conns;    // accepted TCP connections
+  uint32_t reqs;     // requests answered
+  uint32_t evicted;  // idle keep-alive connections closed for a new one
+  uint32_t rejected; // 503, all connections busy
+  uint32_t timeouts; // idle, incomplete request head or stalled body
+  uint8_t open;      // connections open now
+  uint8_t streams;   // of these stream connections
+} httpd_stats_t;
+
+// Persistent HTTP/1.1 connections on server: requests are read without
+// blocking, answered in order (pipelining), and the connection stays open
+// until the client closes it, HTTPD_IDLE_MS pass without a request or
+// HTTPD_MAX_REQS are reached. Responses are buffered and sent with
+// Content-Length; bodies larger than HTTPD_BUF switch to chunked encoding.
+// Requests are dispatched by binary search in routes: unknown paths get
+// 404, a method the route does not allow 405.
+void httpd_begin(WiFiServer *server, const httpd_route_t *routes, size_t count);
+
+// Accepts new connections, handles received requests and timeouts.
+void httpd_service(void);
+
+// Closes all connections (WiFi lost or restarted).
+void httpd_close_all(void);
+
+// Starts the response. type NULL = no Content-Type. headers are extra
+// header lines, each ending with "\r\n", or NULL.
+void httpd_respond(httpd_conn_t *c, uint16_t status, const char *type, const char *headers);
+void httpd_write(httpd_conn_t *c, const void *data, size_t len);
+void httpd_print(httpd_conn_t *c, const char *s);
+void httpd_printf(httpd_conn_t *c, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+// Writes s escaped for an HTML attribute or text (html) or a JSON string.
+void httpd_escaped(httpd_conn_t *c, const char *s, bool html);
+
+// Copies the value of query parameter name (not URL-decoded) to value.
+// Returns false if the parameter is missing or its value does not fit.
+bool httpd_query(const httpd_req_t *req, const char *name, char *value, size_t size);
+
+// Decodes %XX and '+' of a query or form value in place.
+void httpd_urldecode(char *s);
+
+// Free space in the response buffer.
+size_t httpd_space(httpd_conn_t *c);
+
+// Continues the response started with httpd_respond() with body parts from
+// fn; the main loop runs between the parts. Requests pipelined behind it
+// wait until the body is complete. Returns the zeroed context for fn.
+void *httpd_body(httpd_conn_t *c, httpd_body_fn fn);
+
+// Turns the response into a stream: call before httpd_respond(). The head
+// and what the handler wrote are sent without length, then the connection
+// only receives httpd_broadcast() data until the client closes it. Returns
+// false if HTTPD_STREAMS are open already.
+bool httpd_stream(httpd_conn_t *c);
+
+// Sends data to all stream connections, closing the ones that fail.
+// Returns the number of receivers.
+uint8_t httpd_broadcast(const void *data, size_t len);
+uint8_t httpd_streams(void);
+
+// Reads up to size-1 bytes of the request body (waits at most HTTPD_BODY_MS
+// for missing bytes), terminates buf with 0 and returns the length.
+size_t httpd_read_body(httpd_conn_t *c, char *buf, size_t size);
+
+void httpd_get_stats(httpd_stats_t *stats);
+
+#endif
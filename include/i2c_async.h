@@ -0,0 +1,72 @@
+#ifndef I2C_ASYNC_H
+#define I2C_ASYNC_H
+
+#include <Arduino.h>
+
+#define I2C_BUS0             0  // SERCOM0 (Wire):  SCD30, SCD4x
+#define I2C_BUS1             1  // SERCOM2 (Wire1): LPS22HB, BMP280, ATECC608
+#define I2C_BUSES            2
+#define I2C_ASYNC_QUEUE      8  // power of two, per bus
+#define I2C_ASYNC_TIMEOUT_MS 25 // per bus phase
+
+typedef enum
+{
+  I2C_ASYNC_PENDING,
+  I2C_ASYNC_OK,
+  I2C_ASYNC_NACK,
+  I2C_ASYNC_ERROR,  // bus error or arbitration lost
+  I2C_ASYNC_TIMEOUT
+} i2c_async_status_t;
+
+typedef struct i2c_txn i2c_txn_t;
+
+// Called from the ticker interrupt when the transaction has finished.
+// It may submit the next transaction.
+typedef void (*i2c_done_fn)(i2c_txn_t *txn);
+
+// One transaction: optional write, optional delay (sensor execution time,
+// the bus is released meanwhile with a STOP), optional read. With rlen = 0
+// the delay still passes before the next transaction on the bus starts.
+// The memory belongs to the caller and must stay valid until done.
+struct i2c_txn
+{
+  uint8_t addr;
+  const uint8_t *wbuf;
+  uint8_t wlen;
+  uint16_t delay_ms;
+  uint8_t *rbuf;
+  uint8_t rlen;
+  i2c_done_fn done;
+  void *user;
+  volatile uint8_t status; // i2c_async_status_t
+  uint32_t submit_us;
+};
+
+typedef struct
+{
+  uint32_t txns;
+  uint32_t errors;         // NACK, bus error, timeout
+  uint32_t latency_avg_us; // submit -> done
+  uint32_t latency_max_us;
+  uint8_t utilization;     // % of time with the bus active since the last call
+} i2c_async_stats_t;
+
+// Takes over the SERCOM of the bus in its current (Wire) configuration.
+// Wire.begin()/setClock() must have been called before.
+bool i2c_async_begin(uint8_t bus);
+
+// Queues txn. Returns false if the queue is full.
+bool i2c_async_submit(uint8_t bus, i2c_txn_t *txn);
+
+// True if no transaction is queued or running.
+bool i2c_async_idle(uint8_t bus);
+
+// Waits for the running transaction and holds the queue, so the blocking
+// Wire drivers can use the bus. Queued transactions continue after unlock.
+void i2c_async_lock(uint8_t bus);
+void i2c_async_unlock(uint8_t bus);
+
+// Returns the statistics and restarts the utilization window.
+void i2c_async_get_stats(uint8_t bus, i2c_async_stats_t *stats);
+
+#endif
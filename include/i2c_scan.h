@@ -0,0 +1,31 @@
+#ifndef I2C_SCAN_H
+#define I2C_SCAN_H
+
+#include <Arduino.h>
+#include "i2c_async.h"
+
+#define I2C_SCAN_FIRST       0x08 // 0x00-0x07 and 0x78-0x7F are reserved
+#define I2C_SCAN_LAST        0x77
+#define I2C_SCAN_TIMEOUT_US  1000 // per address, 9 SCL periods are 180us at 50kHz
+#define I2C_SCAN_MAX_ERRORS  4    // scan is aborted after this many errors/timeouts
+
+typedef struct
+{
+  uint32_t map[4];  // bit (addr & 31) of map[addr >> 5]: address acknowledged
+  uint8_t count;    // devices found
+  uint8_t errors;   // bus errors and timeouts, the bus was reset to idle
+  uint32_t time_us; // duration of the scan
+} i2c_scan_t;
+
+// Probes every address from I2C_SCAN_FIRST to I2C_SCAN_LAST once with an
+// address-only write and a STOP, polling the SERCOM status with a
+// microsecond timeout. Runs before i2c_async_begin(); Wire.begin() and
+// setClock() must have been called for the bus. Takes about 20ms at 50kHz.
+void i2c_scan(uint8_t bus);
+
+// True if addr acknowledged during the last scan of bus.
+bool i2c_scan_found(uint8_t bus, uint8_t addr);
+
+const i2c_scan_t *i2c_scan_result(uint8_t bus);
+
+#endif
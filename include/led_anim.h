@@ -0,0 +1,48 @@
+#ifndef LED_ANIM_H
+#define LED_ANIM_H
+
+#include <Adafruit_NeoPixel.h>
+
+// Frame rate of the animation engine (stepped from the ticker interrupt).
+#define LED_ANIM_HZ  100
+
+// Animations render the whole strip with one color. Frames are only pushed
+// when the rendered color changes. Interpolation is integer-only; breathing
+// uses a gamma-corrected envelope table computed once in led_anim_begin(),
+// the brightness a table rebuilt by led_anim_brightness().
+// type gives the byte order of a pixel. show must call show() on the real
+// type of the strip (Adafruit_NeoPixel::show() is not virtual). Frames are
+// sent from the ticker only if show_in_isr is set (NeoPixelDMA: show() just
+// starts the transfer), else led_anim_service() sends them.
+void led_anim_begin(Adafruit_NeoPixel *strip, neoPixelType type, void (*show)(void), bool show_in_isr);
+
+// Sends a frame rendered by the ticker. Call it from the main loop.
+void led_anim_service(void);
+
+// Shows color immediately and stops any animation. Afterwards the strip may be
+// written directly (menu, remote mode) until the next animation is started.
+void led_anim_show(uint32_t color);
+
+// Crossfades from the current color to color within ms milliseconds.
+// Calling it again with the same target keeps the running fade.
+void led_anim_fade(uint32_t color, uint16_t ms);
+
+// Toggles between color_on and color_off at freq_dhz (1/10 Hz per full period).
+void led_anim_blink(uint32_t color_on, uint32_t color_off, uint16_t freq_dhz);
+
+// Breathes color with the given period in milliseconds.
+void led_anim_breathe(uint32_t color, uint16_t period_ms);
+
+// True while a fade, blink or breathe animation needs the ticker or a frame
+// waits for led_anim_service().
+bool led_anim_busy(void);
+
+// Changes the brightness of the animation frames and of the strip (for
+// direct writes) and re-renders the current frame.
+void led_anim_brightness(uint8_t brightness);
+
+// Switches the strip off (blank = true) and back on without losing the
+// animation state. Called from ticker context by the light sensor sampling.
+void led_anim_blank(bool blank);
+
+#endif
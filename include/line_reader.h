@@ -0,0 +1,30 @@
+#ifndef LINE_READER_H
+#define LINE_READER_H
+
+#include <Arduino.h>
+
+#define LINE_READER_LEN  192 // max. line length incl. terminator
+
+typedef enum
+{
+  LINE_NONE,     // no complete line yet
+  LINE_READY,    // line holds a complete line
+  LINE_OVERFLOW  // a line longer than LINE_READER_LEN - 1 was dropped
+} line_status_t;
+
+typedef struct
+{
+  char buf[LINE_READER_LEN];
+  size_t len;
+  bool overflow; // dropping the rest of a too long line
+} line_reader_t;
+
+void line_reader_init(line_reader_t *lr);
+
+// Consumes the bytes that are already available from in, never waits.
+// A line ends with LF, CR or CRLF; empty lines are skipped. Partial lines
+// stay in the buffer until the next call. After LINE_READY, *line points to
+// the zero terminated line in lr->buf, valid until the next call.
+line_status_t line_reader_poll(line_reader_t *lr, Stream *in, char **line);
+
+#endif
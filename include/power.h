@@ -0,0 +1,31 @@
+#ifndef POWER_H
+#define POWER_H
+
+#include <Arduino.h>
+
+#define POWER_MIN_MS   5    // shorter pauses are not worth the wakeup
+#define POWER_CATCHUP  64   // ms added to millis() per interrupt lock after STANDBY
+
+typedef struct
+{
+  uint32_t active_ms;  // since the last call
+  uint32_t standby_ms; // since the last call
+  uint32_t wakeups;
+} power_stats_t;
+
+// Starts the RTC (rtc_clock, used as wakeup timer) and clocks the EIC from
+// its generator, which keeps running in STANDBY. Every enabled external
+// interrupt (button, WINC1500) then also wakes the MCU. Safe to call more
+// than once.
+void power_begin(void);
+
+// Enters STANDBY for up to ms milliseconds; an external interrupt ends it
+// earlier. The caller must make sure no ticker job, DMA transfer or USB
+// connection is active. millis() is advanced by the time spent asleep.
+// Returns the time slept in ms.
+uint32_t power_standby(uint32_t ms);
+
+// Returns the active/standby time since the last call and restarts the window.
+void power_get_stats(power_stats_t *stats);
+
+#endif
@@ -0,0 +1,48 @@
+#ifndef RTC_CLOCK_H
+#define RTC_CLOCK_H
+
+#include <Arduino.h>
+
+#define RTC_CLOCK_GCLK       6      // OSC32K, runs in STANDBY (not used by the Arduino core)
+#define RTC_CLOCK_HZ         1024   // RTC count rate (OSC32K / 32)
+#define RTC_CLOCK_DRIFT_MIN  3600   // s between two syncs before the drift is estimated
+#define RTC_CLOCK_DRIFT_MAX  50000  // ppm, OSC32K tolerance over temperature
+#define RTC_CLOCK_UNSYNCED   0xFFFFFFFFUL
+
+typedef struct
+{
+  uint32_t syncs;
+  uint32_t age_s;       // since the last sync, RTC_CLOCK_UNSYNCED if never
+  int32_t drift_ppm;    // applied correction, > 0: RTC runs slow
+  int32_t last_step_ms; // correction applied by the last sync
+} rtc_clock_stats_t;
+
+// Runs the RTC as a free 32 bit counter from OSC32K through GCLK6 (also in
+// STANDBY) and extends it to 64 bit in the overflow interrupt. Safe to call
+// more than once.
+void rtc_clock_begin(void);
+
+// Monotonic time since rtc_clock_begin() in ms. Does not wrap and keeps
+// counting in STANDBY, unlike millis().
+uint64_t rtc_clock_mono_ms(void);
+
+// Raw 32 bit counter and a one-shot compare interrupt (wakeup from STANDBY).
+uint32_t rtc_clock_ticks(void);
+void rtc_clock_alarm(uint32_t ticks);
+void rtc_clock_alarm_off(void);
+
+// Sets UTC from a time server (Unix seconds). Repeated syncs at least
+// RTC_CLOCK_DRIFT_MIN apart estimate the OSC32K drift, which is then
+// corrected continuously between syncs.
+void rtc_clock_sync(uint32_t unix_s);
+
+// True once UTC has been set.
+bool rtc_clock_valid(void);
+
+// Unix seconds now, or of a rtc_clock_mono_ms() time stamp. 0 if not synced.
+uint32_t rtc_clock_utc(void);
+uint32_t rtc_clock_to_utc(uint64_t mono_ms);
+
+void rtc_clock_get_stats(rtc_clock_stats_t *stats);
+
+#endif
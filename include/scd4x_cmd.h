@@ -0,0 +1,28 @@
+#ifndef SCD4X_CMD_H
+#define SCD4X_CMD_H
+
+#include <Arduino.h>
+
+#define SCD4X_CMD_QUEUE  4 // power of two
+
+// Command queue for SCD4x commands that are allowed during periodic
+// measurement. Commands are sent as i2c_async transactions whose delay
+// covers the execution time of the sensor, so the next transfer on the
+// bus (command or measurement read) only starts once the sensor is ready.
+void scd4x_cmd_begin(uint8_t bus, uint8_t addr);
+
+// Queues set_ambient_pressure (0xE000). A pending pressure update is
+// replaced instead of queued twice. Returns false if the queue is full.
+bool scd4x_cmd_set_ambient_pressure(uint16_t hpa);
+
+// Submits the next queued command once the previous one has finished.
+// Call it from the main loop; it never blocks.
+void scd4x_cmd_service(void);
+
+// True while the last command is being sent or executed.
+bool scd4x_cmd_busy(void);
+
+// Number of commands that were not acknowledged.
+uint32_t scd4x_cmd_errors(void);
+
+#endif
@@ -0,0 +1,77 @@
+#ifndef SENSOR_ASYNC_H
+#define SENSOR_ASYNC_H
+
+#include <Arduino.h>
+
+#define SENSOR_ASYNC_STEP_MS    20   // data-ready retry / phase correction step
+#define SENSOR_ASYNC_PRES_MS    1000 // pressure read interval without CO2 sensor
+#define SENSOR_SCD4X_SHOT_MS    5000 // measure_single_shot execution time (SCD41)
+#define SENSOR_LPS22HB_ONESHOT  50   // ms, one-shot conversion time
+
+typedef enum
+{
+  SENSOR_NONE,
+  SENSOR_SCD30,
+  SENSOR_SCD4X,
+  SENSOR_LPS22HB,
+  SENSOR_BMP280
+} sensor_type_t;
+
+typedef struct
+{
+  uint16_t co2;
+  float temp;
+  float humi;
+} co2_sample_t;
+
+typedef struct
+{
+  float pres; // hPa
+  float temp; // deg C, without offset
+} pres_sample_t;
+
+typedef struct
+{
+  uint32_t samples; // CO2 measurements read
+  uint32_t checks;  // data-ready status reads
+  uint32_t errors;  // samples dropped because of a CRC or bus error
+} sensor_async_stats_t;
+
+// Acquisition drivers on top of i2c_async: CO2 sensor on I2C_BUS0, pressure
+// sensor on I2C_BUS1. The sensors must already be configured and measuring
+// (library begin()). Transfers are chained in the ticker callbacks, so a
+// measurement completes while the main loop is busy elsewhere.
+// co2_period_s is the measurement interval of the CO2 sensor; the data-ready
+// status is only checked around the time the next sample is expected.
+void sensor_async_begin(uint8_t co2_type, uint16_t co2_period_s, uint8_t pres_type, uint8_t pres_addr);
+
+// Changes the measurement interval, e.g. after switching the SCD4x to
+// low-power periodic measurement. With single_shot (SCD41 only) the sensor
+// stays idle and a measure_single_shot is triggered every co2_period_s.
+void sensor_async_mode(uint16_t co2_period_s, bool single_shot);
+
+// Time in ms until the next scheduled transfer, 0 while one is running or
+// a sample waits to be read. Bounds the MCU standby time.
+uint32_t sensor_async_idle_ms(void);
+
+// Optional data-ready pin of the SCD30 (RDY, high while new data is
+// available). -1 = not connected, the status word is polled instead.
+void sensor_async_rdy_pin(int8_t pin);
+
+// Starts the measurement read when new data is signalled, the data-ready
+// check when the next sample is due and the pressure read once per CO2
+// sample. Never blocks; call it as often as possible.
+void sensor_async_poll(void);
+
+// Returns true once per new CO2 sample.
+bool sensor_async_co2(co2_sample_t *s);
+
+// Returns the latest pressure sample, false if there is none yet.
+bool sensor_async_pres(pres_sample_t *s);
+
+void sensor_async_get_stats(sensor_async_stats_t *stats);
+
+// CRC-8 of a Sensirion data word (polynomial 0x31, init 0xFF).
+uint8_t sensirion_crc8(const uint8_t *data);
+
+#endif
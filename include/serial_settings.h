@@ -2,6 +2,7 @@
 #define SERIAL_SETTINGS_H
 
 #include <Arduino.h>
+#include "cfg_keys.h"
 
 typedef enum
 {
@@ -11,7 +12,7 @@ typedef enum
   CFG_BOOL,
   CFG_STRING,
   CFG_COLOR,
-  CFG_IP
+  CFG_IP      // uint32_t a.b.c.d with a in the low byte, as uint32_t(IPAddress)
 } cfg_type_t;
 
 typedef struct cfg_item cfg_item_t;
@@ -28,15 +29,61 @@ struct cfg_item
   cfg_apply_fn apply;
 };
 
+// Transaction state (begin/commit/abort). set stages the value in stage,
+// a copy of the size bytes at base that all item pointers point into.
+// commit checks the staged values with validate (may be NULL, returns an
+// error message or NULL), copies them to base, runs each apply hook of the
+// changed items once and saves once. Must persist between lines.
+typedef struct
+{
+  void *base;
+  void *stage;
+  size_t size;
+  const char *(*validate)(void *user, const void *staged);
+  bool open;
+} serial_settings_tx_t;
+
 typedef struct
 {
   void *user;
   bool remote_on;
   Print *out;
   bool (*on_save)(void *user);
+  serial_settings_tx_t *tx; // NULL = no transactions
 } serial_settings_ctx_t;
 
+// Typed value of an item: u for numbers, bool (0/1), colors and IPs
+// (a.b.c.d = bits 0-7 .. 24-31), s for strings.
+typedef struct
+{
+  uint32_t u;
+  const char *s;
+} cfg_value_t;
+
+// Checks (range, length) and stores one value like the set command, staged
+// while a transaction is open, otherwise followed by the apply hook.
+// Returns NULL or the error message. Does not check ctx->remote_on.
+const char *serial_settings_store(const serial_settings_ctx_t *ctx, const cfg_item_t *item, const cfg_value_t *v);
+
+// Reads the active value of an item.
+void serial_settings_load(const cfg_item_t *item, cfg_value_t *v);
+
+// Parses text for an item like the set command (numbers decimal or hex,
+// bool 0/1/true/false/on/off, IP a.b.c.d); v->s points into text.
+// Returns NULL or the error message.
+const char *serial_settings_parse(const cfg_item_t *item, const char *text, cfg_value_t *v);
+
+// Prints the active value in the format of get.
+void serial_settings_print(Print *out, const cfg_item_t *item);
+
+// begin/commit for other front ends (web): same checks, apply hooks and
+// single save as the text commands. Return NULL or the error message.
+const char *serial_settings_begin(const serial_settings_ctx_t *ctx);
+const char *serial_settings_commit(const serial_settings_ctx_t *ctx, const cfg_item_t *items, size_t item_count);
+
 // Parses and handles one line. The line buffer is modified in-place.
+// items must be sorted by key (check with cfg_keys_sorted() in a
+// static_assert), keys are looked up by binary search.
 // Returns true if the line was handled, false if it was not recognized.
 bool serial_settings_handle_line(char *line,
                                  const cfg_item_t *items,
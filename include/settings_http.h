@@ -0,0 +1,29 @@
+#ifndef SETTINGS_HTTP_H
+#define SETTINGS_HTTP_H
+
+#include <Arduino.h>
+#include "httpd.h"
+#include "serial_settings.h"
+
+#define SETTINGS_HTTP_PAIR  224 // max. length of one urlencoded key=value pair in a POST
+#define SETTINGS_HTTP_LINE  256 // buffer space kept free per rendered item
+
+// Settings over HTTP from the same cfg_item_t table, checks and
+// transaction as the serial protocol. get_ctx fills the context (out is
+// not used); remote_on = false makes both pages read only (POST: 403).
+// Values of keys ending in ".pass" are never sent.
+void settings_http_begin(const cfg_item_t *items, size_t count, void (*get_ctx)(serial_settings_ctx_t *ctx));
+
+// GET /api/settings: {"key":value,...}. POST key=value&... (urlencoded):
+// all values are parsed and range checked into the staged copy, then
+// committed with the apply hooks and one flash write. On any error
+// nothing changes and the answer is 400 with the error and the key.
+// Read only: 403 {"ok":false,"error":"..."}.
+void settings_http_api(httpd_conn_t *c, const httpd_req_t *req);
+
+// GET /settings: HTML form with every key. POST applies the form like
+// /api/settings (empty password fields keep the stored value) and shows
+// the page with the result. Read only: the page notes it, a POST gets 403.
+void settings_http_page(httpd_conn_t *c, const httpd_req_t *req);
+
+#endif
@@ -0,0 +1,52 @@
+#ifndef SETTINGS_SCHEMA_H
+#define SETTINGS_SCHEMA_H
+
+// Settings schema: one list for the key table (serial/binary protocol), the
+// defaults and the range check of stored settings. Sorted by key (binary
+// search in serial_settings), checked by a static_assert in main.cpp.
+// Only the key (first argument) may be used outside the firmware, e.g. by
+// tools/settings_lookup_bench.cpp; the other names are defined in main.cpp.
+//   X_NUM(key, type, field, min, max, default, apply)
+//   X_BOOL(key, field, default, apply)
+//   X_STR(key, field, default, apply)
+//   X_IP(key, field, default, apply)
+#define SETTINGS_SCHEMA(X_NUM, X_BOOL, X_STR, X_IP) \
+  X_NUM ("buzzer.pattern.t3", CFG_U8,    buzzer_pattern[0], 0,   BUZZER_PATTERNS-1, BUZZER_MUSTER_T3, NULL) \
+  X_NUM ("buzzer.pattern.t4", CFG_U8,    buzzer_pattern[1], 0,   BUZZER_PATTERNS-1, BUZZER_MUSTER_T4, NULL) \
+  X_NUM ("buzzer.pattern.t5", CFG_U8,    buzzer_pattern[2], 0,   BUZZER_PATTERNS-1, BUZZER_MUSTER_T5, NULL) \
+  X_NUM ("co2.t1",            CFG_U32,   range[0],          400, 10000,    DEFAULT_T1,       NULL) \
+  X_NUM ("co2.t2",            CFG_U32,   range[1],          400, 10000,    DEFAULT_T2,       NULL) \
+  X_NUM ("co2.t3",            CFG_U32,   range[2],          400, 10000,    DEFAULT_T3,       NULL) \
+  X_NUM ("co2.t4",            CFG_U32,   range[3],          400, 10000,    DEFAULT_T4,       NULL) \
+  X_NUM ("co2.t5",            CFG_U32,   range[4],          400, 10000,    DEFAULT_T5,       NULL) \
+  X_NUM ("led.color.t1",      CFG_COLOR, color_t1,          0,   0xFFFFFF, DEFAULT_COLOR_T1, NULL) \
+  X_NUM ("led.color.t2",      CFG_COLOR, color_t2,          0,   0xFFFFFF, DEFAULT_COLOR_T2, NULL) \
+  X_NUM ("led.color.t3",      CFG_COLOR, color_t3,          0,   0xFFFFFF, DEFAULT_COLOR_T3, NULL) \
+  X_NUM ("led.color.t4",      CFG_COLOR, color_t4,          0,   0xFFFFFF, DEFAULT_COLOR_T4, NULL) \
+  X_NUM ("light.bright",      CFG_U16,   light_bright,      0,   1023,     LICHT_HELL,       apply_light) \
+  X_NUM ("light.dark",        CFG_U16,   light_dark,        0,   1023,     LICHT_DUNKEL,     apply_light) \
+  X_NUM ("light.interval",    CFG_U16,   light_interval,    1,   3600,     LICHT_INTERVALL,  apply_light) \
+  X_STR ("mqtt.broker",       mqtt_broker,                  MQTT_BROKER,                     NULL) \
+  X_STR ("mqtt.client_id",    mqtt_client_id,               MQTT_CLIENT_ID,                  NULL) \
+  X_BOOL("mqtt.enabled",      mqtt_enabled,                 MQTT_ENABLED,                    NULL) \
+  X_NUM ("mqtt.interval",     CFG_U32,   mqtt_interval,     10,  3600,     MQTT_INTERVAL,    NULL) \
+  X_STR ("mqtt.pass",         mqtt_pass,                    MQTT_PASS,                       NULL) \
+  X_NUM ("mqtt.port",         CFG_U32,   mqtt_port,         1,   65535,    MQTT_PORT,        NULL) \
+  X_STR ("mqtt.topic_prefix", mqtt_topic_prefix,            MQTT_TOPIC_PREFIX,               NULL) \
+  X_STR ("mqtt.user",         mqtt_user,                    MQTT_USER,                       NULL) \
+  X_NUM ("power.interval",    CFG_U16,   power_interval,    30,  3600,     POWER_INTERVALL,  apply_power) \
+  X_NUM ("power.profile",     CFG_U8,    power_profile,     0,   2,        POWER_PROFIL,     apply_power) \
+  X_NUM ("sys.brightness",    CFG_U32,   brightness,        0,   255,      HELLIGKEIT,       apply_brightness) \
+  X_NUM ("sys.buzzer",        CFG_U32,   buzzer,            0,   1,        BUZZER,           NULL) \
+  X_BOOL("sys.serial_output", serial_output,                false,                           NULL) \
+  X_BOOL("web.settings",      web_settings,                 false,                           NULL) \
+  X_IP  ("wifi.dns",          wifi_dns,                     0,                               NULL) \
+  X_IP  ("wifi.gateway",      wifi_gateway,                 0,                               NULL) \
+  X_IP  ("wifi.ip",           wifi_ip,                      0,                               NULL) \
+  X_NUM ("wifi.listen",       CFG_U8,    wifi_listen,       1,   10,       WIFI_LISTEN,      apply_wifi_power) \
+  X_STR ("wifi.pass",         wifi_code,                    WIFI_CODE,                       NULL) \
+  X_NUM ("wifi.power",        CFG_U8,    wifi_power,        0,   3,        WIFI_POWER,       apply_wifi_power) \
+  X_STR ("wifi.ssid",         wifi_ssid,                    WIFI_SSID,                       NULL) \
+  X_IP  ("wifi.subnet",       wifi_subnet,                  0,                               NULL)
+
+#endif
@@ -0,0 +1,24 @@
+#ifndef TICKER_H
+#define TICKER_H
+
+#include <Arduino.h>
+
+// TC4 runs a 1 kHz interrupt that calls registered handlers at their period.
+#define TICKER_HZ     1000
+#define TICKER_SLOTS  6
+
+// Called from the TC4 interrupt (lowest NVIC priority). Keep it short.
+typedef void (*ticker_fn)(void);
+
+// Configures and starts TC4. Safe to call more than once.
+void ticker_begin(void);
+
+// Registers fn to be called every period_ms milliseconds.
+// Returns false if all slots are in use.
+bool ticker_attach(ticker_fn fn, uint16_t period_ms);
+
+// Masks the ticker interrupt while the main loop updates state shared with handlers.
+void ticker_lock(void);
+void ticker_unlock(void);
+
+#endif
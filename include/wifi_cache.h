@@ -0,0 +1,37 @@
+#ifndef WIFI_CACHE_H
+#define WIFI_CACHE_H
+
+#include <Arduino.h>
+#include "band_store.h"
+
+#define WIFI_CACHE_ADDR   (BAND_STORE_ADDR - 256) // flash row in front of the band_store row
+#define WIFI_CACHE_SLOTS  8                       // 32 byte entries per row, one row erase per 8 writes
+
+typedef struct
+{
+  uint32_t cred;       // hash of SSID and password the entry belongs to
+  uint8_t bssid[6];    // access point of the last connection
+  uint16_t flags;      // reserved, 0
+  uint32_t ip;         // last DHCP lease (or static address)
+  uint32_t gateway;
+  uint32_t subnet;
+  uint32_t connect_ms; // time to connected of the last full connect (scan on all channels)
+  uint32_t reserved;
+  uint16_t pad;
+  uint16_t crc;        // CRC-16 over the bytes before
+} wifi_cache_t;
+
+// Last good connection in flash, so a reconnect or reboot can tell whether
+// the credentials stored in the WINC1500 belong to the configured network
+// and try the fast path first. Entries are appended to one flash row like
+// the band_store; an entry is only written when something differs from
+// the stored one (new credentials, roaming to another AP, new lease).
+
+// Returns the newest valid entry, false if there is none.
+bool wifi_cache_read(wifi_cache_t *entry);
+
+// Stores entry unless it equals the newest one (interrupts are disabled
+// for about 3 ms, 9 ms when the row has to be erased).
+void wifi_cache_write(const wifi_cache_t *entry);
+
+#endif
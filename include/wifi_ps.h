@@ -0,0 +1,48 @@
+#ifndef WIFI_PS_H
+#define WIFI_PS_H
+
+#include <Arduino.h>
+#include <WiFi101.h>
+
+#define WIFI_PS_HOLD_MS  2000 // radio stays on after traffic (TCP ACKs, replies)
+#define WIFI_PS_LEAD_MS  1000 // radio is switched on before scheduled traffic
+
+typedef enum
+{
+  WIFI_PS_OFF = 0, // radio always on
+  WIFI_PS_AUTO,    // M2M_PS_AUTOMATIC, wakes at every DTIM beacon
+  WIFI_PS_DEEP     // M2M_PS_DEEP_AUTOMATIC, wakes every listen interval
+} wifi_ps_mode_t;
+
+typedef struct
+{
+  uint32_t awake_ms; // radio on: traffic, scheduled traffic ahead
+  uint32_t light_ms; // M2M_PS_AUTOMATIC while HTTP connections are open
+  uint32_t sleep_ms; // configured mode while idle
+  uint32_t switches; // sleep mode changes
+  uint8_t mode;      // configured wifi_ps_mode_t
+  uint8_t listen;    // listen interval in beacons
+} wifi_ps_stats_t;
+
+// Configures the power-save mode for the next connection; call before
+// WiFi.begin(), the listen interval is announced when associating. The
+// radio stays on until the first wifi_ps_service().
+void wifi_ps_begin(wifi_ps_mode_t mode, uint8_t listen);
+
+// Connection closed: time is no longer counted.
+void wifi_ps_stop(void);
+
+// Traffic now (e.g. MQTT publish): radio on for WIFI_PS_HOLD_MS.
+void wifi_ps_traffic(void);
+
+// Picks the sleep mode while connected: on during and right after
+// traffic and WIFI_PS_LEAD_MS before next_ms (ms until the next scheduled
+// transfer, 0xFFFFFFFF = none); M2M_PS_AUTOMATIC while busy (keep-alive
+// connections waiting for requests); the configured mode otherwise.
+// Only changes are sent to the WINC1500.
+void wifi_ps_service(bool busy, uint32_t next_ms);
+
+// Time per sleep mode since the last call, restarts the window.
+void wifi_ps_get_stats(wifi_ps_stats_t *stats);
+
+#endif
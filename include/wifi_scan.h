@@ -0,0 +1,35 @@
+#ifndef WIFI_SCAN_H
+#define WIFI_SCAN_H
+
+#include <Arduino.h>
+#include <WiFi101.h>
+#include "httpd.h"
+
+#define WIFI_SCAN_MAX  16 // networks kept, the weakest are dropped
+
+typedef struct
+{
+  char ssid[32+1];
+  int8_t rssi;     // dBm
+  uint8_t enc;     // ENC_TYPE_*
+  uint8_t channel;
+} wifi_scan_net_t;
+
+// Scans once with WiFi.scanNetworks() (blocks up to 5s) and caches the
+// visible networks: hidden SSIDs are skipped, an SSID seen on several
+// access points is kept once with the strongest RSSI, sorted by RSSI.
+// The WINC1500 cannot scan in AP mode, so run it before WiFi.beginAP().
+// Returns the number of cached networks.
+uint8_t wifi_scan_run(void);
+
+uint8_t wifi_scan_count(void);
+const wifi_scan_net_t *wifi_scan_get(uint8_t i);
+
+// Age of the cache in s, 0xFFFFFFFF if there was no scan.
+uint32_t wifi_scan_age(void);
+
+// GET /api/scan: [{"ssid":"...","rssi":-60,"enc":true,"ch":6},...] from
+// the cache, no new scan.
+void wifi_scan_http(httpd_conn_t *c, const httpd_req_t *req);
+
+#endif
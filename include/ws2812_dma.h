@@ -0,0 +1,34 @@
+#ifndef WS2812_DMA_H
+#define WS2812_DMA_H
+
+#include <Adafruit_NeoPixel.h>
+
+// SPI clock for the encoded bit stream: 3 SPI bits per WS2812 bit (800 kHz).
+#define WS2812_SPI_HZ       2400000UL
+// Zero bytes appended to every frame as reset/latch (> 280us at 2.4 MHz).
+#define WS2812_LATCH_BYTES  90
+
+// Drop-in replacement for Adafruit_NeoPixel that clocks the frame out via
+// SERCOM3 SPI (PA22 = PAD0) fed by the DMA controller.
+// show() only encodes the pixel buffer (1 -> 110, 0 -> 100) and returns while
+// the transfer runs in the background; interrupts stay enabled.
+// If the pin is not PA22 or no DMA channel is free, the bit-banged
+// Adafruit_NeoPixel::show() is used instead.
+class NeoPixelDMA : public Adafruit_NeoPixel
+{
+  public:
+    NeoPixelDMA(uint16_t n, int16_t pin, neoPixelType type);
+    ~NeoPixelDMA();
+
+    void begin(void);
+    void show(void);
+    bool canShow(void);
+    bool isDMA(void) const { return dma_channel >= 0; }
+
+  private:
+    uint8_t *spi_buf;
+    uint16_t spi_len;
+    int dma_channel;
+};
+
+#endif
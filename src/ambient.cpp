@@ -0,0 +1,283 @@
+#include "ambient.h"
+#include "ticker.h"
+#include "led_anim.h"
+#include "wiring_private.h"
+
+typedef enum
+{
+  AMB_IDLE,
+  AMB_POWER,
+  AMB_SETTLE,
+  AMB_CONVERT
+} amb_state_t;
+
+static uint8_t amb_pin_power = 0;
+static uint8_t amb_channel = 0;
+static bool amb_ready = false;
+static volatile bool amb_enabled = false;
+static volatile amb_state_t amb_state = AMB_IDLE;
+static volatile uint32_t amb_wait = 0;   // ms left in the current phase
+static volatile uint32_t amb_due = 0;    // millis() of the next sample, also across MCU standby
+
+static uint16_t amb_dark_th = 20;
+static uint16_t amb_bright_th = 40;
+static uint32_t amb_interval_ms = 60000UL;
+
+// Conversion result, handed from the ADC interrupt to the tick handler.
+static volatile bool amb_done = false;
+static volatile uint16_t amb_raw = 0;
+static volatile bool amb_outside = false;
+
+static uint32_t amb_smooth = 0; // value * 16
+static bool amb_valid = false;
+static bool amb_dark = false;
+static bool amb_new = false;
+
+static void adc_sync(void)
+{
+  while(ADC->STATUS.bit.SYNCBUSY);
+}
+
+static void adc_start(bool irq)
+{
+  ADC->CTRLA.bit.ENABLE = 0;
+  adc_sync();
+
+  // 1.5 MHz ADC clock, 16 accumulated 12 bit samples shifted back to 12 bit
+  ADC->REFCTRL.reg = ADC_REFCTRL_REFSEL_INTVCC1;
+  ADC->CTRLB.reg = ADC_CTRLB_PRESCALER_DIV32 | ADC_CTRLB_RESSEL_16BIT;
+  adc_sync();
+  ADC->AVGCTRL.reg = ADC_AVGCTRL_SAMPLENUM_16 | ADC_AVGCTRL_ADJRES(4);
+  ADC->SAMPCTRL.reg = ADC_SAMPCTRL_SAMPLEN(31); // high-impedance source
+  ADC->INPUTCTRL.reg = ADC_INPUTCTRL_GAIN_DIV2 | ADC_INPUTCTRL_MUXNEG_GND | ADC_INPUTCTRL_MUXPOS(amb_channel);
+  adc_sync();
+
+  // Window monitor flags a raw sample outside dark...bright (12 bit compare)
+  ADC->WINLT.reg = (uint32_t)amb_dark_th << 2;
+  adc_sync();
+  ADC->WINUT.reg = (uint32_t)amb_bright_th << 2;
+  adc_sync();
+  ADC->WINCTRL.reg = ADC_WINCTRL_WINMODE_MODE4;
+  adc_sync();
+
+  ADC->INTFLAG.reg = ADC_INTFLAG_RESRDY | ADC_INTFLAG_WINMON;
+  if(irq)
+  {
+    ADC->INTENSET.reg = ADC_INTENSET_RESRDY;
+  }
+
+  ADC->CTRLA.bit.ENABLE = 1;
+  adc_sync();
+  ADC->SWTRIG.reg = ADC_SWTRIG_START;
+}
+
+static void adc_stop(void)
+{
+  ADC->INTENCLR.reg = ADC_INTENCLR_RESRDY;
+  ADC->CTRLA.bit.ENABLE = 0;
+  adc_sync();
+
+  // Back to the Arduino core setup so analogRead() keeps working.
+  ADC->CTRLB.reg = ADC_CTRLB_PRESCALER_DIV512 | ADC_CTRLB_RESSEL_10BIT;
+  adc_sync();
+  ADC->AVGCTRL.reg = ADC_AVGCTRL_SAMPLENUM_1 | ADC_AVGCTRL_ADJRES(0);
+  ADC->SAMPCTRL.reg = ADC_SAMPCTRL_SAMPLEN(0x3F);
+  ADC->WINCTRL.reg = ADC_WINCTRL_WINMODE_DISABLE;
+  adc_sync();
+  ADC->INTFLAG.reg = ADC_INTFLAG_RESRDY | ADC_INTFLAG_WINMON;
+}
+
+static void amb_schedule(uint32_t ms)
+{
+  amb_due = millis() + ms;
+}
+
+static void amb_release(void)
+{
+  led_anim_blank(false);
+  digitalWrite(amb_pin_power, LOW);
+  amb_state = AMB_IDLE;
+}
+
+static void amb_finish(uint16_t raw, bool outside)
+{
+  uint32_t value;
+
+  amb_release();
+
+  if(!amb_valid)
+  {
+    amb_smooth = (uint32_t)raw << 4;
+    amb_valid = true;
+  }
+  else
+  {
+    amb_smooth = amb_smooth + ((int32_t)(((uint32_t)raw << 4) - amb_smooth) / 4); // EMA, alpha 1/4
+  }
+  value = amb_smooth >> 4;
+
+  if(!amb_dark && (value < amb_dark_th))
+  {
+    amb_dark = true;
+  }
+  else if(amb_dark && (value > amb_bright_th))
+  {
+    amb_dark = false;
+  }
+  amb_new = true;
+
+  // A raw value across the window that the smoothed state does not follow yet:
+  // sample again soon instead of waiting a full interval.
+  if(outside && (amb_dark != (raw < amb_dark_th)))
+  {
+    amb_schedule(AMBIENT_FAST_S * 1000UL);
+  }
+  else
+  {
+    amb_schedule(amb_interval_ms);
+  }
+}
+
+static void amb_tick(void)
+{
+  if(!amb_enabled)
+  {
+    return;
+  }
+
+  switch(amb_state)
+  {
+    case AMB_IDLE:
+      if((int32_t)(millis() - amb_due) >= 0)
+      {
+        digitalWrite(amb_pin_power, HIGH);
+        amb_wait = AMBIENT_POWER_MS;
+        amb_state = AMB_POWER;
+      }
+      break;
+    case AMB_POWER:
+      if(--amb_wait == 0)
+      {
+        led_anim_blank(true); // pushes a dark frame right away
+        amb_wait = AMBIENT_SETTLE_MS;
+        amb_state = AMB_SETTLE;
+      }
+      break;
+    case AMB_SETTLE:
+      if(--amb_wait == 0)
+      {
+        amb_wait = 5; // conversion takes < 1 ms
+        amb_state = AMB_CONVERT;
+        amb_done = false;
+        adc_start(true);
+      }
+      break;
+    case AMB_CONVERT:
+      if(amb_done)
+      {
+        amb_finish(amb_raw, amb_outside);
+      }
+      else if(--amb_wait == 0) // no result, try again next interval
+      {
+        adc_stop();
+        amb_release();
+        amb_schedule(amb_interval_ms);
+      }
+      break;
+  }
+}
+
+void ADC_Handler(void)
+{
+  amb_raw = ADC->RESULT.reg >> 2; // 12 -> 10 bit
+  amb_outside = ADC->INTFLAG.bit.WINMON;
+  adc_stop();
+  amb_done = true;
+}
+
+void ambient_begin(uint8_t pin_sensor, uint8_t pin_power)
+{
+  amb_pin_power = pin_power;
+  amb_channel = g_APinDescription[pin_sensor].ulADCChannelNumber;
+
+  pinMode(pin_power, OUTPUT);
+  digitalWrite(pin_power, LOW);
+  pinPeripheral(pin_sensor, PIO_ANALOG);
+
+  NVIC_ClearPendingIRQ(ADC_IRQn);
+  NVIC_SetPriority(ADC_IRQn, 3); // same level as the ticker, they never preempt each other
+  NVIC_EnableIRQ(ADC_IRQn);
+
+  if(!amb_ready)
+  {
+    amb_ready = true;
+    ticker_begin();
+    ticker_attach(amb_tick, 1);
+  }
+}
+
+void ambient_config(uint16_t dark, uint16_t bright, uint16_t interval_s)
+{
+  ticker_lock();
+  amb_dark_th = dark;
+  amb_bright_th = (bright > dark) ? bright : dark;
+  amb_interval_ms = (interval_s > 0 ? interval_s : 1) * 1000UL;
+  if((amb_state == AMB_IDLE) && ((int32_t)(amb_due - millis()) > (int32_t)amb_interval_ms))
+  {
+    amb_schedule(amb_interval_ms);
+  }
+  ticker_unlock();
+}
+
+void ambient_enable(bool on)
+{
+  ticker_lock();
+  NVIC_DisableIRQ(ADC_IRQn);
+  if(on && !amb_enabled)
+  {
+    amb_schedule(amb_valid ? amb_interval_ms : 1000); // first sample 1 s after start
+    amb_state = AMB_IDLE;
+  }
+  else if(!on && (amb_state != AMB_IDLE))
+  {
+    adc_stop();
+    amb_release();
+  }
+  amb_enabled = on;
+  NVIC_EnableIRQ(ADC_IRQn);
+  ticker_unlock();
+}
+
+bool ambient_busy(void)
+{
+  return amb_enabled && (amb_state != AMB_IDLE);
+}
+
+bool ambient_poll(uint16_t *value, bool *dark)
+{
+  bool ret;
+
+  ticker_lock();
+  ret = amb_new;
+  amb_new = false;
+  *value = amb_smooth >> 4;
+  *dark = amb_dark;
+  ticker_unlock();
+
+  return ret;
+}
+
+uint16_t ambient_read(void)
+{
+  uint16_t raw;
+
+  digitalWrite(amb_pin_power, HIGH);
+  delay(AMBIENT_POWER_MS);
+  adc_start(false);
+  while(ADC->INTFLAG.bit.RESRDY == 0);
+  raw = ADC->RESULT.reg >> 2;
+  adc_stop();
+  digitalWrite(amb_pin_power, LOW);
+
+  return raw;
+}
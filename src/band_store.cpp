@@ -0,0 +1,69 @@
+#include "band_store.h"
+
+#define BAND_EMPTY  0xFFFFFFFFUL
+
+static int band_next = -1; // next free slot, -1 = row not scanned yet
+
+static bool band_valid(uint32_t e)
+{
+  return (uint16_t)(e >> 16) == (uint16_t)~e;
+}
+
+static void band_scan(void)
+{
+  const volatile uint32_t *row = (const volatile uint32_t *)BAND_STORE_ADDR;
+
+  band_next = BAND_STORE_SLOTS;
+  for(int i = 0; i < BAND_STORE_SLOTS; i++)
+  {
+    if(row[i] == BAND_EMPTY)
+    {
+      band_next = i;
+      break;
+    }
+  }
+}
+
+bool band_store_read(uint16_t *co2)
+{
+  const volatile uint32_t *row = (const volatile uint32_t *)BAND_STORE_ADDR;
+
+  band_scan();
+  for(int i = band_next - 1; i >= 0; i--) // newest first, skips interrupted writes
+  {
+    uint32_t e = row[i];
+    if(band_valid(e))
+    {
+      *co2 = (uint16_t)e;
+      return true;
+    }
+  }
+  return false;
+}
+
+void band_store_write(uint16_t co2)
+{
+  if(band_next < 0)
+  {
+    band_scan();
+  }
+
+  __disable_irq();
+  if(band_next >= BAND_STORE_SLOTS)
+  {
+    NVMCTRL->ADDR.reg = BAND_STORE_ADDR / 2;
+    NVMCTRL->CTRLA.reg = NVMCTRL_CTRLA_CMDEX_KEY | NVMCTRL_CTRLA_CMD_ER;
+    while(!NVMCTRL->INTFLAG.bit.READY);
+    band_next = 0;
+  }
+
+  // Page buffer is all 0xFF after PBC, so only the new word is programmed
+  NVMCTRL->CTRLA.reg = NVMCTRL_CTRLA_CMDEX_KEY | NVMCTRL_CTRLA_CMD_PBC;
+  while(!NVMCTRL->INTFLAG.bit.READY);
+  ((volatile uint32_t *)BAND_STORE_ADDR)[band_next] = ((uint32_t)(uint16_t)~co2 << 16) | co2;
+  NVMCTRL->CTRLA.reg = NVMCTRL_CTRLA_CMDEX_KEY | NVMCTRL_CTRLA_CMD_WP;
+  while(!NVMCTRL->INTFLAG.bit.READY);
+  __enable_irq();
+
+  band_next++;
+}
@@ -0,0 +1,166 @@
+#include "binframe.h"
+
+#include <string.h>
+
+uint16_t binframe_crc16(const uint8_t *data, size_t len)
+{
+  uint16_t crc = 0xFFFF;
+
+  while(len--)
+  {
+    crc ^= (uint16_t)(*data++) << 8;
+    for(uint8_t i = 0; i < 8; i++)
+    {
+      crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1);
+    }
+  }
+  return crc;
+}
+
+size_t binframe_encode(const uint8_t *in, size_t len, uint8_t *out)
+{
+  size_t code_pos = 0, pos = 1;
+  uint8_t code = 1;
+
+  for(size_t i = 0; i < len; i++)
+  {
+    if(in[i] == 0)
+    {
+      out[code_pos] = code;
+      code_pos = pos++;
+      code = 1;
+      continue;
+    }
+    out[pos++] = in[i];
+    if(++code == 0xFF)
+    {
+      out[code_pos] = code;
+      code_pos = pos++;
+      code = 1;
+    }
+  }
+  out[code_pos] = code;
+  out[pos++] = 0;
+  return pos;
+}
+
+size_t binframe_decode(const uint8_t *in, size_t len, uint8_t *out)
+{
+  size_t i = 0, o = 0;
+
+  while(i < len)
+  {
+    uint8_t code = in[i++];
+    if((code == 0) || ((i + code - 1) > len))
+    {
+      return 0;
+    }
+    for(uint8_t k = 1; k < code; k++)
+    {
+      out[o++] = in[i++];
+    }
+    if((code < 0xFF) && (i < len))
+    {
+      out[o++] = 0;
+    }
+  }
+  return o;
+}
+
+size_t binframe_seal(uint8_t *frame, size_t len)
+{
+  uint16_t crc = binframe_crc16(frame, len);
+
+  frame[len++] = (uint8_t)crc;
+  frame[len++] = (uint8_t)(crc >> 8);
+  return len;
+}
+
+int binframe_check(const uint8_t *frame, size_t len)
+{
+  if(len < (BINFRAME_HDR + 2))
+  {
+    return -1;
+  }
+  uint16_t crc = (uint16_t)frame[len - 2] | ((uint16_t)frame[len - 1] << 8);
+  if(binframe_crc16(frame, len - 2) != crc)
+  {
+    return -1;
+  }
+  return (int)(len - BINFRAME_HDR - 2);
+}
+
+bool binframe_tlv_put(uint8_t *buf, size_t cap, size_t *pos, uint8_t tag, const void *value, size_t len)
+{
+  if((len > 0xFF) || ((*pos + 2 + len) > cap))
+  {
+    return false;
+  }
+  buf[(*pos)++] = tag;
+  buf[(*pos)++] = (uint8_t)len;
+  if(len > 0)
+  {
+    memcpy(&buf[*pos], value, len);
+    *pos += len;
+  }
+  return true;
+}
+
+bool binframe_tlv_next(const uint8_t *buf, size_t len, size_t *pos, uint8_t *tag, const uint8_t **value, uint8_t *vlen)
+{
+  if((*pos + 2) > len)
+  {
+    return false;
+  }
+  *tag = buf[*pos];
+  *vlen = buf[*pos + 1];
+  if((*pos + 2 + *vlen) > len)
+  {
+    return false;
+  }
+  *value = &buf[*pos + 2];
+  *pos += 2 + *vlen;
+  return true;
+}
+
+static void put16(uint8_t *p, uint16_t v)
+{
+  p[0] = (uint8_t)v;
+  p[1] = (uint8_t)(v >> 8);
+}
+
+static void put32(uint8_t *p, uint32_t v)
+{
+  put16(p, (uint16_t)v);
+  put16(p + 2, (uint16_t)(v >> 16));
+}
+
+static uint16_t get16(const uint8_t *p)
+{
+  return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static uint32_t get32(const uint8_t *p)
+{
+  return (uint32_t)get16(p) | ((uint32_t)get16(p + 2) << 16);
+}
+
+void binframe_put_rec(uint8_t *out, const binframe_rec_t *rec)
+{
+  put32(out, rec->seq);
+  put32(out + 4, rec->time);
+  put16(out + 8, rec->co2);
+  put16(out + 10, (uint16_t)rec->temp);
+  put16(out + 12, rec->humi);
+  put16(out + 14, rec->pres);
+}
+
+void binframe_get_rec(const uint8_t *in, binframe_rec_t *rec)
+{
+  rec->seq = get32(in);
+  rec->time = get32(in + 4);
+  rec->co2 = get16(in + 8);
+  rec->temp = (int16_t)get16(in + 10);
+  rec->humi = get16(in + 12);
+  rec->pres = get16(in + 14);
+}
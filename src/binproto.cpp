@@ -0,0 +1,480 @@
+#include "binproto.h"
+#include "rtc_clock.h"
+
+#include <string.h>
+
+// Collects the text output of a settings command for the BF_CMD reply.
+class frame_print : public Print
+{
+public:
+  frame_print(uint8_t *buf, size_t cap) : buf(buf), cap(cap), len(0) {}
+  size_t write(uint8_t c)
+  {
+    if(len >= cap)
+    {
+      return 0;
+    }
+    buf[len++] = c;
+    return 1;
+  }
+  size_t length(void) const
+  {
+    return len;
+  }
+
+private:
+  uint8_t *buf;
+  size_t cap;
+  size_t len;
+};
+
+static Stream *bp_io = NULL;
+static bool bp_active = false;
+static uint32_t bp_rx_ms = 0; // millis() of the last received frame
+
+static uint8_t bp_rx[BINFRAME_ENC_MAX];
+static size_t bp_rx_len = 0;
+static bool bp_rx_overflow = false;
+
+static uint8_t bp_tx[BINFRAME_MAX];
+static size_t bp_tx_len = 0;
+static uint8_t bp_enc[BINFRAME_ENC_MAX];
+
+// running history export
+static bool hx_active = false;
+static uint8_t hx_seq_req;
+static uint32_t hx_next, hx_end;
+
+void binproto_begin(Stream *io)
+{
+  bp_io = io;
+  bp_active = true;
+  bp_rx_ms = millis();
+  bp_rx_len = 0;
+  bp_rx_overflow = false;
+  hx_active = false;
+}
+
+bool binproto_active(void)
+{
+  return bp_active;
+}
+
+void binproto_end(void)
+{
+  bp_active = false;
+  bp_rx_len = 0;
+  bp_rx_overflow = false;
+  hx_active = false;
+}
+
+static void tx_start(uint8_t type, uint8_t seq)
+{
+  bp_tx[0] = type;
+  bp_tx[1] = seq;
+  bp_tx[2] = 0;
+  bp_tx_len = BINFRAME_HDR;
+}
+
+static void tx_send(uint8_t flags)
+{
+  bp_tx[2] = flags;
+  size_t len = binframe_seal(bp_tx, bp_tx_len);
+  len = binframe_encode(bp_tx, len, bp_enc);
+  bp_io->write(bp_enc, len);
+}
+
+// Appends a TLV to the reply; a full frame is sent with BF_FLAG_MORE first.
+static void tx_tlv(uint8_t tag, const void *value, size_t len)
+{
+  size_t cap = BINFRAME_HDR + BINFRAME_PAYLOAD;
+
+  if(!binframe_tlv_put(bp_tx, cap, &bp_tx_len, tag, value, len))
+  {
+    tx_send(BF_FLAG_MORE);
+    bp_tx_len = BINFRAME_HDR;
+    binframe_tlv_put(bp_tx, cap, &bp_tx_len, tag, value, len);
+  }
+}
+
+static void tx_error(uint8_t seq, const char *msg)
+{
+  tx_start(BF_ERROR, seq);
+  size_t len = strlen(msg);
+  memcpy(&bp_tx[bp_tx_len], msg, len);
+  bp_tx_len += len;
+  tx_send(0);
+}
+
+// Key and value TLVs are kept together in one frame.
+static void tx_item(const cfg_item_t *item)
+{
+  cfg_value_t v;
+  size_t klen = strlen(item->key);
+  size_t vlen;
+  uint8_t tag;
+  uint8_t num[4];
+  const void *value = num;
+
+  serial_settings_load(item, &v);
+  switch(item->type)
+  {
+    case CFG_BOOL:
+      tag = T_BOOL;
+      num[0] = (uint8_t)v.u;
+      vlen = 1;
+      break;
+    case CFG_STRING:
+      tag = T_STR;
+      value = v.s;
+      vlen = strlen(v.s);
+      break;
+    case CFG_IP:
+      tag = T_IP;
+      memcpy(num, &v.u, 4); // a.b.c.d, little-endian
+      vlen = 4;
+      break;
+    default:
+      tag = T_U32;
+      memcpy(num, &v.u, 4);
+      vlen = 4;
+      break;
+  }
+
+  if((bp_tx_len + 4 + klen + vlen) > (BINFRAME_HDR + BINFRAME_PAYLOAD))
+  {
+    tx_send(BF_FLAG_MORE);
+    bp_tx_len = BINFRAME_HDR;
+  }
+  tx_tlv(T_KEY, item->key, klen);
+  tx_tlv(tag, value, vlen);
+}
+
+static const cfg_item_t *find_key(const cfg_item_t *items, size_t count, const uint8_t *key, uint8_t len)
+{
+  char buf[64];
+
+  if(len >= sizeof(buf))
+  {
+    return NULL;
+  }
+  memcpy(buf, key, len);
+  buf[len] = 0;
+  return cfg_key_find(items, count, buf);
+}
+
+static void do_get(uint8_t seq, const uint8_t *p, size_t len, const cfg_item_t *items, size_t count)
+{
+  size_t pos = 0;
+  uint8_t tag, vlen;
+  const uint8_t *value;
+
+  tx_start(BF_GET | BF_REPLY, seq);
+  while(binframe_tlv_next(p, len, &pos, &tag, &value, &vlen))
+  {
+    if(tag != T_KEY)
+    {
+      continue;
+    }
+    const cfg_item_t *item = find_key(items, count, value, vlen);
+    if(item == NULL)
+    {
+      tx_tlv(T_KEY, value, vlen);
+      tx_tlv(T_ERR, "Unknown key", 11);
+      continue;
+    }
+    tx_item(item);
+  }
+  tx_send(0);
+}
+
+static const char *set_one(const serial_settings_ctx_t *ctx, const cfg_item_t *item, uint8_t tag, const uint8_t *value, uint8_t vlen)
+{
+  char str[BINFRAME_PAYLOAD + 1];
+  cfg_value_t v;
+
+  v.u = 0;
+  v.s = NULL;
+  switch(item->type)
+  {
+    case CFG_BOOL:
+      if((tag != T_BOOL) || (vlen != 1))
+      {
+        return "Invalid bool";
+      }
+      v.u = value[0];
+      break;
+    case CFG_STRING:
+      if(tag != T_STR)
+      {
+        return "Invalid string";
+      }
+      memcpy(str, value, vlen);
+      str[vlen] = 0;
+      v.s = str;
+      break;
+    case CFG_IP:
+      if((tag != T_IP) || (vlen != 4))
+      {
+        return "Invalid IP";
+      }
+      memcpy(&v.u, value, 4);
+      break;
+    default:
+      if((tag != T_U32) || (vlen != 4))
+      {
+        return "Invalid number";
+      }
+      memcpy(&v.u, value, 4);
+      break;
+  }
+  return serial_settings_store(ctx, item, &v);
+}
+
+static void do_set(uint8_t seq, const uint8_t *p, size_t len, const serial_settings_ctx_t *ctx, const cfg_item_t *items, size_t count)
+{
+  size_t pos = 0;
+  uint8_t tag, vlen, ktag, klen;
+  const uint8_t *value, *key;
+
+  tx_start(BF_SET | BF_REPLY, seq);
+  while(binframe_tlv_next(p, len, &pos, &ktag, &key, &klen))
+  {
+    if((ktag != T_KEY) || !binframe_tlv_next(p, len, &pos, &tag, &value, &vlen))
+    {
+      break;
+    }
+
+    const char *err;
+    const cfg_item_t *item = find_key(items, count, key, klen);
+    if(!ctx->remote_on)
+    {
+      err = "Remote control not enabled";
+    }
+    else if(item == NULL)
+    {
+      err = "Unknown key";
+    }
+    else
+    {
+      err = set_one(ctx, item, tag, value, vlen);
+    }
+    tx_tlv(T_KEY, key, klen);
+    tx_tlv(T_ERR, err, err ? strlen(err) : 0);
+  }
+  tx_send(0);
+}
+
+static void do_cmd(uint8_t seq, const uint8_t *p, size_t len, const serial_settings_ctx_t *ctx, const cfg_item_t *items, size_t count)
+{
+  char line[BINFRAME_PAYLOAD + 1];
+  serial_settings_ctx_t c = *ctx;
+
+  if(len > BINFRAME_PAYLOAD)
+  {
+    len = BINFRAME_PAYLOAD;
+  }
+  memcpy(line, p, len);
+  line[len] = 0;
+
+  tx_start(BF_CMD | BF_REPLY, seq);
+  frame_print out(&bp_tx[BINFRAME_HDR], BINFRAME_PAYLOAD);
+  c.out = &out;
+  if(!serial_settings_handle_line(line, items, count, &c))
+  {
+    out.print("ERROR: Unknown command");
+  }
+  bp_tx_len = BINFRAME_HDR + out.length();
+  tx_send(0);
+}
+
+static void history_frame(void)
+{
+  history_rec_t rec;
+  binframe_rec_t w;
+
+  tx_start(BF_HISTORY | BF_REPLY, hx_seq_req);
+  if(hx_next < history_first())
+  {
+    hx_next = history_first(); // overwritten meanwhile, the gap shows in seq
+  }
+  while((hx_next < hx_end) && ((bp_tx_len + BINFRAME_REC_LEN) <= (BINFRAME_HDR + BINFRAME_PAYLOAD)))
+  {
+    if(!history_get(hx_next, &rec))
+    {
+      break;
+    }
+    w.seq = hx_next++;
+    w.time = rtc_clock_to_utc((uint64_t)rec.mono_s * 1000);
+    w.co2 = rec.co2;
+    w.temp = rec.temp;
+    w.humi = rec.humi;
+    w.pres = rec.pres;
+    binframe_put_rec(&bp_tx[bp_tx_len], &w);
+    bp_tx_len += BINFRAME_REC_LEN;
+  }
+  hx_active = (hx_next < hx_end);
+  tx_send(hx_active ? BF_FLAG_MORE : 0);
+}
+
+static void handle_frame(uint8_t *f, size_t len, const serial_settings_ctx_t *ctx, const cfg_item_t *items, size_t count)
+{
+  int plen = binframe_check(f, len);
+  if(plen < 0)
+  {
+    tx_error((len > 1) ? f[1] : 0, "Bad CRC");
+    return;
+  }
+  if(len > BINFRAME_MAX) // the COBS buffer holds a few bytes more
+  {
+    tx_error(f[1], "Frame too long");
+    return;
+  }
+
+  uint8_t type = f[0], seq = f[1];
+  const uint8_t *p = &f[BINFRAME_HDR];
+  switch(type)
+  {
+    case BF_HELLO:
+      {
+        uint8_t info[3] = { BINFRAME_VERSION, (uint8_t)count, (uint8_t)(count >> 8) };
+        tx_start(BF_HELLO | BF_REPLY, seq);
+        memcpy(&bp_tx[bp_tx_len], info, sizeof(info));
+        bp_tx_len += sizeof(info);
+#ifdef VERSION
+        memcpy(&bp_tx[bp_tx_len], VERSION, strlen(VERSION));
+        bp_tx_len += strlen(VERSION);
+#endif
+        tx_send(0);
+      }
+      break;
+    case BF_GET:
+      do_get(seq, p, plen, items, count);
+      break;
+    case BF_SET:
+      do_set(seq, p, plen, ctx, items, count);
+      break;
+    case BF_DUMP:
+      tx_start(BF_DUMP | BF_REPLY, seq);
+      for(size_t i = 0; i < count; i++)
+      {
+        tx_item(&items[i]);
+      }
+      tx_send(0);
+      break;
+    case BF_CMD:
+      do_cmd(seq, p, plen, ctx, items, count);
+      break;
+    case BF_HISTORY:
+      {
+        if(plen < 6)
+        {
+          tx_error(seq, "Bad request");
+          break;
+        }
+        uint32_t from = (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+        uint16_t max = (uint16_t)(p[4] | (p[5] << 8));
+        hx_seq_req = seq;
+        hx_next = (from < history_first()) ? history_first() : from;
+        hx_end = history_next();
+        if(hx_next > hx_end)
+        {
+          hx_next = hx_end;
+        }
+        if((hx_end - hx_next) > max)
+        {
+          hx_end = hx_next + max;
+        }
+        history_frame(); // also answers an empty range
+      }
+      break;
+    case BF_MODE_TEXT:
+      tx_start(BF_MODE_TEXT | BF_REPLY, seq);
+      tx_send(0);
+      binproto_end();
+      break;
+    default:
+      tx_error(seq, "Unknown type");
+      break;
+  }
+}
+
+void binproto_poll(const serial_settings_ctx_t *ctx, const cfg_item_t *items, size_t item_count)
+{
+  if(!bp_active)
+  {
+    return;
+  }
+
+  while(bp_active && (bp_io->available() > 0))
+  {
+    int c = bp_io->read();
+    if(c < 0)
+    {
+      break;
+    }
+    if(c != 0)
+    {
+      if(bp_rx_len < sizeof(bp_rx))
+      {
+        bp_rx[bp_rx_len++] = (uint8_t)c;
+      }
+      else
+      {
+        bp_rx_overflow = true;
+      }
+      continue;
+    }
+
+    // delimiter: one complete frame
+    bp_rx_ms = millis();
+    if(bp_rx_overflow)
+    {
+      tx_error(0, "Frame too long");
+    }
+    else if(bp_rx_len > 0)
+    {
+      size_t len = binframe_decode(bp_rx, bp_rx_len, bp_rx);
+      if(len == 0)
+      {
+        tx_error(0, "Bad frame");
+      }
+      else
+      {
+        handle_frame(bp_rx, len, ctx, items, item_count);
+      }
+    }
+    bp_rx_len = 0;
+    bp_rx_overflow = false;
+  }
+
+  for(uint8_t i = 0; hx_active && (i < BINPROTO_FRAMES_PER_POLL); i++)
+  {
+    history_frame();
+  }
+
+  if(bp_active && !hx_active && ((millis() - bp_rx_ms) > BINPROTO_IDLE_MS))
+  {
+    binproto_end(); // host gone without BF_MODE_TEXT
+  }
+}
+
+void binproto_sample(uint32_t seq, const history_rec_t *rec)
+{
+  binframe_rec_t w;
+
+  if(!bp_active)
+  {
+    return;
+  }
+  w.seq = seq;
+  w.time = rtc_clock_to_utc((uint64_t)rec->mono_s * 1000);
+  w.co2 = rec->co2;
+  w.temp = rec->temp;
+  w.humi = rec->humi;
+  w.pres = rec->pres;
+  tx_start(BF_SAMPLE, 0);
+  binframe_put_rec(&bp_tx[bp_tx_len], &w);
+  bp_tx_len += BINFRAME_REC_LEN;
+  tx_send(0);
+}
@@ -0,0 +1,210 @@
+#include "button.h"
+#include "ticker.h"
+
+static const volatile uint32_t *btn_in = NULL;
+static uint32_t btn_mask = 0;
+
+// Debounce state, only touched by the tick handler after button_begin().
+static volatile bool btn_stable = false; // debounced level, true = pressed
+static bool btn_ignore = false;          // press started before button_begin()
+static bool btn_hold_sent = false;
+static bool btn_last_short = false;
+static uint16_t btn_count = 0;           // ms the raw level differs from btn_stable
+static uint32_t btn_down_ms = 0;
+static uint32_t btn_up_ms = 0;
+
+// Set by the EIC interrupt on the first edge of a bounce sequence.
+static volatile bool btn_edge = false;
+static volatile uint32_t btn_edge_us = 0;
+
+// Single-producer (tick interrupt) / single-consumer (main loop) ring buffer.
+static button_event_t btn_queue[BUTTON_QUEUE_LEN];
+static volatile uint8_t btn_head = 0;
+static volatile uint8_t btn_tail = 0;
+
+static volatile uint32_t stat_events = 0;
+static volatile uint32_t stat_dropped = 0;
+static volatile uint32_t stat_lat_max = 0;
+static volatile uint32_t stat_lat_sum = 0;
+static volatile uint32_t stat_lat_count = 0;
+static uint32_t stat_wait_max = 0;
+
+static void button_push(uint8_t type, uint32_t duration, uint32_t now)
+{
+  uint8_t head = btn_head;
+  uint8_t next = (head + 1) & (BUTTON_QUEUE_LEN - 1);
+
+  if(next == btn_tail)
+  {
+    stat_dropped++;
+    return;
+  }
+
+  btn_queue[head].type = type;
+  btn_queue[head].duration_ms = (duration > 0xFFFF) ? 0xFFFF : duration;
+  btn_queue[head].time_ms = now;
+  __DMB(); // entry must be visible before the index moves
+  btn_head = next;
+  stat_events++;
+}
+
+static void button_edge_isr(void)
+{
+  if(!btn_edge)
+  {
+    btn_edge_us = micros();
+    btn_edge = true;
+  }
+}
+
+static void button_tick(void)
+{
+  uint32_t now;
+  bool raw;
+
+  if(!btn_edge && !btn_stable && (btn_count == 0))
+  {
+    return; // released and no edge seen: nothing to do
+  }
+
+  now = millis();
+  raw = ((*btn_in & btn_mask) == 0);
+
+  if(raw == btn_stable)
+  {
+    btn_count = 0;
+    if(btn_edge && ((micros() - btn_edge_us) > (2000UL * BUTTON_DEBOUNCE_MS)))
+    {
+      btn_edge = false; // glitch, level went back
+    }
+    if(btn_stable && !btn_ignore && !btn_hold_sent && ((now - btn_down_ms) >= BUTTON_HOLD_MS))
+    {
+      btn_hold_sent = true;
+      button_push(BUTTON_HOLD, now - btn_down_ms, now);
+    }
+    return;
+  }
+
+  if(++btn_count < BUTTON_DEBOUNCE_MS)
+  {
+    return;
+  }
+
+  // Level has been stable for the debounce time: accept the edge.
+  btn_count = 0;
+  btn_stable = raw;
+  if(btn_edge)
+  {
+    uint32_t lat = micros() - btn_edge_us;
+    btn_edge = false;
+    if(lat > stat_lat_max)
+    {
+      stat_lat_max = lat;
+    }
+    stat_lat_sum += lat;
+    stat_lat_count++;
+  }
+
+  if(raw) // pressed
+  {
+    btn_down_ms = now - BUTTON_DEBOUNCE_MS;
+    btn_hold_sent = false;
+    btn_ignore = false;
+    if(btn_last_short && ((btn_down_ms - btn_up_ms) > BUTTON_DOUBLE_MS))
+    {
+      btn_last_short = false;
+    }
+    button_push(BUTTON_DOWN, 0, now);
+    return;
+  }
+
+  // released
+  if(btn_ignore)
+  {
+    btn_ignore = false;
+    return;
+  }
+
+  uint32_t duration = (now - BUTTON_DEBOUNCE_MS) - btn_down_ms;
+  btn_up_ms = now - BUTTON_DEBOUNCE_MS;
+  if(duration >= BUTTON_HOLD_MS)
+  {
+    btn_last_short = false;
+    button_push(BUTTON_LONG, duration, now);
+  }
+  else if(btn_last_short)
+  {
+    btn_last_short = false;
+    button_push(BUTTON_DOUBLE, duration, now);
+  }
+  else
+  {
+    btn_last_short = true;
+    button_push(BUTTON_SHORT, duration, now);
+  }
+}
+
+void button_begin(uint8_t pin)
+{
+  const PinDescription *p = &g_APinDescription[pin];
+
+  btn_in = &PORT->Group[p->ulPort].IN.reg;
+  btn_mask = 1UL << p->ulPin;
+
+  pinMode(pin, INPUT_PULLUP);
+  btn_stable = ((*btn_in & btn_mask) == 0);
+  btn_ignore = btn_stable;
+
+  attachInterrupt(digitalPinToInterrupt(pin), button_edge_isr, CHANGE);
+
+  ticker_begin();
+  ticker_attach(button_tick, 1);
+}
+
+bool button_get(button_event_t *ev)
+{
+  uint8_t tail = btn_tail;
+
+  if(tail == btn_head)
+  {
+    return false;
+  }
+
+  *ev = btn_queue[tail];
+  __DMB(); // read the entry before releasing the slot
+  btn_tail = (tail + 1) & (BUTTON_QUEUE_LEN - 1);
+
+  uint32_t wait = millis() - ev->time_ms;
+  if(wait > stat_wait_max)
+  {
+    stat_wait_max = wait;
+  }
+
+  return true;
+}
+
+void button_flush(void)
+{
+  btn_tail = btn_head;
+}
+
+bool button_idle(void)
+{
+  return !btn_edge && !btn_stable && (btn_count == 0);
+}
+
+bool button_pressed(void)
+{
+  return btn_stable;
+}
+
+void button_get_stats(button_stats_t *stats)
+{
+  ticker_lock();
+  stats->events = stat_events;
+  stats->dropped = stat_dropped;
+  stats->latency_max_us = stat_lat_max;
+  stats->latency_avg_us = (stat_lat_count > 0) ? (stat_lat_sum / stat_lat_count) : 0;
+  ticker_unlock();
+  stats->wait_max_ms = stat_wait_max;
+}
@@ -0,0 +1,181 @@
+#include "buzzer_seq.h"
+#include "ticker.h"
+#include "wiring_private.h"
+
+// Ring of steps; the head entry is the one playing. Written by the main loop
+// under ticker_lock() and consumed by the tick handler.
+static buzzer_step_t seq_queue[BUZZER_SEQ_QUEUE];
+static volatile uint8_t seq_head = 0;
+static volatile uint8_t seq_tail = 0;
+static volatile bool seq_loop = false;
+static volatile bool seq_playing = false;
+static uint16_t seq_left = 0;
+static bool seq_ready = false;
+
+static void tcc0_sync(void)
+{
+  while(TCC0->SYNCBUSY.reg);
+}
+
+static void tone_out(uint16_t freq_hz, uint8_t duty)
+{
+  if((freq_hz == 0) || (duty == 0))
+  {
+    TCC0->CCB[1].reg = 0; // constant low
+    return;
+  }
+  if(duty > 100)
+  {
+    duty = 100;
+  }
+
+  // Buffered registers, the new period starts at the next overflow (no glitches).
+  uint32_t per = (F_CPU / freq_hz) - 1;
+  TCC0->PERB.reg = per;
+  TCC0->CCB[1].reg = ((per + 1) * duty) / 100;
+}
+
+static void seq_start_head(void)
+{
+  buzzer_step_t *s = &seq_queue[seq_head];
+
+  tone_out(s->freq_hz, s->duty);
+  seq_left = s->ms;
+  seq_playing = true;
+}
+
+static void seq_next(void)
+{
+  buzzer_step_t done = seq_queue[seq_head];
+
+  seq_head = (seq_head + 1) & (BUZZER_SEQ_QUEUE - 1);
+  if(seq_loop) // requeue into the slot just freed
+  {
+    seq_queue[seq_tail] = done;
+    seq_tail = (seq_tail + 1) & (BUZZER_SEQ_QUEUE - 1);
+  }
+
+  if(seq_head == seq_tail)
+  {
+    tone_out(0, 0);
+    seq_playing = false;
+    return;
+  }
+  seq_start_head();
+}
+
+static void seq_tick(void)
+{
+  if(!seq_playing)
+  {
+    return;
+  }
+
+  if(seq_left == 0) // endless step, leave it as soon as another one is queued
+  {
+    if(((seq_head + 1) & (BUZZER_SEQ_QUEUE - 1)) != seq_tail)
+    {
+      seq_next();
+    }
+    return;
+  }
+
+  if(--seq_left == 0)
+  {
+    seq_next();
+  }
+}
+
+void buzzer_seq_begin(uint8_t pin)
+{
+  PM->APBCMASK.reg |= PM_APBCMASK_TCC0;
+  GCLK->CLKCTRL.reg = GCLK_CLKCTRL_ID_TCC0_TCC1 | GCLK_CLKCTRL_GEN_GCLK0 | GCLK_CLKCTRL_CLKEN;
+  while(GCLK->STATUS.bit.SYNCBUSY);
+
+  TCC0->CTRLA.reg = TCC_CTRLA_SWRST;
+  tcc0_sync();
+  while(TCC0->CTRLA.bit.SWRST);
+
+  // 48 MHz, normal PWM: output high from BOTTOM up to CC1
+  TCC0->WAVE.reg = TCC_WAVE_WAVEGEN_NPWM;
+  tcc0_sync();
+  TCC0->PER.reg = (F_CPU / BUZZER_SEQ_HZ) - 1;
+  TCC0->CC[1].reg = 0;
+  tcc0_sync();
+  TCC0->CTRLA.reg = TCC_CTRLA_PRESCALER_DIV1 | TCC_CTRLA_ENABLE;
+  tcc0_sync();
+
+  digitalWrite(pin, LOW);
+  pinPeripheral(pin, PIO_TIMER);
+
+  if(!seq_ready)
+  {
+    seq_ready = true;
+    ticker_begin();
+    ticker_attach(seq_tick, 1);
+  }
+}
+
+bool buzzer_seq_add(uint16_t freq_hz, uint8_t duty, uint16_t ms)
+{
+  bool ok = false;
+
+  ticker_lock();
+  uint8_t next = (seq_tail + 1) & (BUZZER_SEQ_QUEUE - 1);
+  if(next != seq_head)
+  {
+    seq_queue[seq_tail].freq_hz = freq_hz;
+    seq_queue[seq_tail].duty = duty;
+    seq_queue[seq_tail].ms = ms;
+    seq_tail = next;
+    if(!seq_playing)
+    {
+      seq_start_head();
+    }
+    ok = true;
+  }
+  ticker_unlock();
+
+  return ok;
+}
+
+void buzzer_seq_play(const buzzer_step_t *steps, uint8_t count, bool loop)
+{
+  if(count >= BUZZER_SEQ_QUEUE)
+  {
+    count = BUZZER_SEQ_QUEUE - 1;
+  }
+
+  ticker_lock();
+  seq_head = seq_tail = 0;
+  for(uint8_t i = 0; i < count; i++)
+  {
+    seq_queue[seq_tail++] = steps[i];
+  }
+  seq_loop = loop;
+  if(count > 0)
+  {
+    seq_start_head();
+  }
+  else
+  {
+    tone_out(0, 0);
+    seq_playing = false;
+  }
+  ticker_unlock();
+}
+
+void buzzer_seq_stop(void)
+{
+  ticker_lock();
+  seq_head = seq_tail = 0;
+  seq_loop = false;
+  seq_playing = false;
+  tone_out(0, 0);
+  ticker_unlock();
+}
+
+bool buzzer_seq_busy(void)
+{
+  return seq_playing;
+}
@@ -0,0 +1,150 @@
+#include "dmac.h"
+
+#include <string.h>
+
+// Descriptor and write-back tables must be 128-bit aligned (SAMD21 datasheet, DMAC chapter).
+static DmacDescriptor dmac_desc[DMAC_CHANNELS] __attribute__((aligned(16)));
+static DmacDescriptor dmac_wb[DMAC_CHANNELS] __attribute__((aligned(16)));
+static dmac_done_fn dmac_done[DMAC_CHANNELS];
+static uint8_t dmac_used = 0;
+static bool dmac_started = false;
+
+static uint32_t irq_save(void)
+{
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  return primask;
+}
+
+static void irq_restore(uint32_t primask)
+{
+  if(primask == 0)
+  {
+    __enable_irq();
+  }
+}
+
+void dmac_begin(void)
+{
+  if(dmac_started)
+  {
+    return;
+  }
+
+  PM->AHBMASK.reg |= PM_AHBMASK_DMAC;
+  PM->APBBMASK.reg |= PM_APBBMASK_DMAC;
+
+  DMAC->CTRL.bit.DMAENABLE = 0;
+  DMAC->CTRL.bit.SWRST = 1;
+  while(DMAC->CTRL.bit.SWRST);
+
+  memset((void *)dmac_desc, 0, sizeof(dmac_desc));
+  memset((void *)dmac_wb, 0, sizeof(dmac_wb));
+  DMAC->BASEADDR.reg = (uint32_t)dmac_desc;
+  DMAC->WRBADDR.reg = (uint32_t)dmac_wb;
+  DMAC->CTRL.reg = DMAC_CTRL_DMAENABLE | DMAC_CTRL_LVLEN(0xF);
+
+  NVIC_ClearPendingIRQ(DMAC_IRQn);
+  NVIC_SetPriority(DMAC_IRQn, 1);
+  NVIC_EnableIRQ(DMAC_IRQn);
+
+  dmac_started = true;
+}
+
+int dmac_channel_alloc(uint8_t trigsrc, dmac_done_fn done)
+{
+  if(!dmac_started || dmac_used >= DMAC_CHANNELS)
+  {
+    return -1;
+  }
+
+  uint8_t ch = dmac_used++;
+  dmac_done[ch] = done;
+
+  uint32_t primask = irq_save();
+  DMAC->CHID.reg = DMAC_CHID_ID(ch);
+  DMAC->CHCTRLA.reg &= ~DMAC_CHCTRLA_ENABLE;
+  DMAC->CHCTRLA.reg = DMAC_CHCTRLA_SWRST;
+  while(DMAC->CHCTRLA.reg & DMAC_CHCTRLA_SWRST);
+  DMAC->CHCTRLB.reg = DMAC_CHCTRLB_LVL(0) |
+                      DMAC_CHCTRLB_TRIGSRC(trigsrc) |
+                      DMAC_CHCTRLB_TRIGACT_BEAT;
+  DMAC->CHINTENSET.reg = DMAC_CHINTENSET_TCMPL | DMAC_CHINTENSET_TERR;
+  irq_restore(primask);
+
+  return ch;
+}
+
+bool dmac_transfer(uint8_t channel, const volatile void *src, volatile void *dst,
+                   uint16_t count, bool src_inc, bool dst_inc)
+{
+  if(channel >= dmac_used || count == 0 || dmac_busy(channel))
+  {
+    return false;
+  }
+
+  // With address increment enabled the descriptor holds the end address (last beat + 1).
+  DmacDescriptor *d = &dmac_desc[channel];
+  d->BTCTRL.reg = DMAC_BTCTRL_VALID |
+                  DMAC_BTCTRL_BEATSIZE_BYTE |
+                  DMAC_BTCTRL_BLOCKACT_INT |
+                  (src_inc ? DMAC_BTCTRL_SRCINC : 0) |
+                  (dst_inc ? DMAC_BTCTRL_DSTINC : 0);
+  d->BTCNT.reg = count;
+  d->SRCADDR.reg = (uint32_t)src + (src_inc ? count : 0);
+  d->DSTADDR.reg = (uint32_t)dst + (dst_inc ? count : 0);
+  d->DESCADDR.reg = 0;
+
+  uint32_t primask = irq_save();
+  DMAC->CHID.reg = DMAC_CHID_ID(channel);
+  DMAC->CHCTRLA.reg = DMAC_CHCTRLA_ENABLE;
+  irq_restore(primask);
+
+  return true;
+}
+
+bool dmac_busy(uint8_t channel)
+{
+  bool busy;
+
+  uint32_t primask = irq_save();
+  DMAC->CHID.reg = DMAC_CHID_ID(channel);
+  busy = (DMAC->CHCTRLA.reg & DMAC_CHCTRLA_ENABLE) != 0;
+  irq_restore(primask);
+
+  return busy;
+}
+
+void dmac_abort(uint8_t channel)
+{
+  uint32_t primask = irq_save();
+  DMAC->CHID.reg = DMAC_CHID_ID(channel);
+  DMAC->CHCTRLA.reg &= ~DMAC_CHCTRLA_ENABLE;
+  while(DMAC->CHCTRLA.reg & DMAC_CHCTRLA_ENABLE);
+  DMAC->CHINTFLAG.reg = DMAC_CHINTFLAG_TCMPL | DMAC_CHINTFLAG_TERR | DMAC_CHINTFLAG_SUSP;
+  irq_restore(primask);
+}
+
+void DMAC_Handler(void)
+{
+  uint8_t saved = DMAC->CHID.reg;
+  uint32_t pending = DMAC->INTSTATUS.reg;
+
+  for(uint8_t ch = 0; ch < dmac_used; ch++)
+  {
+    if((pending & (1u << ch)) == 0)
+    {
+      continue;
+    }
+
+    DMAC->CHID.reg = DMAC_CHID_ID(ch);
+    uint8_t flags = DMAC->CHINTFLAG.reg;
+    DMAC->CHINTFLAG.reg = flags;
+    if(dmac_done[ch] && (flags & (DMAC_CHINTFLAG_TCMPL | DMAC_CHINTFLAG_TERR)))
+    {
+      dmac_done[ch](ch, (flags & DMAC_CHINTFLAG_TERR) != 0);
+    }
+  }
+
+  DMAC->CHID.reg = saved;
+}
@@ -0,0 +1,127 @@
+#include "dns_captive.h"
+#include <WiFiUdp.h>
+
+#define DNS_HDR      12
+#define DNS_TYPE_A   1
+#define DNS_TYPE_ANY 255
+#define DNS_CLASS_IN 1
+
+static WiFiUDP dns_udp;
+static bool dns_active = false;
+static uint8_t dns_ip[4];
+static uint32_t dns_queries = 0;
+
+static uint16_t get_u16(const uint8_t *p)
+{
+  return ((uint16_t)p[0] << 8) | p[1];
+}
+
+static void put_u16(uint8_t *p, uint16_t v)
+{
+  p[0] = v >> 8;
+  p[1] = v;
+}
+
+// Builds the answer in place, returns its length or 0 to drop the packet.
+static size_t dns_answer(uint8_t *buf, size_t len, size_t size)
+{
+  size_t pos = DNS_HDR;
+  uint16_t type, cls;
+
+  if((len < DNS_HDR) || (buf[2] & 0x80) || (buf[2] & 0x78) || (get_u16(&buf[4]) == 0))
+  {
+    return 0; // short, a response, not a standard query or no question
+  }
+  while((pos < len) && (buf[pos] != 0)) // QNAME labels
+  {
+    if(buf[pos] & 0xC0)
+    {
+      return 0; // no compression in questions
+    }
+    pos += buf[pos] + 1;
+  }
+  if((pos + 5) > len)
+  {
+    return 0;
+  }
+  type = get_u16(&buf[pos + 1]);
+  cls = get_u16(&buf[pos + 3]);
+  pos += 5; // end of the first question, the others are dropped
+
+  buf[2] = 0x84 | (buf[2] & 0x01); // QR, AA, RD copied
+  buf[3] = 0x00;                   // RA=0, NOERROR
+  put_u16(&buf[4], 1);             // QDCOUNT
+  put_u16(&buf[6], 0);             // ANCOUNT
+  put_u16(&buf[8], 0);             // NSCOUNT
+  put_u16(&buf[10], 0);            // ARCOUNT
+  if(((type == DNS_TYPE_A) || (type == DNS_TYPE_ANY)) && (cls == DNS_CLASS_IN) && ((pos + 16) <= size))
+  {
+    put_u16(&buf[6], 1);
+    put_u16(&buf[pos], 0xC000 | DNS_HDR); // name: pointer to the question
+    put_u16(&buf[pos + 2], DNS_TYPE_A);
+    put_u16(&buf[pos + 4], DNS_CLASS_IN);
+    put_u16(&buf[pos + 6], 0);
+    put_u16(&buf[pos + 8], DNS_CAPTIVE_TTL);
+    put_u16(&buf[pos + 10], 4);
+    memcpy(&buf[pos + 12], dns_ip, 4);
+    pos += 16;
+  }
+  return pos;
+}
+
+void dns_captive_begin(IPAddress ip)
+{
+  for(uint8_t i = 0; i < 4; i++)
+  {
+    dns_ip[i] = ip[i];
+  }
+  dns_captive_stop();
+  dns_active = (dns_udp.begin(DNS_CAPTIVE_PORT) != 0);
+}
+
+void dns_captive_stop(void)
+{
+  if(dns_active)
+  {
+    dns_udp.stop();
+    dns_active = false;
+  }
+}
+
+void dns_captive_service(void)
+{
+  uint8_t buf[DNS_CAPTIVE_BUF + 16];
+
+  if(!dns_active)
+  {
+    return;
+  }
+  for(uint8_t i = 0; i < DNS_CAPTIVE_POLL; i++)
+  {
+    int len = dns_udp.parsePacket();
+    if(len <= 0)
+    {
+      break;
+    }
+    if(len > DNS_CAPTIVE_BUF)
+    {
+      dns_udp.flush();
+      continue;
+    }
+    len = dns_udp.read(buf, len);
+    size_t n = dns_answer(buf, (len > 0) ? len : 0, sizeof(buf));
+    if(n == 0)
+    {
+      continue;
+    }
+    dns_queries++;
+    dns_udp.beginPacket(dns_udp.remoteIP(), dns_udp.remotePort());
+    dns_udp.write(buf, n);
+    dns_udp.endPacket();
+  }
+}
+
+uint32_t dns_captive_queries(void)
+{
+  return dns_queries;
+}
@@ -0,0 +1,30 @@
+#include "history.h"
+
+static history_rec_t hist_buf[HISTORY_LEN];
+static uint32_t hist_next = 0;
+
+void history_add(const history_rec_t *rec)
+{
+  hist_buf[hist_next % HISTORY_LEN] = *rec;
+  hist_next++;
+}
+
+uint32_t history_first(void)
+{
+  return (hist_next > HISTORY_LEN) ? (hist_next - HISTORY_LEN) : 0;
+}
+
+uint32_t history_next(void)
+{
+  return hist_next;
+}
+
+bool history_get(uint32_t seq, history_rec_t *rec)
+{
+  if((seq < history_first()) || (seq >= hist_next))
+  {
+    return false;
+  }
+  *rec = hist_buf[seq % HISTORY_LEN];
+  return true;
+}
@@ -0,0 +1,211 @@
+#include "history_http.h"
+#include "history.h"
+#include "rtc_clock.h"
+#include "binframe.h"
+
+typedef enum
+{
+  HX_CSV,
+  HX_JSON,
+  HX_BIN
+} hx_fmt_t;
+
+typedef struct
+{
+  uint32_t next;   // sequence number of the next record
+  uint32_t end;    // history_next() at the request
+  uint32_t to;     // Unix seconds, 0 = open end
+  uint32_t last_s; // mono_s of the last record sent
+  uint16_t res;
+  uint8_t fmt;
+  bool first;      // no record sent yet
+} hx_ctx_t;
+
+static_assert(sizeof(hx_ctx_t) <= HTTPD_CTX, "hx_ctx_t must fit in HTTPD_CTX");
+
+static char hx_headers[64]; // sent after the handler returned
+
+static uint32_t hx_utc(const history_rec_t *rec)
+{
+  return rtc_clock_to_utc((uint64_t)rec->mono_s * 1000);
+}
+
+// First record at or after from_s; the history is in time order.
+static uint32_t hx_find(uint32_t lo, uint32_t hi, uint32_t from_s)
+{
+  history_rec_t rec;
+
+  while(lo < hi)
+  {
+    uint32_t mid = lo + (hi - lo) / 2;
+    if(!history_get(mid, &rec) || (hx_utc(&rec) < from_s))
+    {
+      lo = mid + 1;
+    }
+    else
+    {
+      hi = mid;
+    }
+  }
+  return lo;
+}
+
+static void hx_record(httpd_conn_t *c, hx_ctx_t *x, uint32_t seq, const history_rec_t *rec)
+{
+  if(x->fmt == HX_BIN)
+  {
+    binframe_rec_t w;
+    uint8_t buf[BINFRAME_REC_LEN];
+
+    w.seq = seq;
+    w.time = hx_utc(rec);
+    w.co2 = rec->co2;
+    w.temp = rec->temp;
+    w.humi = rec->humi;
+    w.pres = rec->pres;
+    binframe_put_rec(buf, &w);
+    httpd_write(c, buf, sizeof(buf));
+  }
+  else if(x->fmt == HX_JSON)
+  {
+    httpd_printf(c, "%s\r\n{\"seq\":%lu,\"s\":%lu,\"c\":%u,\"t\":%.2f,\"h\":%.2f",
+                 x->first ? "" : ",", (unsigned long)seq, (unsigned long)hx_utc(rec),
+                 rec->co2, rec->temp / 100.0, rec->humi / 100.0);
+    if(rec->pres)
+    {
+      httpd_printf(c, ",\"p\":%.1f", rec->pres / 10.0);
+    }
+    httpd_print(c, "}");
+  }
+  else
+  {
+    httpd_printf(c, "%lu,%lu,%u,%.2f,%.2f,", (unsigned long)seq, (unsigned long)hx_utc(rec),
+                 rec->co2, rec->temp / 100.0, rec->humi / 100.0);
+    if(rec->pres)
+    {
+      httpd_printf(c, "%.1f", rec->pres / 10.0);
+    }
+    httpd_print(c, "\r\n");
+  }
+  x->first = false;
+}
+
+static bool hx_body(httpd_conn_t *c, void *ctx)
+{
+  hx_ctx_t *x = (hx_ctx_t *)ctx;
+  history_rec_t rec;
+
+  if(x->next < history_first())
+  {
+    x->next = history_first(); // overwritten meanwhile, the gap shows in seq
+  }
+  while((x->next < x->end) && (httpd_space(c) >= HISTORY_HTTP_LINE))
+  {
+    uint32_t seq = x->next++;
+    if(!history_get(seq, &rec))
+    {
+      continue;
+    }
+    if(x->to && (hx_utc(&rec) > x->to))
+    {
+      x->next = x->end; // all later records are newer
+      break;
+    }
+    if(!x->first && ((rec.mono_s - x->last_s) < x->res))
+    {
+      continue;
+    }
+    x->last_s = rec.mono_s;
+    hx_record(c, x, seq, &rec);
+  }
+  if(x->next < x->end)
+  {
+    return true;
+  }
+  if(x->fmt == HX_JSON)
+  {
+    httpd_print(c, "\r\n]}\r\n");
+  }
+  return false;
+}
+
+void history_http(httpd_conn_t *c, const httpd_req_t *req)
+{
+  char value[16];
+  uint32_t first = history_first(), end = history_next();
+  hx_ctx_t *x;
+  uint8_t fmt = HX_CSV;
+  const char *type = "text/csv";
+
+  if(httpd_query(req, "fmt", value, sizeof(value)))
+  {
+    if(strcmp(value, "json") == 0)
+    {
+      fmt = HX_JSON;
+      type = "application/json";
+    }
+    else if(strcmp(value, "bin") == 0)
+    {
+      fmt = HX_BIN;
+      type = "application/octet-stream";
+    }
+    else if(strcmp(value, "csv"))
+    {
+      httpd_respond(c, 400, "text/plain", NULL);
+      httpd_print(c, "fmt: csv, json or bin\r\n");
+      return;
+    }
+  }
+  if(httpd_query(req, "from", value, sizeof(value)) || httpd_query(req, "to", value, sizeof(value)))
+  {
+    if(!rtc_clock_valid())
+    {
+      httpd_respond(c, 503, "text/plain", "Retry-After: 60\r\n");
+      httpd_print(c, "Clock not set, use seq\r\n");
+      return;
+    }
+  }
+
+  httpd_respond(c, 200, type, hx_headers);
+  snprintf(hx_headers, sizeof(hx_headers), "X-History-First: %lu\r\nX-History-Next: %lu\r\n",
+           (unsigned long)first, (unsigned long)end);
+  x = (hx_ctx_t *)httpd_body(c, hx_body);
+  if(!x)
+  {
+    return;
+  }
+  x->next = first;
+  x->end = end;
+  x->fmt = fmt;
+  x->first = true;
+  if(httpd_query(req, "seq", value, sizeof(value)))
+  {
+    uint32_t seq = strtoul(value, NULL, 10);
+    if(seq > x->next)
+    {
+      x->next = (seq < end) ? seq : end;
+    }
+  }
+  if(httpd_query(req, "from", value, sizeof(value)))
+  {
+    x->next = hx_find(x->next, end, strtoul(value, NULL, 10));
+  }
+  if(httpd_query(req, "to", value, sizeof(value)))
+  {
+    x->to = strtoul(value, NULL, 10);
+  }
+  if(httpd_query(req, "res", value, sizeof(value)))
+  {
+    uint32_t res = strtoul(value, NULL, 10);
+    x->res = (res < 0xFFFF) ? res : 0xFFFF;
+  }
+
+  if(fmt == HX_JSON)
+  {
+    httpd_printf(c, "{\"first\":%lu,\"next\":%lu,\"records\":[", (unsigned long)first, (unsigned long)end);
+  }
+  else if(fmt == HX_CSV)
+  {
+    httpd_print(c, "seq,time,co2,temp,humi,pres\r\n");
+  }
+}
@@ -0,0 +1,897 @@
+#include "httpd.h"
+#include "cfg_keys.h"
+
+#include <stdarg.h>
+
+#define HTTPD_LINGER_MS  20 // before closing, so the WINC1500 sends the last segment
+
+typedef enum
+{
+  CONN_FREE,
+  CONN_REQ,   // reading request line and headers
+  CONN_SKIP,  // skipping request body bytes the handler did not read
+  CONN_CLOSE, // last response sent, closing after HTTPD_LINGER_MS
+  CONN_STREAM, // response without end, httpd_broadcast() data follows
+  CONN_BODY    // response body generated by httpd_body_fn, one part per call
+} conn_state_t;
+
+struct httpd_conn
+{
+  WiFiClient client;
+  uint8_t state;
+  uint8_t rx[HTTPD_RX];
+  uint8_t rx_pos;
+  uint8_t rx_len;
+  char line[HTTPD_LINE];
+  uint8_t line_len;
+  bool line_long;
+  bool req_line;     // request line received
+  bool in_head;      // request head started
+  uint16_t error;    // status for a malformed request, 0 = ok
+  httpd_req_t req;
+  uint32_t body_left;
+  uint32_t t_last;   // last received byte or sent response
+  uint32_t t_head;   // start of the current request head
+  uint16_t reqs;
+  httpd_body_fn body_fn;
+  bool body_chunked;
+  bool body_keep;
+  uint32_t body_ctx[(HTTPD_CTX + 3) / 4];
+};
+
+static httpd_conn_t httpd_conns[HTTPD_CONNS];
+static WiFiServer *httpd_server = NULL;
+static const httpd_route_t *httpd_routes = NULL;
+static size_t httpd_route_count = 0;
+static httpd_stats_t httpd_stats;
+
+// Response being built: head and chunk size are placed directly in front of
+// the body, so every flush is a single send (max. 1400 bytes on the WINC1500).
+static uint8_t out_buf[HTTPD_HDR + HTTPD_BUF + 8];
+#define OUT_BODY (out_buf + HTTPD_HDR)
+
+static struct
+{
+  httpd_conn_t *c;
+  uint16_t status;
+  const char *type;
+  const char *headers;
+  size_t len;    // bytes in the body buffer
+  bool started;  // httpd_respond() called
+  bool sent;     // head sent
+  bool chunked;
+  bool keep;
+  bool stream;   // httpd_stream() called
+  bool failed;   // write error, connection is closed
+} resp;
+
+static const char *status_text(uint16_t status)
+{
+  switch(status)
+  {
+    case 200: return "OK";
+    case 204: return "No Content";
+    case 302: return "Found";
+    case 400: return "Bad Request";
+    case 403: return "Forbidden";
+    case 404: return "Not Found";
+    case 405: return "Method Not Allowed";
+    case 408: return "Request Timeout";
+    case 413: return "Payload Too Large";
+    case 414: return "URI Too Long";
+    case 431: return "Request Header Fields Too Large";
+    case 500: return "Internal Server Error";
+    case 501: return "Not Implemented";
+    case 503: return "Service Unavailable";
+  }
+  return "";
+}
+
+static size_t head_add(char *h, size_t n, size_t size, const char *fmt, ...)
+{
+  va_list ap;
+  int r;
+
+  if(n >= size)
+  {
+    return n;
+  }
+  va_start(ap, fmt);
+  r = vsnprintf(h + n, size - n, fmt, ap);
+  va_end(ap);
+  if(r < 0)
+  {
+    return n;
+  }
+  return ((n + r) < size) ? (n + r) : (size - 1);
+}
+
+static size_t resp_head(char *h, size_t size, long length)
+{
+  httpd_conn_t *c = resp.c;
+  size_t n = 0;
+
+  n = head_add(h, n, size, "HTTP/1.1 %u %s\r\n", resp.status, status_text(resp.status));
+  if(resp.type)
+  {
+    n = head_add(h, n, size, "Content-Type: %s\r\n", resp.type);
+  }
+  if(resp.chunked)
+  {
+    n = head_add(h, n, size, "Transfer-Encoding: chunked\r\n");
+  }
+  else if(length >= 0)
+  {
+    n = head_add(h, n, size, "Content-Length: %ld\r\n", length);
+  }
+  if(resp.keep)
+  {
+    n = head_add(h, n, size, "Connection: keep-alive\r\nKeep-Alive: timeout=%u, max=%u\r\n",
+                 HTTPD_IDLE_MS / 1000, HTTPD_MAX_REQS - c->reqs);
+  }
+  else
+  {
+    n = head_add(h, n, size, "Connection: close\r\n");
+  }
+  if(resp.headers)
+  {
+    n = head_add(h, n, size, "%s", resp.headers);
+  }
+  return head_add(h, n, size, "\r\n");
+}
+
+static void resp_flush(bool last)
+{
+  char pre[HTTPD_HDR];
+  size_t plen = 0, len = resp.len;
+
+  if(!resp.sent)
+  {
+    if(resp.stream)
+    {
+      last = false; // stream data follows until the connection is closed
+      resp.keep = false;
+    }
+    else if(!last) // body does not fit into the buffer
+    {
+      if(resp.c->req.http11)
+      {
+        resp.chunked = true;
+      }
+      else
+      {
+        resp.keep = false; // HTTP/1.0: the body ends with the connection
+      }
+    }
+    plen = resp_head(pre, sizeof(pre) - 8, last ? (long)len : -1);
+  }
+  if(resp.chunked)
+  {
+    if(len > 0)
+    {
+      plen += sprintf(pre + plen, "%X\r\n", (unsigned int)len);
+      OUT_BODY[len++] = '\r';
+      OUT_BODY[len++] = '\n';
+    }
+    if(last)
+    {
+      memcpy(OUT_BODY + len, "0\r\n\r\n", 5);
+      len += 5;
+    }
+  }
+
+  uint8_t *start = OUT_BODY - plen;
+  memcpy(start, pre, plen);
+  if(!resp.failed && ((plen + len) > 0))
+  {
+    if(resp.c->client.write(start, plen + len) != (plen + len))
+    {
+      resp.failed = true;
+    }
+  }
+  resp.sent = true;
+  resp.len = 0;
+}
+
+static int conn_getc(httpd_conn_t *c)
+{
+  if(c->rx_pos >= c->rx_len)
+  {
+    if(!c->client.available())
+    {
+      return -1;
+    }
+    int n = c->client.read(c->rx, HTTPD_RX);
+    if(n <= 0)
+    {
+      return -1;
+    }
+    c->rx_pos = 0;
+    c->rx_len = n;
+  }
+  return c->rx[c->rx_pos++];
+}
+
+static void conn_free(httpd_conn_t *c)
+{
+  c->client.stop();
+  c->state = CONN_FREE;
+}
+
+static void conn_reset_req(httpd_conn_t *c)
+{
+  c->line_len = 0;
+  c->line_long = false;
+  c->req_line = false;
+  c->in_head = false;
+  c->error = 0;
+}
+
+// Sends the buffered response part and sets the next connection state.
+static void conn_send(httpd_conn_t *c, bool more)
+{
+  resp_flush(!more);
+  c->t_last = millis();
+  if(resp.failed)
+  {
+    conn_free(c);
+  }
+  else if(more)
+  {
+    c->state = CONN_BODY;
+  }
+  else if(resp.stream)
+  {
+    c->state = CONN_STREAM;
+  }
+  else if(!resp.keep)
+  {
+    c->state = CONN_CLOSE;
+  }
+  else if(c->body_left > 0)
+  {
+    c->state = CONN_SKIP;
+  }
+  else
+  {
+    c->state = CONN_REQ;
+  }
+  c->body_chunked = resp.chunked;
+  c->body_keep = resp.keep;
+  resp.c = NULL;
+}
+
+static void conn_route(httpd_conn_t *c)
+{
+  static const char *const allow[] = { "", "Allow: GET\r\n", "Allow: POST\r\n", "Allow: GET, POST\r\n" };
+  const httpd_route_t *r = cfg_key_find(httpd_routes, httpd_route_count, c->req.path, true); // paths are case-sensitive
+  uint8_t method = 0;
+
+  if(!r)
+  {
+    return; // 404
+  }
+  if(strcmp(c->req.method, "GET") == 0)
+  {
+    method = HTTPD_GET;
+  }
+  else if(strcmp(c->req.method, "POST") == 0)
+  {
+    method = HTTPD_POST;
+  }
+  if(!(r->methods & method))
+  {
+    httpd_respond(c, 405, "text/plain", allow[r->methods & (HTTPD_GET | HTTPD_POST)]);
+    httpd_print(c, "405 Method Not Allowed\r\n");
+    return;
+  }
+  if(r->type)
+  {
+    httpd_respond(c, 200, r->type, NULL);
+  }
+  r->fn(c, &c->req);
+}
+
+static void conn_request(httpd_conn_t *c)
+{
+  memset(&resp, 0, sizeof(resp));
+  resp.c = c;
+  c->body_left = c->req.content_length;
+  c->body_fn = NULL;
+  c->reqs++;
+
+  if(c->error)
+  {
+    httpd_respond(c, c->error, "text/plain", NULL);
+    httpd_printf(c, "%u %s\r\n", c->error, status_text(c->error));
+  }
+  else
+  {
+    conn_route(c);
+  }
+  if(!resp.started)
+  {
+    c->body_fn = NULL;
+    httpd_respond(c, 404, "text/plain", NULL);
+    httpd_print(c, "404 Not Found\r\n");
+  }
+  httpd_stats.reqs++;
+  conn_reset_req(c);
+  // a short generated body still goes out with Content-Length
+  conn_send(c, c->body_fn && c->body_fn(c, c->body_ctx));
+}
+
+static void conn_body(httpd_conn_t *c)
+{
+  if(!c->client.connected())
+  {
+    conn_free(c);
+    return;
+  }
+  memset(&resp, 0, sizeof(resp));
+  resp.c = c;
+  resp.started = true;
+  resp.sent = true;
+  resp.chunked = c->body_chunked;
+  resp.keep = c->body_keep;
+  conn_send(c, c->body_fn(c, c->body_ctx));
+}
+
+static void conn_request_line(httpd_conn_t *c)
+{
+  httpd_req_t *r = &c->req;
+  char *target, *version, *q;
+
+  memset(r, 0, sizeof(httpd_req_t));
+  r->query = "";
+  c->req_line = true;
+  if(c->line_long)
+  {
+    c->error = 414;
+    return;
+  }
+  target = strchr(c->line, ' ');
+  version = target ? strchr(target + 1, ' ') : NULL;
+  if(!version || ((size_t)(target - c->line) >= sizeof(r->method)) || strncmp(version + 1, "HTTP/1.", 7))
+  {
+    c->error = 400;
+    return;
+  }
+  *target++ = 0;
+  *version++ = 0;
+  strcpy(r->method, c->line);
+  strcpy(r->path, target);
+  q = strchr(r->path, '?');
+  if(q)
+  {
+    *q++ = 0;
+    r->query = q;
+  }
+  r->http11 = (version[7] != '0');
+  r->keep_alive = r->http11;
+}
+
+static void conn_header(httpd_conn_t *c)
+{
+  char *value;
+
+  if(c->line_long)
+  {
+    if(c->error == 0)
+    {
+      c->error = 431;
+    }
+    return;
+  }
+  value = strchr(c->line, ':');
+  if(!value)
+  {
+    return;
+  }
+  *value++ = 0;
+  while(*value == ' ')
+  {
+    value++;
+  }
+  if(strcasecmp(c->line, "Connection") == 0)
+  {
+    if(strcasestr(value, "close"))
+    {
+      c->req.keep_alive = false;
+    }
+    else if(strcasestr(value, "keep-alive"))
+    {
+      c->req.keep_alive = true;
+    }
+  }
+  else if(strcasecmp(c->line, "Content-Length") == 0)
+  {
+    c->req.content_length = strtoul(value, NULL, 10);
+  }
+  else if((strcasecmp(c->line, "Transfer-Encoding") == 0) && (c->error == 0))
+  {
+    c->error = 501; // chunked request bodies are not supported
+  }
+}
+
+// Returns true when the request head is complete.
+static bool conn_line(httpd_conn_t *c)
+{
+  c->line[c->line_len] = 0;
+  if(!c->req_line)
+  {
+    if((c->line_len == 0) && !c->line_long)
+    {
+      return false; // empty lines before the request
+    }
+    conn_request_line(c);
+  }
+  else if((c->line_len == 0) && !c->line_long)
+  {
+    return true;
+  }
+  else
+  {
+    conn_header(c);
+  }
+  c->line_len = 0;
+  c->line_long = false;
+  return false;
+}
+
+static void conn_poll(httpd_conn_t *c)
+{
+  uint8_t answered = 0;
+  int ch;
+
+  if(c->state == CONN_CLOSE)
+  {
+    if((millis() - c->t_last) >= HTTPD_LINGER_MS)
+    {
+      conn_free(c);
+    }
+    return;
+  }
+  if(c->state == CONN_BODY)
+  {
+    conn_body(c);
+    return;
+  }
+  if(c->state == CONN_STREAM)
+  {
+    while(conn_getc(c) >= 0); // nothing is expected from the client
+    if(!c->client.connected())
+    {
+      conn_free(c);
+    }
+    return;
+  }
+
+  while((answered < HTTPD_PIPELINE) && ((c->state == CONN_REQ) || (c->state == CONN_SKIP)))
+  {
+    if(c->state == CONN_SKIP)
+    {
+      while((c->body_left > 0) && ((ch = conn_getc(c)) >= 0))
+      {
+        c->body_left--;
+        c->t_last = millis();
+      }
+      if(c->body_left > 0)
+      {
+        if((millis() - c->t_last) > HTTPD_HEAD_MS) // announced body does not arrive
+        {
+          httpd_stats.timeouts++;
+          conn_free(c);
+          return;
+        }
+        break;
+      }
+      c->state = CONN_REQ;
+    }
+    ch = conn_getc(c);
+    if(ch < 0)
+    {
+      break;
+    }
+    c->t_last = millis();
+    if(!c->in_head)
+    {
+      c->in_head = true;
+      c->t_head = c->t_last;
+    }
+    if(ch == '\n')
+    {
+      if(conn_line(c))
+      {
+        conn_request(c);
+        answered++;
+      }
+    }
+    else if(ch != '\r')
+    {
+      if(c->line_len < (HTTPD_LINE - 1))
+      {
+        c->line[c->line_len++] = ch;
+      }
+      else
+      {
+        c->line_long = true;
+      }
+    }
+  }
+
+  if(c->state == CONN_REQ)
+  {
+    if(c->in_head && (c->line_len == 0) && !c->req_line)
+    {
+      c->in_head = false; // only empty lines so far
+    }
+    if(c->in_head && ((millis() - c->t_head) > HTTPD_HEAD_MS))
+    {
+      httpd_stats.timeouts++;
+      c->req_line = true;
+      c->error = 408;
+      c->req.keep_alive = false;
+      conn_request(c);
+      return;
+    }
+    if(!c->in_head && ((millis() - c->t_last) > HTTPD_IDLE_MS))
+    {
+      httpd_stats.timeouts++;
+      conn_free(c);
+      return;
+    }
+  }
+  if((c->state != CONN_FREE) && !c->client.connected() && (c->rx_pos >= c->rx_len) && !c->client.available())
+  {
+    conn_free(c); // closed by the client
+  }
+}
+
+static bool conn_idle(const httpd_conn_t *c)
+{
+  return (c->state == CONN_REQ) && !c->in_head && (c->rx_pos >= c->rx_len);
+}
+
+static void conn_accept(WiFiClient &client)
+{
+  httpd_conn_t *slot = NULL;
+
+  for(uint8_t i = 0; i < HTTPD_CONNS; i++)
+  {
+    if(httpd_conns[i].state == CONN_FREE)
+    {
+      slot = &httpd_conns[i];
+      break;
+    }
+  }
+  if(!slot) // close the longest idle keep-alive connection
+  {
+    for(uint8_t i = 0; i < HTTPD_CONNS; i++)
+    {
+      httpd_conn_t *c = &httpd_conns[i];
+      if(conn_idle(c) && (!slot || ((millis() - c->t_last) > (millis() - slot->t_last))))
+      {
+        slot = c;
+      }
+    }
+    if(!slot)
+    {
+      static const char busy[] = "HTTP/1.1 503 Service Unavailable\r\nContent-Length: 0\r\nRetry-After: 1\r\nConnection: close\r\n\r\n";
+      client.write((const uint8_t *)busy, sizeof(busy) - 1);
+      client.stop();
+      httpd_stats.rejected++;
+      return;
+    }
+    slot->client.stop();
+    httpd_stats.evicted++;
+  }
+
+  slot->client = client;
+  slot->state = CONN_REQ;
+  slot->rx_pos = slot->rx_len = 0;
+  slot->reqs = 0;
+  slot->t_last = millis();
+  conn_reset_req(slot);
+  httpd_stats.conns++;
+}
+
+void httpd_begin(WiFiServer *server, const httpd_route_t *routes, size_t count)
+{
+  httpd_server = server;
+  httpd_routes = routes;
+  httpd_route_count = count;
+}
+
+void httpd_service(void)
+{
+  if(!httpd_server)
+  {
+    return;
+  }
+
+  WiFiClient client = httpd_server->available(); // new connection or one with data
+  if(client)
+  {
+    bool known = false;
+    for(uint8_t i = 0; i < HTTPD_CONNS; i++)
+    {
+      if((httpd_conns[i].state != CONN_FREE) && (httpd_conns[i].client == client))
+      {
+        known = true;
+        break;
+      }
+    }
+    if(!known)
+    {
+      conn_accept(client);
+    }
+  }
+
+  for(uint8_t i = 0; i < HTTPD_CONNS; i++)
+  {
+    if(httpd_conns[i].state != CONN_FREE)
+    {
+      conn_poll(&httpd_conns[i]);
+    }
+  }
+}
+
+void httpd_close_all(void)
+{
+  for(uint8_t i = 0; i < HTTPD_CONNS; i++)
+  {
+    if(httpd_conns[i].state != CONN_FREE)
+    {
+      conn_free(&httpd_conns[i]);
+    }
+  }
+}
+
+void httpd_respond(httpd_conn_t *c, uint16_t status, const char *type, const char *headers)
+{
+  if((resp.c != c) || resp.started)
+  {
+    return;
+  }
+  resp.started = true;
+  resp.status = status;
+  resp.type = type;
+  resp.headers = headers;
+  resp.keep = c->req.keep_alive && (c->error == 0) && (c->reqs < HTTPD_MAX_REQS);
+}
+
+void httpd_write(httpd_conn_t *c, const void *data, size_t len)
+{
+  const uint8_t *p = (const uint8_t *)data;
+
+  if((resp.c != c) || !resp.started)
+  {
+    return;
+  }
+  while(len > 0)
+  {
+    size_t n = HTTPD_BUF - resp.len;
+    if(n == 0)
+    {
+      resp_flush(false);
+      continue;
+    }
+    if(n > len)
+    {
+      n = len;
+    }
+    memcpy(OUT_BODY + resp.len, p, n);
+    resp.len += n;
+    p += n;
+    len -= n;
+  }
+}
+
+bool httpd_query(const httpd_req_t *req, const char *name, char *value, size_t size)
+{
+  size_t nlen = strlen(name);
+  const char *p = req->query;
+
+  while(*p)
+  {
+    const char *end = strchr(p, '&');
+    if(!end)
+    {
+      end = p + strlen(p);
+    }
+    if((strncmp(p, name, nlen) == 0) && ((p[nlen] == '=') || ((p + nlen) == end)))
+    {
+      const char *v = (p[nlen] == '=') ? (p + nlen + 1) : end;
+      if((size_t)(end - v) >= size)
+      {
+        return false;
+      }
+      memcpy(value, v, end - v);
+      value[end - v] = 0;
+      return true;
+    }
+    p = *end ? (end + 1) : end;
+  }
+  return false;
+}
+
+static uint8_t hex_val(char c)
+{
+  return (c <= '9') ? (c - '0') : ((c | 0x20) - 'a' + 10);
+}
+
+void httpd_urldecode(char *s)
+{
+  char *dst = s;
+
+  while(*s)
+  {
+    if((s[0] == '%') && isxdigit((uint8_t)s[1]) && isxdigit((uint8_t)s[2]))
+    {
+      *dst++ = (hex_val(s[1]) << 4) | hex_val(s[2]);
+      s += 3;
+    }
+    else if(*s == '+')
+    {
+      *dst++ = ' ';
+      s++;
+    }
+    else
+    {
+      *dst++ = *s++;
+    }
+  }
+  *dst = 0;
+}
+
+size_t httpd_space(httpd_conn_t *c)
+{
+  return ((resp.c == c) && resp.started) ? (HTTPD_BUF - resp.len) : 0;
+}
+
+void *httpd_body(httpd_conn_t *c, httpd_body_fn fn)
+{
+  if((resp.c != c) || resp.stream)
+  {
+    return NULL;
+  }
+  c->body_fn = fn;
+  memset(c->body_ctx, 0, sizeof(c->body_ctx));
+  return c->body_ctx;
+}
+
+void httpd_print(httpd_conn_t *c, const char *s)
+{
+  httpd_write(c, s, strlen(s));
+}
+
+void httpd_printf(httpd_conn_t *c, const char *fmt, ...)
+{
+  va_list ap, ap2;
+  int n;
+
+  if((resp.c != c) || !resp.started)
+  {
+    return;
+  }
+  va_start(ap, fmt);
+  va_copy(ap2, ap);
+  n = vsnprintf((char *)OUT_BODY + resp.len, HTTPD_BUF - resp.len + 1, fmt, ap);
+  if((n >= 0) && ((size_t)n > (HTTPD_BUF - resp.len)) && (resp.len > 0))
+  {
+    resp_flush(false); // does not fit, format again into the empty buffer
+    n = vsnprintf((char *)OUT_BODY, HTTPD_BUF + 1, fmt, ap2);
+  }
+  va_end(ap2);
+  va_end(ap);
+  if(n > 0)
+  {
+    resp.len += ((size_t)n < (HTTPD_BUF - resp.len)) ? (size_t)n : (HTTPD_BUF - resp.len); // truncated if > HTTPD_BUF
+  }
+}
+
+void httpd_escaped(httpd_conn_t *c, const char *s, bool html)
+{
+  for(; *s; s++)
+  {
+    uint8_t ch = *s;
+    if(html && ((ch == '&') || (ch == '<') || (ch == '>') || (ch == '\'') || (ch == '"')))
+    {
+      httpd_printf(c, "&#%u;", ch);
+    }
+    else if(!html && ((ch == '"') || (ch == '\\')))
+    {
+      httpd_printf(c, "\\%c", ch);
+    }
+    else if(!html && (ch < 0x20))
+    {
+      httpd_printf(c, "\\u%04x", ch);
+    }
+    else
+    {
+      httpd_write(c, &ch, 1);
+    }
+  }
+}
+
+static uint8_t conn_count(uint8_t state)
+{
+  uint8_t n = 0;
+
+  for(uint8_t i = 0; i < HTTPD_CONNS; i++)
+  {
+    if(httpd_conns[i].state == state)
+    {
+      n++;
+    }
+  }
+  return n;
+}
+
+bool httpd_stream(httpd_conn_t *c)
+{
+  if((resp.c != c) || resp.started || (conn_count(CONN_STREAM) >= HTTPD_STREAMS))
+  {
+    return false;
+  }
+  resp.stream = true;
+  return true;
+}
+
+uint8_t httpd_broadcast(const void *data, size_t len)
+{
+  uint8_t n = 0;
+
+  for(uint8_t i = 0; i < HTTPD_CONNS; i++)
+  {
+    httpd_conn_t *c = &httpd_conns[i];
+    if(c->state != CONN_STREAM)
+    {
+      continue;
+    }
+    if(c->client.write((const uint8_t *)data, len) != len)
+    {
+      conn_free(c); // gone without closing
+      continue;
+    }
+    c->t_last = millis();
+    n++;
+  }
+  return n;
+}
+
+uint8_t httpd_streams(void)
+{
+  return conn_count(CONN_STREAM);
+}
+
+size_t httpd_read_body(httpd_conn_t *c, char *buf, size_t size)
+{
+  uint32_t t0 = millis();
+  size_t n = 0;
+
+  while(((n + 1) < size) && (c->body_left > 0))
+  {
+    int ch = conn_getc(c);
+    if(ch < 0)
+    {
+      if(((millis() - t0) > HTTPD_BODY_MS) || !c->client.connected())
+      {
+        break;
+      }
+      continue;
+    }
+    buf[n++] = ch;
+    c->body_left--;
+  }
+  buf[n] = 0;
+  return n;
+}
+
+void httpd_get_stats(httpd_stats_t *stats)
+{
+  *stats = httpd_stats;
+  stats->open = HTTPD_CONNS - conn_count(CONN_FREE);
+  stats->streams = conn_count(CONN_STREAM);
+}
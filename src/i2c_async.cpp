@@ -0,0 +1,380 @@
+#include "i2c_async.h"
+#include "ticker.h"
+#include "dmac.h"
+
+typedef enum
+{
+  BUS_IDLE,
+  BUS_WRITE,
+  BUS_DELAY,
+  BUS_READ
+} bus_phase_t;
+
+typedef struct
+{
+  Sercom *sercom;
+  int8_t ch_tx;
+  int8_t ch_rx;
+  bool ready;
+  volatile bool locked;
+  volatile uint8_t phase;
+  i2c_txn_t *queue[I2C_ASYNC_QUEUE];
+  volatile uint8_t head;
+  volatile uint8_t tail;
+  i2c_txn_t *cur;
+  uint16_t wait;      // ms left in the current phase
+  uint32_t phase_us;  // start of the current bus transfer
+  // statistics
+  uint32_t txns;
+  uint32_t errors;
+  uint64_t lat_sum;
+  uint32_t lat_max;
+  uint32_t busy_us;
+  uint32_t window_us;
+} i2c_bus_t;
+
+static i2c_bus_t i2c_bus[I2C_BUSES];
+static bool i2c_ticker = false;
+
+static void i2c_sync(Sercom *s)
+{
+  while(s->I2CM.SYNCBUSY.bit.SYSOP);
+}
+
+static uint8_t bus_error(Sercom *s)
+{
+  uint16_t status = s->I2CM.STATUS.reg;
+
+  if(status & (SERCOM_I2CM_STATUS_BUSERR | SERCOM_I2CM_STATUS_ARBLOST))
+  {
+    return I2C_ASYNC_ERROR;
+  }
+  if((s->I2CM.INTFLAG.reg & SERCOM_I2CM_INTFLAG_MB) && (status & SERCOM_I2CM_STATUS_RXNACK))
+  {
+    return I2C_ASYNC_NACK;
+  }
+
+  return I2C_ASYNC_PENDING;
+}
+
+// Releases the bus and leaves CTRLB as the Wire driver expects it.
+static void bus_stop(Sercom *s)
+{
+  if(s->I2CM.STATUS.bit.BUSSTATE == 2) // owner
+  {
+    s->I2CM.CTRLB.reg = SERCOM_I2CM_CTRLB_ACKACT | SERCOM_I2CM_CTRLB_CMD(3);
+    i2c_sync(s);
+  }
+  s->I2CM.CTRLB.reg = 0;
+  i2c_sync(s);
+}
+
+static void bus_busy_end(i2c_bus_t *b)
+{
+  b->busy_us += micros() - b->phase_us;
+}
+
+static void bus_finish(i2c_bus_t *b, uint8_t status)
+{
+  i2c_txn_t *t = b->cur;
+  uint32_t lat = micros() - t->submit_us;
+
+  if(status != I2C_ASYNC_OK)
+  {
+    b->errors++;
+    if(b->sercom->I2CM.STATUS.bit.BUSSTATE != 1)
+    {
+      b->sercom->I2CM.STATUS.reg = SERCOM_I2CM_STATUS_BUSSTATE(1); // force idle
+      i2c_sync(b->sercom);
+    }
+  }
+  b->txns++;
+  b->lat_sum += lat;
+  if(lat > b->lat_max)
+  {
+    b->lat_max = lat;
+  }
+
+  b->cur = NULL;
+  b->phase = BUS_IDLE;
+  t->status = status;
+  if(t->done)
+  {
+    t->done(t);
+  }
+}
+
+static void phase_write(i2c_bus_t *b)
+{
+  Sercom *s = b->sercom;
+  i2c_txn_t *t = b->cur;
+
+  s->I2CM.CTRLB.reg = 0;
+  i2c_sync(s);
+  // TX requests follow INTFLAG.MB, i.e. start after the address was acknowledged.
+  dmac_transfer(b->ch_tx, t->wbuf, &s->I2CM.DATA.reg, t->wlen, true, false);
+  s->I2CM.ADDR.reg = SERCOM_I2CM_ADDR_ADDR(t->addr << 1);
+  i2c_sync(s);
+
+  b->phase_us = micros();
+  b->wait = I2C_ASYNC_TIMEOUT_MS;
+  b->phase = BUS_WRITE;
+}
+
+static void phase_read(i2c_bus_t *b)
+{
+  Sercom *s = b->sercom;
+  i2c_txn_t *t = b->cur;
+
+  // Smart mode: every DATA read by the DMA acknowledges the byte and clocks
+  // the next one. The last byte is left for the tick, which NACKs it.
+  s->I2CM.CTRLB.reg = SERCOM_I2CM_CTRLB_SMEN;
+  i2c_sync(s);
+  if(t->rlen > 1)
+  {
+    dmac_transfer(b->ch_rx, &s->I2CM.DATA.reg, t->rbuf, t->rlen - 1, false, true);
+  }
+  s->I2CM.ADDR.reg = SERCOM_I2CM_ADDR_ADDR((t->addr << 1) | 1);
+  i2c_sync(s);
+
+  b->phase_us = micros();
+  b->wait = I2C_ASYNC_TIMEOUT_MS;
+  b->phase = BUS_READ;
+}
+
+static void phase_next(i2c_bus_t *b)
+{
+  i2c_txn_t *t = b->cur;
+
+  if(t->delay_ms > 0)
+  {
+    b->wait = t->delay_ms + 1; // at least delay_ms with a 1 ms tick
+    b->phase = BUS_DELAY;
+  }
+  else if(t->rlen > 0)
+  {
+    phase_read(b);
+  }
+  else
+  {
+    bus_finish(b, I2C_ASYNC_OK);
+  }
+}
+
+static void bus_timeout(i2c_bus_t *b, int8_t ch)
+{
+  dmac_abort(ch);
+  bus_busy_end(b);
+  bus_stop(b->sercom);
+  bus_finish(b, I2C_ASYNC_TIMEOUT);
+}
+
+static void bus_tick(i2c_bus_t *b)
+{
+  Sercom *s = b->sercom;
+  uint8_t err;
+
+  switch(b->phase)
+  {
+    case BUS_WRITE:
+      err = bus_error(s);
+      if(err != I2C_ASYNC_PENDING)
+      {
+        dmac_abort(b->ch_tx);
+        bus_busy_end(b);
+        bus_stop(s);
+        bus_finish(b, err);
+      }
+      else if(!dmac_busy(b->ch_tx) && (s->I2CM.INTFLAG.reg & SERCOM_I2CM_INTFLAG_MB))
+      {
+        bus_busy_end(b);
+        bus_stop(s);
+        phase_next(b);
+      }
+      else if(--b->wait == 0)
+      {
+        bus_timeout(b, b->ch_tx);
+      }
+      break;
+
+    case BUS_DELAY:
+      if(--b->wait == 0)
+      {
+        if(b->cur->rlen > 0)
+        {
+          phase_read(b);
+        }
+        else
+        {
+          bus_finish(b, I2C_ASYNC_OK);
+        }
+      }
+      break;
+
+    case BUS_READ:
+      err = bus_error(s);
+      if(err != I2C_ASYNC_PENDING)
+      {
+        dmac_abort(b->ch_rx);
+        bus_busy_end(b);
+        bus_stop(s);
+        bus_finish(b, err);
+      }
+      else if(!dmac_busy(b->ch_rx) && (s->I2CM.INTFLAG.reg & SERCOM_I2CM_INTFLAG_SB))
+      {
+        // Last byte is waiting in the shift register: NACK + STOP, then take it.
+        s->I2CM.CTRLB.reg = SERCOM_I2CM_CTRLB_ACKACT;
+        i2c_sync(s);
+        s->I2CM.CTRLB.reg = SERCOM_I2CM_CTRLB_ACKACT | SERCOM_I2CM_CTRLB_CMD(3);
+        i2c_sync(s);
+        b->cur->rbuf[b->cur->rlen - 1] = s->I2CM.DATA.reg;
+        s->I2CM.CTRLB.reg = 0;
+        i2c_sync(s);
+        bus_busy_end(b);
+        bus_finish(b, I2C_ASYNC_OK);
+      }
+      else if(--b->wait == 0)
+      {
+        bus_timeout(b, b->ch_rx);
+      }
+      break;
+
+    case BUS_IDLE:
+    default:
+      break;
+  }
+
+  // Start the next queued transaction right away.
+  while((b->phase == BUS_IDLE) && !b->locked && (b->head != b->tail))
+  {
+    b->cur = b->queue[b->head];
+    b->head = (b->head + 1) & (I2C_ASYNC_QUEUE - 1);
+    if(b->cur->wlen > 0)
+    {
+      phase_write(b);
+    }
+    else
+    {
+      phase_next(b);
+    }
+  }
+}
+
+static void i2c_tick(void)
+{
+  for(uint8_t i = 0; i < I2C_BUSES; i++)
+  {
+    if(i2c_bus[i].ready)
+    {
+      bus_tick(&i2c_bus[i]);
+    }
+  }
+}
+
+bool i2c_async_begin(uint8_t bus)
+{
+  if(bus >= I2C_BUSES)
+  {
+    return false;
+  }
+
+  i2c_bus_t *b = &i2c_bus[bus];
+  if(b->ready)
+  {
+    return true;
+  }
+
+  dmac_begin();
+  if(bus == I2C_BUS0)
+  {
+    b->sercom = SERCOM0;
+    b->ch_tx = dmac_channel_alloc(SERCOM0_DMAC_ID_TX, NULL);
+    b->ch_rx = dmac_channel_alloc(SERCOM0_DMAC_ID_RX, NULL);
+  }
+  else
+  {
+    b->sercom = SERCOM2;
+    b->ch_tx = dmac_channel_alloc(SERCOM2_DMAC_ID_TX, NULL);
+    b->ch_rx = dmac_channel_alloc(SERCOM2_DMAC_ID_RX, NULL);
+  }
+  if((b->ch_tx < 0) || (b->ch_rx < 0))
+  {
+    return false;
+  }
+
+  b->phase = BUS_IDLE;
+  b->head = b->tail = 0;
+  b->window_us = micros();
+  b->ready = true;
+
+  if(!i2c_ticker)
+  {
+    i2c_ticker = true;
+    ticker_begin();
+    ticker_attach(i2c_tick, 1);
+  }
+
+  return true;
+}
+
+bool i2c_async_submit(uint8_t bus, i2c_txn_t *txn)
+{
+  bool ok = false;
+
+  if((bus >= I2C_BUSES) || !i2c_bus[bus].ready)
+  {
+    return false;
+  }
+
+  i2c_bus_t *b = &i2c_bus[bus];
+  ticker_lock();
+  uint8_t next = (b->tail + 1) & (I2C_ASYNC_QUEUE - 1);
+  if(next != b->head)
+  {
+    txn->status = I2C_ASYNC_PENDING;
+    txn->submit_us = micros();
+    b->queue[b->tail] = txn;
+    b->tail = next;
+    ok = true;
+  }
+  ticker_unlock();
+
+  return ok;
+}
+
+bool i2c_async_idle(uint8_t bus)
+{
+  i2c_bus_t *b = &i2c_bus[bus];
+
+  return (b->phase == BUS_IDLE) && (b->head == b->tail);
+}
+
+void i2c_async_lock(uint8_t bus)
+{
+  i2c_bus_t *b = &i2c_bus[bus];
+
+  b->locked = true;
+  while(b->phase != BUS_IDLE); // finished by the ticker
+}
+
+void i2c_async_unlock(uint8_t bus)
+{
+  i2c_bus[bus].locked = false;
+}
+
+void i2c_async_get_stats(uint8_t bus, i2c_async_stats_t *stats)
+{
+  i2c_bus_t *b = &i2c_bus[bus];
+  uint32_t now = micros();
+
+  ticker_lock();
+  uint32_t window = now - b->window_us;
+  stats->txns = b->txns;
+  stats->errors = b->errors;
+  stats->latency_avg_us = (b->txns > 0) ? (b->lat_sum / b->txns) : 0;
+  stats->latency_max_us = b->lat_max;
+  stats->utilization = (window > 0) ? (uint8_t)(((uint64_t)b->busy_us * 100) / window) : 0;
+  b->busy_us = 0;
+  b->window_us = now;
+  ticker_unlock();
+}
@@ -0,0 +1,93 @@
+#include "i2c_scan.h"
+
+static i2c_scan_t scan_result[I2C_BUSES];
+
+static void scan_sync(Sercom *s)
+{
+  while(s->I2CM.SYNCBUSY.bit.SYSOP);
+}
+
+static uint8_t scan_probe(Sercom *s, uint8_t addr)
+{
+  uint8_t status = I2C_ASYNC_OK;
+  uint32_t t0 = micros();
+
+  s->I2CM.ADDR.reg = SERCOM_I2CM_ADDR_ADDR(addr << 1); // START + address, write
+  scan_sync(s);
+  while(!(s->I2CM.INTFLAG.reg & (SERCOM_I2CM_INTFLAG_MB | SERCOM_I2CM_INTFLAG_SB)))
+  {
+    if((micros() - t0) > I2C_SCAN_TIMEOUT_US)
+    {
+      status = I2C_ASYNC_TIMEOUT; // SCL held low or no clock
+      break;
+    }
+  }
+  if(status == I2C_ASYNC_OK)
+  {
+    if(s->I2CM.STATUS.reg & (SERCOM_I2CM_STATUS_BUSERR | SERCOM_I2CM_STATUS_ARBLOST))
+    {
+      status = I2C_ASYNC_ERROR;
+    }
+    else if(s->I2CM.STATUS.bit.RXNACK)
+    {
+      status = I2C_ASYNC_NACK;
+    }
+  }
+
+  if(s->I2CM.STATUS.bit.BUSSTATE == 2) // owner
+  {
+    s->I2CM.CTRLB.reg = SERCOM_I2CM_CTRLB_CMD(3); // STOP
+    scan_sync(s);
+  }
+  s->I2CM.CTRLB.reg = 0;
+  scan_sync(s);
+  if((status == I2C_ASYNC_TIMEOUT) || (status == I2C_ASYNC_ERROR))
+  {
+    s->I2CM.STATUS.reg = SERCOM_I2CM_STATUS_BUSSTATE(1); // force idle
+    scan_sync(s);
+  }
+
+  return status;
+}
+
+void i2c_scan(uint8_t bus)
+{
+  if(bus >= I2C_BUSES)
+  {
+    return;
+  }
+
+  Sercom *s = (bus == I2C_BUS0) ? SERCOM0 : SERCOM2;
+  i2c_scan_t *r = &scan_result[bus];
+  uint32_t t0 = micros();
+
+  memset(r, 0, sizeof(i2c_scan_t));
+  for(uint8_t addr = I2C_SCAN_FIRST; addr <= I2C_SCAN_LAST; addr++)
+  {
+    uint8_t status = scan_probe(s, addr);
+    if(status == I2C_ASYNC_OK)
+    {
+      r->map[addr >> 5] |= 1UL << (addr & 31);
+      r->count++;
+    }
+    else if((status != I2C_ASYNC_NACK) && (++r->errors >= I2C_SCAN_MAX_ERRORS))
+    {
+      break; // bus stuck, do not spend 1ms on every address
+    }
+  }
+  r->time_us = micros() - t0;
+}
+
+bool i2c_scan_found(uint8_t bus, uint8_t addr)
+{
+  if((bus >= I2C_BUSES) || (addr > 0x7F))
+  {
+    return false;
+  }
+  return (scan_result[bus].map[addr >> 5] >> (addr & 31)) & 1;
+}
+
+const i2c_scan_t *i2c_scan_result(uint8_t bus)
+{
+  return &scan_result[(bus < I2C_BUSES) ? bus : I2C_BUS0];
+}
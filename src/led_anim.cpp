@@ -0,0 +1,302 @@
+#include "led_anim.h"
+#include "ticker.h"
+
+#define LED_ANIM_TICK_MS   (1000 / LED_ANIM_HZ)
+#define LED_ANIM_ENVELOPE  64
+
+typedef enum
+{
+  ANIM_STATIC,
+  ANIM_FADE,
+  ANIM_BLINK,
+  ANIM_BREATHE
+} anim_mode_t;
+
+static Adafruit_NeoPixel *anim_strip = NULL;
+static anim_mode_t anim_mode = ANIM_STATIC;
+static uint32_t anim_from = 0;
+static uint32_t anim_to = 0;
+static uint32_t anim_alt = 0;
+static uint16_t anim_step = 0;
+static uint16_t anim_steps = 1;
+static uint32_t anim_shown = 0;
+static bool anim_force = false;
+static bool anim_blanked = false;
+static uint8_t anim_envelope[LED_ANIM_ENVELOPE];
+static uint8_t anim_level[256];           // brightness table, channel value -> sent value
+static uint8_t anim_r = 1, anim_g = 0, anim_b = 2, anim_w = 1; // byte offsets in a pixel (NEO_GRB)
+static void (*anim_show)(void) = NULL;
+static bool anim_isr_show = false;        // show() may run in the ticker (DMA)
+static volatile bool anim_dirty = false;  // frame in the pixel buffer, waits for led_anim_service()
+
+// Blends two 0xRRGGBB colors, w = 0 (a) ... 256 (b).
+static uint32_t mix(uint32_t a, uint32_t b, uint16_t w)
+{
+  uint32_t out = 0;
+
+  for(uint8_t shift = 0; shift <= 16; shift += 8)
+  {
+    int32_t ca = (a >> shift) & 0xFF;
+    int32_t cb = (b >> shift) & 0xFF;
+    out |= (uint32_t)(ca + (((cb - ca) * (int32_t)w) >> 8)) << shift;
+  }
+
+  return out;
+}
+
+static uint16_t ms_to_steps(uint32_t ms)
+{
+  uint32_t steps = ms / LED_ANIM_TICK_MS;
+
+  if(steps == 0)
+  {
+    return 1;
+  }
+  if(steps > 0xFFFF)
+  {
+    return 0xFFFF;
+  }
+  return steps;
+}
+
+static uint32_t anim_render(void)
+{
+  switch(anim_mode)
+  {
+    case ANIM_FADE:
+      if(anim_step >= anim_steps)
+      {
+        anim_mode = ANIM_STATIC;
+        return anim_to;
+      }
+      anim_step++;
+      return mix(anim_from, anim_to, ((uint32_t)anim_step << 8) / anim_steps);
+    case ANIM_BLINK:
+      if(++anim_step >= (2 * anim_steps))
+      {
+        anim_step = 0;
+      }
+      return (anim_step < anim_steps) ? anim_to : anim_alt;
+    case ANIM_BREATHE:
+      if(++anim_step >= anim_steps)
+      {
+        anim_step = 0;
+      }
+      return mix(0, anim_to, anim_envelope[((uint32_t)anim_step * LED_ANIM_ENVELOPE) / anim_steps] + 1);
+    case ANIM_STATIC:
+    default:
+      return anim_to;
+  }
+}
+
+// Same scaling as Adafruit_NeoPixel::setBrightness(), once per level instead
+// of per pixel write.
+static void anim_levels(uint8_t brightness)
+{
+  uint16_t scale = (uint16_t)brightness + 1;
+
+  for(uint16_t c = 0; c < 256; c++)
+  {
+    anim_level[c] = (c * scale) >> 8;
+  }
+}
+
+// Writes color to every pixel through the brightness table. The pixel buffer
+// is written directly, so the strip brightness does not scale it again.
+static void anim_fill(uint32_t color)
+{
+  uint8_t *p = anim_strip->getPixels();
+  uint8_t bpp = (anim_w == anim_r) ? 3 : 4;
+  uint8_t r = anim_level[(color >> 16) & 0xFF];
+  uint8_t g = anim_level[(color >> 8) & 0xFF];
+  uint8_t b = anim_level[color & 0xFF];
+
+  for(uint16_t i = 0; i < anim_strip->numPixels(); i++, p += bpp)
+  {
+    p[anim_w] = 0;
+    p[anim_r] = r;
+    p[anim_g] = g;
+    p[anim_b] = b;
+  }
+}
+
+// Sends the pixel buffer. In the ticker only with DMA; a bit-banged show()
+// blocks all interrupts, there it is left to led_anim_service().
+static void anim_output(bool in_ticker)
+{
+  if(in_ticker && !anim_isr_show)
+  {
+    anim_dirty = true;
+    return;
+  }
+  anim_dirty = false;
+  anim_show();
+}
+
+static void anim_push(uint32_t color)
+{
+  if((color == anim_shown) && !anim_force)
+  {
+    return;
+  }
+
+  anim_shown = color;
+  anim_force = false;
+  anim_fill(color);
+  anim_output(true);
+}
+
+static void anim_tick(void)
+{
+  if((anim_strip == NULL) || anim_blanked)
+  {
+    return;
+  }
+  if((anim_mode == ANIM_STATIC) && !anim_force)
+  {
+    return; // nothing to animate, the strip may be owned by the main loop
+  }
+
+  anim_push(anim_render());
+}
+
+void led_anim_begin(Adafruit_NeoPixel *strip, neoPixelType type, void (*show)(void), bool show_in_isr)
+{
+  // Triangle 0..255..0 over one period, gamma-corrected for a perceptually even breath.
+  for(uint8_t i = 0; i < LED_ANIM_ENVELOPE; i++)
+  {
+    uint8_t half = LED_ANIM_ENVELOPE / 2;
+    uint8_t pos = (i < half) ? i : (LED_ANIM_ENVELOPE - 1 - i);
+    anim_envelope[i] = Adafruit_NeoPixel::gamma8((pos * 255) / (half - 1));
+  }
+
+  anim_w = (type >> 6) & 3;
+  anim_r = (type >> 4) & 3;
+  anim_g = (type >> 2) & 3;
+  anim_b = type & 3;
+  anim_levels(strip->getBrightness());
+
+  anim_show = show;
+  anim_isr_show = show_in_isr;
+  anim_strip = strip;
+  anim_shown = anim_to = strip->getPixelColor(0);
+  anim_mode = ANIM_STATIC;
+
+  ticker_begin();
+  ticker_attach(anim_tick, LED_ANIM_TICK_MS);
+}
+
+void led_anim_service(void)
+{
+  if(!anim_dirty)
+  {
+    return;
+  }
+
+  ticker_lock();
+  anim_output(false);
+  ticker_unlock();
+}
+
+void led_anim_show(uint32_t color)
+{
+  ticker_lock();
+  anim_mode = ANIM_STATIC;
+  anim_to = color;
+  anim_shown = color;
+  anim_force = false;
+  if(anim_strip && !anim_blanked) // otherwise shown when the blanking ends
+  {
+    anim_fill(color);
+    anim_output(false);
+  }
+  ticker_unlock();
+}
+
+void led_anim_fade(uint32_t color, uint16_t ms)
+{
+  ticker_lock();
+  if(((anim_mode == ANIM_STATIC) || (anim_mode == ANIM_FADE)) && (anim_to == color))
+  {
+    ticker_unlock();
+    return;
+  }
+  anim_from = anim_shown;
+  anim_to = color;
+  anim_step = 0;
+  anim_steps = ms_to_steps(ms);
+  anim_mode = ANIM_FADE;
+  ticker_unlock();
+}
+
+void led_anim_blink(uint32_t color_on, uint32_t color_off, uint16_t freq_dhz)
+{
+  uint16_t steps = ms_to_steps(5000UL / ((freq_dhz > 0) ? freq_dhz : 1)); // half period
+
+  ticker_lock();
+  if((anim_mode == ANIM_BLINK) && (anim_to == color_on) && (anim_alt == color_off) && (anim_steps == steps))
+  {
+    ticker_unlock();
+    return;
+  }
+  anim_to = color_on;
+  anim_alt = color_off;
+  anim_step = 0;
+  anim_steps = steps;
+  anim_mode = ANIM_BLINK;
+  ticker_unlock();
+}
+
+void led_anim_breathe(uint32_t color, uint16_t period_ms)
+{
+  uint16_t steps = ms_to_steps(period_ms);
+
+  ticker_lock();
+  if((anim_mode == ANIM_BREATHE) && (anim_to == color) && (anim_steps == steps))
+  {
+    ticker_unlock();
+    return;
+  }
+  anim_to = color;
+  anim_step = 0;
+  anim_steps = steps;
+  anim_mode = ANIM_BREATHE;
+  ticker_unlock();
+}
+
+bool led_anim_busy(void)
+{
+  return (anim_mode != ANIM_STATIC) || anim_force || anim_dirty;
+}
+
+void led_anim_brightness(uint8_t brightness)
+{
+  ticker_lock();
+  if(anim_strip)
+  {
+    anim_strip->setBrightness(brightness); // for direct writes (menu, remote mode)
+    anim_levels(brightness);
+    anim_force = true; // re-render the current frame at the new level on the next tick
+  }
+  ticker_unlock();
+}
+
+void led_anim_blank(bool blank)
+{
+  if((anim_strip == NULL) || (blank == anim_blanked))
+  {
+    return;
+  }
+
+  anim_blanked = blank;
+  if(blank)
+  {
+    anim_fill(0);
+    anim_output(true);
+  }
+  else
+  {
+    anim_force = true;
+    anim_push(anim_render());
+  }
+}
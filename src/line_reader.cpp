@@ -0,0 +1,50 @@
+#include "line_reader.h"
+
+void line_reader_init(line_reader_t *lr)
+{
+  lr->len = 0;
+  lr->overflow = false;
+}
+
+line_status_t line_reader_poll(line_reader_t *lr, Stream *in, char **line)
+{
+  while(in->available() > 0)
+  {
+    int c = in->read();
+    if(c < 0)
+    {
+      break;
+    }
+
+    if((c == '\n') || (c == '\r'))
+    {
+      if(lr->overflow)
+      {
+        lr->overflow = false;
+        lr->len = 0;
+        return LINE_OVERFLOW;
+      }
+      if(lr->len == 0)
+      {
+        continue; // empty line or LF of a CRLF
+      }
+      lr->buf[lr->len] = 0;
+      lr->len = 0;
+      *line = lr->buf;
+      return LINE_READY;
+    }
+
+    if(lr->overflow)
+    {
+      continue;
+    }
+    if(lr->len >= (sizeof(lr->buf) - 1))
+    {
+      lr->overflow = true; // dropped up to the next line end
+      continue;
+    }
+    lr->buf[lr->len++] = (char)c;
+  }
+
+  return LINE_NONE;
+}
@@ -27,6 +27,10 @@
 //--- WiFi/WLAN ---
 #define WIFI_SSID          "" //WiFi SSID
 #define WIFI_CODE          "" //WiFi Passwort
+#define WIFI_TIMEOUT       10000 //10s, max. Wartezeit auf WiFi-Verbindung (WiFi.begin() blockiert, Standard 60s)
+#define WIFI_FAST_TIMEOUT  4000  //4s, max. Wartezeit beim Schnellverbinden mit dem gespeicherten Profil des WINC1500
+#define WIFI_POWER         0     //WiFi Power-Save: 0=nach Stromsparprofil, 1=aus, 2=automatisch (DTIM), 3=Deep Power-Save
+#define WIFI_LISTEN        3     //1-10, Listen-Intervall im Deep Power-Save in Beacons (je ca. 100ms)
 
 //--- MQTT ---
 #define MQTT_ENABLED       0      //0 = MQTT deaktiviert, 1 = MQTT aktiviert
@@ -37,26 +41,63 @@
 #define MQTT_CLIENT_ID     ""     //MQTT Client ID (leer = automatisch aus MAC)
 #define MQTT_TOPIC_PREFIX  "co2ampel" //MQTT Topic Prefix
 #define MQTT_INTERVAL      60     //MQTT Publish Intervall in Sekunden
+#define MQTT_KEEPALIVE     30     //s, Keep-Alive = Intervall + 30s, kein PINGREQ zwischen zwei Publishes
 
 //--- Ampelhelligkeit (LEDs) ---
 #define HELLIGKEIT         180 //1-255 (255=100%, 179=70%)
 #define HELLIGKEIT_DUNKEL  20  //1-255 (255=100%, 25=10%)
 #define NUM_LEDS           4   //Anzahl der LEDs
+#define LED_DMA            1   //1 = WS2812 via SERCOM3-SPI+DMA (Interrupts bleiben an), 0 = Bit-Banging
+#define LED_TYP            (NEO_GRB + NEO_KHZ800) //Byte-Reihenfolge und Takt der WS2812
+#define AMPEL_FADE_MS      1000 //Ueberblendzeit bei Farbwechsel in ms (0 = sofort)
+#define AMPEL_BLINK_DHZ    5   //Blinkfrequenz Rot in 1/10 Hz (5 = 0.5Hz, 1s an/1s aus)
+#define AMPEL_ATMEN        0   //1 = Rot "atmen" statt blinken
 
 //--- Lichtsensor ---
 #define LICHT_DUNKEL       20   //<20 -> dunkel
-#define LICHT_INTERVALL    60 //10-120min (Sensorpruefung)
+#define LICHT_HELL         40   //>40 -> wieder hell (Hysterese)
+#define LICHT_INTERVALL    3600 //1-3600s = 60min (Sensorpruefung, LEDs nur ca. 3ms aus)
 
 //--- Allgemein ---
 #define INTERVALL          2 //2-1800s Messintervall (nur SCD30, SCD4X immer 5s)
+#define INTERVALL_SCD4X    5 //5s Messintervall SCD4X (periodische Messung)
+#define SCD30_RDY_PIN     -1 //Pin fuer SCD30 RDY (Data-Ready), -1 = nicht verbunden
 #define AMPEL_DURCHSCHNITT 1 //1 = CO2 Durchschnitt fuer Ampel verwenden
 #define AUTO_KALIBRIERUNG  0 //1 = automatische Kalibrierung (ASC) an (erfordert 7 Tage Dauerbetrieb mit 1h Frischluft pro Tag)
 #define BUZZER             1 //Buzzer aktivieren
 #define BUZZER_DELAY     300 //300s, Buzzer Startverzögerung
+#define BUZZER_FREQ      BUZZER_SEQ_HZ //Tonfrequenz in Hz
+#define BUZZER_MUSTER_T3   0 //Alarmmuster ab co2.t3 (0=aus, 1=1s an/1s aus, 2=kurzer Piep alle 10s, 3=Doppelpiep alle 10s, 4=Dauerton)
+#define BUZZER_MUSTER_T4   0 //Alarmmuster ab co2.t4
+#define BUZZER_MUSTER_T5   1 //Alarmmuster ab co2.t5
 #define TEMP_OFFSET        6 //Pro WiFi, Temperaturoffset in °C (0-20)
 #define DRUCK_DIFF         5 //Druckunterschied in hPa (5-20)
+#define DRUCK_FILTER       8 //Tiefpass Luftdruck, neuer Wert geht mit 1/8 ein
 #define BAUDRATE           9600 //9600 Baud
-#define STARTWERT          500 //500ppm, CO2-Startwert
+#define SERIAL_ZEILEN      8    //max. Befehlszeilen pro loop()-Durchlauf
+#define STARTWERT          500 //500ppm, CO2-Startwert ohne gesicherte Ampelstufe
+#define BAND_SPEICHERN     300 //300s, Ampelstufe fruehestens alle 300s im Flash sichern (Anzeige nach Stromausfall)
+#define EVENTS_PING        15    //15s, Kommentar an /events ohne neue Daten (erkennt getrennte Clients)
+#define ZEIT_SYNC          21600 //6h, Abgleich der Uhrzeit per SNTP (WINC1500)
+#define ZEIT_RETRY         60    //60s, erneuter Versuch solange keine Zeit vorliegt
+#define ZEIT_MIN           1577836800UL //2020-01-01, kleinere Werte sind keine gueltige Zeit
+
+//--- Stromsparen ---
+#define POWER_PROFIL       0   //0=normal, 1=Low-Power (SCD4X 30s, MCU Standby, WiFi Power-Save), 2=Single-Shot (nur SCD41)
+#define POWER_INTERVALL    300 //30-3600s Messintervall Single-Shot (SCD30: Intervall im Low-Power-Profil, max. 1800s)
+#define INTERVALL_SCD4X_LP 30  //30s Messintervall SCD4X Low-Power periodisch
+//geschaetzte Stromaufnahme in uA (Datenblattwerte, ohne LEDs)
+#define STROM_MCU_AKTIV    6000
+#define STROM_MCU_STANDBY  60
+#define STROM_SCD30        19000
+#define STROM_SCD4X        15000
+#define STROM_SCD4X_LP     3200
+#define STROM_SCD41_IDLE   150
+#define STROM_SCD41_SHOT   90000 //uAs pro Single-Shot-Messung
+#define STROM_WINC         40000
+#define STROM_WINC_PS      2000
+#define STROM_WINC_MAXPS   1000 //Deep Power-Save, wach zu jedem DTIM
+#define STROM_WINC_DOZE    380  //Deep Power-Save zwischen den Beacons
 
 //--- Fixed Colors (not configurable) ---
 #define FARBE_VIOLETT      0xFF00FF //0xFF00FF (used for menu UI)
@@ -76,9 +117,13 @@
 //--- I2C/Wire ---
 #define ADDR_SCD30         0x61 //0x61, Wire=SERCOM0
 #define ADDR_SCD4X         0x62 //0x62, Wire=SERCOM0
+#define SCD4X_SCD40        0    //get_sensor_variant Bits 15..12
+#define SCD4X_SCD41        1
+#define SCD4X_UNBEKANNT    0xFF //Befehl nicht unterstuetzt (aeltere Sensor-Firmware)
 #define ADDR_LPS22HB       0x5C //0x5C, Wire1=SERCOM2
 #define ADDR_BMP280        0x76 //0x76 or 0x77, Wire1=SERCOM2
 #define ADDR_ATECC608      0x60 //0x60, Wire1=SERCOM2 (optional)
+#define CO2_ANLAUF         2000 //ms nach Reset, bis dahin wird Wire nach dem CO2-Sensor abgesucht (SCD30 max. 2s, SCD4X 1s)
 
 //--- Features ---
 enum Features
@@ -91,6 +136,14 @@ enum Features
   FEATURE_WINC1500 = (1<<5),
 };
 
+//--- Stromsparprofile ---
+enum Profiles
+{
+  PROFIL_NORMAL = 0,
+  PROFIL_LOW_POWER,
+  PROFIL_SINGLE_SHOT,
+};
+
 
 #include <Wire.h>
 #include <SPI.h>
@@ -103,6 +156,30 @@ enum Features
 #include <MQTT.h>
 
 #include "serial_settings.h"
+#include "settings_schema.h"
+#include "ws2812_dma.h"
+#include "ticker.h"
+#include "led_anim.h"
+#include "button.h"
+#include "buzzer_seq.h"
+#include "ambient.h"
+#include "scd4x_cmd.h"
+#include "i2c_async.h"
+#include "sensor_async.h"
+#include "power.h"
+#include "rtc_clock.h"
+#include "line_reader.h"
+#include "history.h"
+#include "binproto.h"
+#include "band_store.h"
+#include "i2c_scan.h"
+#include "httpd.h"
+#include "history_http.h"
+#include "settings_http.h"
+#include "dns_captive.h"
+#include "wifi_scan.h"
+#include "wifi_cache.h"
+#include "wifi_ps.h"
 
 extern USBDeviceClass USBDevice; //USBCore.cpp
 
@@ -112,10 +189,37 @@ extern USBDeviceClass USBDevice; //USBCore.cpp
 // PlatformIO: Forward declarations for WiFi functions
 unsigned int wifi_start_ap(void);
 unsigned int wifi_start(void);
+void wifi_power_save(void);
+static bool wifi_ap_mode(int status);
+uint16_t scd4x_start(void);
+uint8_t scd4x_get_variant(void);
+void power_profile(bool restart);
 
 // PlatformIO: Forward declarations for helper functions
 void get_chip_id(char *buffer, size_t buffer_size);
 void get_device_id(char *buffer, size_t buffer_size);
+void ampel(unsigned int co2);
+uint8_t ampel_band(unsigned int co2);
+
+//Alarmmuster (Frequenz Hz, Tastgrad %, Dauer ms), laufen in Schleife
+static const buzzer_step_t muster_langsam[] = { {BUZZER_FREQ, 50, 1000}, {0, 0, 1000} };
+static const buzzer_step_t muster_kurz[]    = { {BUZZER_FREQ, 50, 100},  {0, 0, 9900} };
+static const buzzer_step_t muster_doppel[]  = { {BUZZER_FREQ, 50, 100},  {0, 0, 100}, {BUZZER_FREQ, 50, 100}, {0, 0, 9700} };
+static const buzzer_step_t muster_dauer[]   = { {BUZZER_FREQ, 50, 0} };
+typedef struct
+{
+  const buzzer_step_t *steps;
+  uint8_t count;
+} BUZZER_PATTERN;
+static const BUZZER_PATTERN buzzer_patterns[] =
+{
+  { NULL,           0 }, //0: aus
+  { muster_langsam, 2 }, //1: 1s an/1s aus
+  { muster_kurz,    2 }, //2: kurzer Piep alle 10s
+  { muster_doppel,  4 }, //3: Doppelpiep alle 10s
+  { muster_dauer,   1 }, //4: Dauerton
+};
+#define BUZZER_PATTERNS (sizeof(buzzer_patterns) / sizeof(buzzer_patterns[0]))
 
 typedef struct
 {
@@ -140,55 +244,107 @@ typedef struct
   uint32_t color_t3;        // Color for range[1] <= CO2 < range[2] (warning)
   uint32_t color_t4;           // Color for CO2 >= range[2] (alert)
   boolean serial_output;      // Enable serial measurement output
+  uint8_t buzzer_pattern[3];  // Alarm pattern for CO2 >= range[2], range[3], range[4]
+  uint16_t light_dark;        // Light sensor: dark below this value
+  uint16_t light_bright;      // Light sensor: bright again above this value
+  uint16_t light_interval;    // Light sensor sample interval in s
+  uint8_t power_profile;      // PROFIL_NORMAL, PROFIL_LOW_POWER, PROFIL_SINGLE_SHOT
+  uint16_t power_interval;    // Measurement interval in s (single shot, SCD30 low power)
+  uint32_t wifi_ip;           // Static IP (CFG_IP), 0.0.0.0 = DHCP
+  uint32_t wifi_gateway;
+  uint32_t wifi_subnet;
+  uint32_t wifi_dns;
+  uint8_t wifi_power;         // 0 = by power profile, 1 = off, 2 = automatic, 3 = deep automatic
+  uint8_t wifi_listen;        // Listen interval in beacons (deep power-save)
+  boolean web_settings;       // Allow POST on /settings and /api/settings
 } SETTINGS;
 
 // PlatformIO: Forward declarations for settings and MQTT functions
-void settings_read(SETTINGS *data);
+uint8_t settings_load(SETTINGS *data);
 void settings_write(const SETTINGS *data);
+uint32_t settings_crc(const void *data, size_t len);
 void mqtt_connect(void);
 void mqtt_reconnect(void);
 void mqtt_service(void);
 void mqtt_publish_sensors(void);
+static uint32_t mqtt_next_ms(void);
 
 SETTINGS settings;
 static bool apply_brightness(void *user, const cfg_item_t *item);
+static bool apply_light(void *user, const cfg_item_t *item);
+static bool apply_power(void *user, const cfg_item_t *item);
+static bool apply_wifi_power(void *user, const cfg_item_t *item);
 static bool on_save_settings(void *user);
-static const cfg_item_t settings_items[] =
-{
-  { "sys.serial_output", CFG_BOOL, &settings.serial_output, 0, 0, 0, NULL },
-  { "sys.brightness",   CFG_U32,   &settings.brightness,     0, 255, 0, apply_brightness },
-  { "sys.buzzer",       CFG_U32,   &settings.buzzer,         0, 1,   0, NULL },
-  { "co2.t1",           CFG_U32,   &settings.range[0],       400, 10000, 0, NULL },
-  { "co2.t2",           CFG_U32,   &settings.range[1],       400, 10000, 0, NULL },
-  { "co2.t3",           CFG_U32,   &settings.range[2],       400, 10000, 0, NULL },
-  { "co2.t4",           CFG_U32,   &settings.range[3],       400, 10000, 0, NULL },
-  { "co2.t5",           CFG_U32,   &settings.range[4],       400, 10000, 0, NULL },
-  { "led.color.t1",     CFG_COLOR, &settings.color_t1,       0, 0xFFFFFF, 0, NULL },
-  { "led.color.t2",     CFG_COLOR, &settings.color_t2,       0, 0xFFFFFF, 0, NULL },
-  { "led.color.t3",     CFG_COLOR, &settings.color_t3,       0, 0xFFFFFF, 0, NULL },
-  { "led.color.t4",     CFG_COLOR, &settings.color_t4,       0, 0xFFFFFF, 0, NULL },
-  { "wifi.ssid",        CFG_STRING, settings.wifi_ssid,      0, 0, sizeof(settings.wifi_ssid) - 1, NULL },
-  { "wifi.pass",        CFG_STRING, settings.wifi_code,      0, 0, sizeof(settings.wifi_code) - 1, NULL },
-  { "mqtt.enabled",     CFG_BOOL,  &settings.mqtt_enabled,   0, 0, 0, NULL },
-  { "mqtt.broker",      CFG_STRING, settings.mqtt_broker,    0, 0, sizeof(settings.mqtt_broker) - 1, NULL },
-  { "mqtt.port",        CFG_U32,   &settings.mqtt_port,      1, 65535, 0, NULL },
-  { "mqtt.user",        CFG_STRING, settings.mqtt_user,      0, 0, sizeof(settings.mqtt_user) - 1, NULL },
-  { "mqtt.pass",        CFG_STRING, settings.mqtt_pass,      0, 0, sizeof(settings.mqtt_pass) - 1, NULL },
-  { "mqtt.client_id",   CFG_STRING, settings.mqtt_client_id, 0, 0, sizeof(settings.mqtt_client_id) - 1, NULL },
-  { "mqtt.topic_prefix",CFG_STRING, settings.mqtt_topic_prefix, 0, 0, sizeof(settings.mqtt_topic_prefix) - 1, NULL },
-  { "mqtt.interval",    CFG_U32,   &settings.mqtt_interval,  10, 3600, 0, NULL },
+static const char *validate_settings(void *user, const void *staged);
+// Settings: key table, defaults and range check from SETTINGS_SCHEMA (settings_schema.h).
+#define ITEM_NUM(key, type, field, min, max, def, apply) { key, type, &settings.field, min, max, 0, apply },
+#define ITEM_BOOL(key, field, def, apply)                { key, CFG_BOOL, &settings.field, 0, 0, 0, apply },
+#define ITEM_STR(key, field, def, apply)                 { key, CFG_STRING, settings.field, 0, 0, sizeof(settings.field) - 1, apply },
+#define ITEM_IP(key, field, def, apply)                  { key, CFG_IP, &settings.field, 0, 0, 0, apply },
+static constexpr cfg_item_t settings_items[] =
+{
+  SETTINGS_SCHEMA(ITEM_NUM, ITEM_BOOL, ITEM_STR, ITEM_IP)
 };
-static const size_t settings_items_count = sizeof(settings_items) / sizeof(settings_items[0]);
-// Settings stored at high address in flash
+static constexpr size_t settings_items_count = sizeof(settings_items) / sizeof(settings_items[0]);
+static_assert(cfg_keys_sorted(settings_items, 0, settings_items_count), "settings_items must be sorted by key, without duplicates");
+static SETTINGS settings_stage; //Zwischenspeicher fuer begin/commit
+static serial_settings_tx_t settings_tx = { &settings, &settings_stage, sizeof(SETTINGS), validate_settings, false };
+#define ITEM_DEF_NUM(key, type, field, min, max, def, apply) s->field = def;
+#define ITEM_DEF_BOOL(key, field, def, apply)                s->field = def;
+#define ITEM_DEF_STR(key, field, def, apply)                 strncpy(s->field, def, sizeof(s->field) - 1);
+#define ITEM_DEF_IP(key, field, def, apply)                  s->field = def;
+#define ITEM_CHECK_NUM(key, type, field, min, max, def, apply) \
+  if(((uint32_t)s->field < (uint32_t)(min)) || ((uint32_t)s->field > (uint32_t)(max))) { s->field = def; }
+#define ITEM_CHECK_BOOL(key, field, def, apply) \
+  if(*(const uint8_t *)&s->field > 1) { s->field = def; }
+#define ITEM_CHECK_STR(key, field, def, apply) \
+  s->field[sizeof(s->field) - 1] = 0;
+#define ITEM_CHECK_IP(key, field, def, apply) //jede Adresse gueltig
+
+// Settings image in flash: header + SETTINGS, CRC-32 over SETTINGS.
+// Version 1 is the raw SETTINGS struct written before the header existed.
+// Fields appended at the end of SETTINGS keep the version: the header size
+// limits the copy, the appended fields stay zero and settings_check() sets
+// them to the default if 0 is outside their range (so 0 must be either a
+// sensible value, like 0.0.0.0 = DHCP for the CFG_IP keys, or invalid).
+// Any other change of the layout needs a new SETTINGS_VERSION and a step in
+// settings_migrations[] that converts the previous version in place.
 // WARNING: Settings will be lost on firmware upload (bootloader erases entire app area)
 // Recommended: Export settings via serial before updating firmware
 // Place at 0x3F800 (last 2KB of flash) - may survive small firmware updates
-#define SETTINGS_FLASH_ADDR ((const volatile SETTINGS*)0x0003F800)
+// The last row of these 2KB holds the band_store log (last displayed CO2 value),
+// the row in front of it the wifi_cache log (last WiFi connection).
+#define SETTINGS_AREA     (WIFI_CACHE_ADDR - 0x3F800UL) //1536 Bytes
+#define SETTINGS_MAGIC    0x31474643UL //"CFG1"
+#define SETTINGS_VERSION  2
+#define SETTINGS_V1_SIZE  offsetof(SETTINGS, buzzer_pattern) //Version 1 endet mit serial_output
+typedef struct
+{
+  uint32_t magic;
+  uint16_t version;
+  uint16_t size;    // sizeof(SETTINGS) of the writing firmware
+  uint32_t crc;
+  SETTINGS data;
+} SETTINGS_IMAGE;
+static_assert(sizeof(SETTINGS_IMAGE) <= SETTINGS_AREA, "settings image must fit in front of the wifi_cache row");
+static_assert(SETTINGS_V1_SIZE == 385, "the fields of version 1 must stay in front of buzzer_pattern");
+#define SETTINGS_FLASH_ADDR ((const volatile SETTINGS_IMAGE*)0x0003F800)
+enum SettingsLoad
+{
+  SETTINGS_OK=0,    //CRC ok, aktuelle Version
+  SETTINGS_MIGRATED, //aeltere Version uebernommen
+  SETTINGS_DEFAULTS  //Standardwerte
+};
+uint8_t settings_state=SETTINGS_DEFAULTS;
 SCD30 scd30;
 SensirionI2CScd4x scd4x;
 Adafruit_BMP280 bmp280(&Wire1);
 LPS22HBClass lps22(Wire1);
-Adafruit_NeoPixel ws2812 = Adafruit_NeoPixel(NUM_LEDS, PIN_WS2812, NEO_GRB + NEO_KHZ800);
+#if LED_DMA
+NeoPixelDMA ws2812(NUM_LEDS, PIN_WS2812, LED_TYP);
+#else
+Adafruit_NeoPixel ws2812 = Adafruit_NeoPixel(NUM_LEDS, PIN_WS2812, LED_TYP);
+#endif
 WiFiServer server(80); //Webserver Port 80
 WiFiClient mqttWifiClient;
 MQTTClient mqttClient(256); //256 Byte Buffer
@@ -196,6 +352,37 @@ MQTTClient mqttClient(256); //256 Byte Buffer
 unsigned int features=0, remote_on=0, buzzer_timer=BUZZER_DELAY;
 unsigned int co2_value=STARTWERT, co2_average=STARTWERT, light_value=1024;
 float temp_value=20, temp_offset=TEMP_OFFSET, humi_value=50, pres_value=1013, pres_last=1013, temp2_value=20;
+uint8_t scd4x_variant=SCD4X_UNBEKANNT; //SCD40, SCD41, ... (Single-Shot nicht auf dem SCD40)
+uint64_t sample_ms=0; //Zeitpunkt des letzten Messwerts (rtc_clock_mono_ms)
+uint8_t band_saved=0xFF; //im Flash gesicherte Ampelstufe (band_store), 0xFF = keine
+wifi_cache_t wifi_conn; //aktuelle WiFi-Verbindung (AP, Adresse), wie in wifi_cache gespeichert
+unsigned long wifi_connect_ms=0; //Dauer des letzten Verbindungsaufbaus
+bool wifi_connect_fast=false; //mit gespeichertem Profil verbunden
+uint64_t mqtt_last_publish=0; //Zeitpunkt des letzten MQTT-Publish (rtc_clock_mono_ms)
+
+static bool serial_text(void) //Textausgaben auf USB, nicht im Binaerprotokoll (wuerden Frames zerstoeren)
+{
+  return (features & FEATURE_USB) && !binproto_active();
+}
+
+//Startablauf: setup() zeigt die letzte Ampelstufe und startet die Sensoren,
+//WiFi und MQTT verbinden danach schrittweise in loop() (boot_service)
+enum BootState
+{
+  BOOT_WINC=0, //WINC1500 pruefen
+  BOOT_WIFI,   //WiFi verbinden
+  BOOT_MQTT,   //MQTT verbinden
+  BOOT_CO2,    //auf ersten Messwert warten
+  BOOT_FERTIG
+};
+#define BOOT_PHASEN 10
+typedef struct
+{
+  const char *name;
+  uint32_t ms; //millis() am Ende der Phase
+} BOOT_PHASE;
+BOOT_PHASE boot_phases[BOOT_PHASEN];
+uint8_t boot_state=BOOT_WINC, boot_count=0;
 
 static void print_ip_address_line(const IPAddress &ip)
 {
@@ -211,7 +398,11 @@ static void print_ip_address_line(const IPAddress &ip)
 
 void leds(uint32_t color)
 {
-  ws2812.fill(color, 0, NUM_LEDS);
+  led_anim_show(color); //sofort anzeigen, laufende Animation beenden
+}
+
+static void ws2812_show(void) //fuer led_anim: show() ist nicht virtuell, NeoPixelDMA::show() nur ueber ws2812
+{
   ws2812.show();
 }
 
@@ -219,8 +410,44 @@ static bool apply_brightness(void *user, const cfg_item_t *item)
 {
   (void)user;
   (void)item;
-  ws2812.setBrightness(settings.brightness);
-  ws2812.show();
+  led_anim_brightness(settings.brightness); //naechster Ticker-Takt zeigt das Bild neu an
+  return true;
+}
+
+static bool apply_light(void *user, const cfg_item_t *item)
+{
+  (void)user;
+  (void)item;
+  ambient_config(settings.light_dark, settings.light_bright, settings.light_interval);
+  return true;
+}
+
+static bool single_shot_ok(uint8_t profile) //Single-Shot gibt es nicht auf dem SCD40
+{
+  return (profile != PROFIL_SINGLE_SHOT) || !(features & FEATURE_SCD4X) || (scd4x_variant != SCD4X_SCD40);
+}
+
+static bool apply_power(void *user, const cfg_item_t *item)
+{
+  bool ok = single_shot_ok(settings.power_profile);
+  (void)user;
+  (void)item;
+  if(!ok) //einzelnes set ohne Transaktion
+  {
+    settings.power_profile = PROFIL_LOW_POWER;
+  }
+  power_profile(true);
+  return ok;
+}
+
+static bool apply_wifi_power(void *user, const cfg_item_t *item)
+{
+  (void)user;
+  (void)item;
+  if((features & FEATURE_WINC1500) && (WiFi.status() == WL_CONNECTED))
+  {
+    wifi_power_save(); //Listen-Intervall erst ab der naechsten Verbindung
+  }
   return true;
 }
 
@@ -241,9 +468,40 @@ static void print_measurements(void)
     Serial.print("u: ");         //Temperatur
     Serial.println(temp2_value); //Wert in °C
   }
+  Serial.print("s: ");           //Zeitstempel
+  Serial.println(rtc_clock_to_utc(sample_ms)); //Unix-Zeit UTC, 0 = keine Uhrzeit
   Serial.println();
 }
 
+static void print_http_status(void)
+{
+  httpd_stats_t st;
+
+  httpd_get_stats(&st);
+  Serial.print("HTTP: ");
+  Serial.print(st.open);
+  Serial.print(" open (");
+  Serial.print(st.streams);
+  Serial.print(" /events), ");
+  Serial.print(st.conns);
+  Serial.print(" connections, ");
+  Serial.print(st.reqs);
+  Serial.print(" requests");
+  if(st.conns > 0)
+  {
+    Serial.print(" (");
+    Serial.print((float)st.reqs / st.conns, 1);
+    Serial.print(" per connection)");
+  }
+  Serial.print(", ");
+  Serial.print(st.timeouts);
+  Serial.print(" timeouts, ");
+  Serial.print(st.evicted);
+  Serial.print(" evicted, ");
+  Serial.print(st.rejected);
+  Serial.println(" rejected");
+}
+
 static void print_wifi_status(void)
 {
   if(features & FEATURE_WINC1500)
@@ -262,9 +520,31 @@ static void print_wifi_status(void)
         Serial.println(WiFi.SSID());
         Serial.print("IP Address: ");
         print_ip_address_line(WiFi.localIP());
+        Serial.print("IP Config: ");
+        Serial.println((settings.wifi_ip != 0) ? "static" : "DHCP");
+        {
+          const uint8_t *b = wifi_conn.bssid;
+          char bssid[18];
+          sprintf(bssid, "%02X:%02X:%02X:%02X:%02X:%02X", b[5], b[4], b[3], b[2], b[1], b[0]);
+          Serial.print("BSSID: ");
+          Serial.println(bssid);
+        }
+        Serial.print("Connect Time: ");
+        Serial.print(wifi_connect_ms);
+        if(wifi_connect_fast)
+        {
+          Serial.print(" ms (fast, full scan ");
+          Serial.print(wifi_conn.connect_ms);
+          Serial.println(" ms)");
+        }
+        else
+        {
+          Serial.println(" ms (full scan)");
+        }
         Serial.print("Signal Strength: ");
         Serial.print(WiFi.RSSI());
         Serial.println(" dBm");
+        print_http_status();
         break;
       case WL_NO_SHIELD:
         Serial.println("No WiFi hardware");
@@ -288,10 +568,20 @@ static void print_wifi_status(void)
         Serial.println("Disconnected");
         break;
       case WL_AP_LISTENING:
+      case WL_AP_CONNECTED:
         Serial.print("Access Point Mode - SSID: ");
         Serial.println(WiFi.SSID());
         Serial.print("AP IP Address: ");
         print_ip_address_line(WiFi.localIP());
+        Serial.print("AP Clients: ");
+        Serial.println((status == WL_AP_CONNECTED) ? "connected" : "none");
+        Serial.print("DNS: ");
+        Serial.print(dns_captive_queries());
+        Serial.println(" queries answered");
+        Serial.print("Scan: ");
+        Serial.print(wifi_scan_count());
+        Serial.println(" networks");
+        print_http_status();
         break;
       default:
         Serial.print("Unknown (");
@@ -348,6 +638,278 @@ static void print_mqtt_status(void)
   }
 }
 
+static void print_button_status(void)
+{
+  button_stats_t stats;
+
+  button_get_stats(&stats);
+  Serial.print("Button Events: ");
+  Serial.print(stats.events);
+  Serial.print(" (dropped ");
+  Serial.print(stats.dropped);
+  Serial.println(")");
+  Serial.print("Button Latency: ");
+  Serial.print(stats.latency_avg_us);
+  Serial.print("us avg, ");
+  Serial.print(stats.latency_max_us);
+  Serial.println("us max");
+  Serial.print("Button Queue Wait: ");
+  Serial.print(stats.wait_max_ms);
+  Serial.println("ms max");
+}
+
+static void print_boot_status(void)
+{
+  Serial.print("Boot:");
+  for(uint8_t i=0; i<boot_count; i++)
+  {
+    Serial.print((i == 0) ? " " : ", ");
+    Serial.print(boot_phases[i].name);
+    Serial.print(" ");
+    Serial.print(boot_phases[i].ms);
+    Serial.print("ms");
+  }
+  Serial.println((boot_state == BOOT_FERTIG) ? "" : " (running)");
+}
+
+static void print_banner(void)
+{
+  Serial.println("\nCO2 Ampel Pro NG v" VERSION);
+  Serial.print("Settings: v");
+  Serial.print(SETTINGS_VERSION);
+  if(settings_state == SETTINGS_OK)            { Serial.println(", CRC ok"); }
+  else if(settings_state == SETTINGS_MIGRATED) { Serial.println(", migrated"); }
+  else                                         { Serial.println(", defaults"); }
+  Serial.print("Features:");
+  if(features & FEATURE_SCD30)    { Serial.print(" SCD30"); }
+  if(features & FEATURE_SCD4X)
+  {
+    if(scd4x_variant == SCD4X_SCD40)      { Serial.print(" SCD4X (SCD40)"); }
+    else if(scd4x_variant == SCD4X_SCD41) { Serial.print(" SCD4X (SCD41)"); }
+    else                                  { Serial.print(" SCD4X"); }
+  }
+  if(features & FEATURE_LPS22HB)  { Serial.print(" LPS22HB"); }
+  if(features & FEATURE_BMP280)   { Serial.print(" BMP280"); }
+  if(features & FEATURE_WINC1500) { Serial.print(" WINC1500"); }
+  #if LED_DMA
+  if(ws2812.isDMA())              { Serial.print(" WS2812-DMA"); }
+  #endif
+  Serial.println();
+  print_boot_status();
+  Serial.println();
+}
+
+static void print_time_status(void)
+{
+  rtc_clock_stats_t stats;
+  uint32_t utc = rtc_clock_utc();
+
+  rtc_clock_get_stats(&stats);
+  Serial.print("Uptime: ");
+  Serial.print((uint32_t)(rtc_clock_mono_ms() / 1000));
+  Serial.println("s");
+  Serial.print("Time: ");
+  if(utc == 0)
+  {
+    Serial.println("not synced");
+    return;
+  }
+  time_t t = utc;
+  struct tm tm;
+  char buf[32];
+  gmtime_r(&t, &tm);
+  strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S UTC", &tm);
+  Serial.println(buf);
+  Serial.print("Time Sync: ");
+  Serial.print(stats.age_s);
+  Serial.print("s ago, ");
+  Serial.print(stats.syncs);
+  Serial.print(" syncs, drift ");
+  Serial.print(stats.drift_ppm);
+  Serial.print("ppm, last step ");
+  Serial.print(stats.last_step_ms);
+  Serial.println("ms");
+}
+
+static uint32_t winc_current(const wifi_ps_stats_t *ps) //mittlerer Strom des WINC1500 in uA nach Zeit je Power-Save-Modus
+{
+  uint32_t total = ps->awake_ms + ps->light_ms + ps->sleep_ms;
+  uint32_t sleep_ua;
+
+  if(total == 0)
+  {
+    return 0; //nicht verbunden
+  }
+  sleep_ua = (ps->mode == WIFI_PS_DEEP) ? (STROM_WINC_DOZE + ((STROM_WINC_MAXPS - STROM_WINC_DOZE) / ps->listen)) :
+             (ps->mode == WIFI_PS_AUTO) ? STROM_WINC_PS : STROM_WINC;
+  return (((uint64_t)ps->awake_ms * STROM_WINC) + ((uint64_t)ps->light_ms * STROM_WINC_PS) +
+          ((uint64_t)ps->sleep_ms * sleep_ua)) / total;
+}
+
+static void print_power_status(void)
+{
+  power_stats_t stats;
+  wifi_ps_stats_t ps;
+  uint32_t total, active, ua, winc_ua, ref_ua;
+
+  power_get_stats(&stats);
+  wifi_ps_get_stats(&ps);
+  total = stats.active_ms + stats.standby_ms;
+  active = (total > 0) ? (((uint64_t)stats.active_ms * 1000) / total) : 1000; //Promille
+
+  //MCU anteilig, Sensor und WiFi nach Profil
+  ua = ((STROM_MCU_AKTIV * active) + (STROM_MCU_STANDBY * (1000 - active))) / 1000;
+  if(features & FEATURE_SCD30)
+  {
+    ua += STROM_SCD30;
+  }
+  else if(features & FEATURE_SCD4X)
+  {
+    if(settings.power_profile == PROFIL_SINGLE_SHOT)
+    {
+      ua += STROM_SCD41_IDLE + (STROM_SCD41_SHOT / settings.power_interval);
+    }
+    else
+    {
+      ua += (settings.power_profile == PROFIL_LOW_POWER) ? STROM_SCD4X_LP : STROM_SCD4X;
+    }
+  }
+  ref_ua = ua + STROM_WINC; //WiFi immer wach: Zustand, fuer den TEMP_OFFSET ermittelt wurde
+  winc_ua = (features & FEATURE_WINC1500) ? winc_current(&ps) : 0;
+  ua += winc_ua;
+
+  Serial.print("Power Profile: ");
+  Serial.println(settings.power_profile);
+  Serial.print("Power Active: ");
+  Serial.print(active / 10);
+  Serial.print(".");
+  Serial.print(active % 10);
+  Serial.print("% (");
+  Serial.print(stats.wakeups);
+  Serial.println(" wakeups)");
+  Serial.print("Power Current: ");
+  Serial.print(ua / 1000.0f, 1);
+  Serial.println("mA (estimated, without LEDs)");
+  if(features & FEATURE_WINC1500)
+  {
+    uint32_t ps_total = ps.awake_ms + ps.light_ms + ps.sleep_ms;
+    Serial.print("WiFi Power-Save: ");
+    Serial.print((ps.mode == WIFI_PS_DEEP) ? "deep" : (ps.mode == WIFI_PS_AUTO) ? "automatic" : "off");
+    Serial.print(", listen ");
+    Serial.print(ps.listen);
+    if(ps_total > 0)
+    {
+      Serial.print(", awake ");
+      Serial.print((ps.awake_ms * 100.0f) / ps_total, 1);
+      Serial.print("%, light ");
+      Serial.print((ps.light_ms * 100.0f) / ps_total, 1);
+      Serial.print("%, sleep ");
+      Serial.print((ps.sleep_ms * 100.0f) / ps_total, 1);
+      Serial.print("%, ");
+      Serial.print(ps.switches);
+      Serial.print(" switches, ");
+      Serial.print(winc_ua / 1000.0f, 1);
+      Serial.print("mA");
+    }
+    Serial.println();
+    //Eigenerwaermung ~ Leistung: TEMP_OFFSET gilt fuer dauernd wachen WINC1500
+    Serial.print("Temp Offset: ");
+    Serial.print(temp_offset, 1);
+    Serial.print("C set, ");
+    Serial.print((temp_offset * ua) / ref_ua, 1);
+    Serial.print("C estimated at ");
+    Serial.print(ua / 1000.0f, 1);
+    Serial.print("mA (");
+    Serial.print(((temp_offset * ua) / ref_ua) - temp_offset, 1);
+    Serial.println("C)");
+  }
+}
+
+//bekannte I2C-Geraete, Namen fuer die Ausgabe des Bus-Scans
+typedef struct
+{
+  uint8_t bus;
+  uint8_t addr;
+  const char *name;
+} I2C_DEVICE;
+static const I2C_DEVICE i2c_devices[] =
+{
+  { I2C_BUS0, ADDR_SCD30,    "SCD30" },
+  { I2C_BUS0, ADDR_SCD4X,    "SCD4X" },
+  { I2C_BUS1, ADDR_LPS22HB,  "LPS22HB" },
+  { I2C_BUS1, ADDR_ATECC608, "ATECC608" },
+  { I2C_BUS1, ADDR_BMP280,   "BMP280" },
+  { I2C_BUS1, ADDR_BMP280+1, "BMP280" },
+};
+
+static void print_i2c_scan(uint8_t bus)
+{
+  const i2c_scan_t *scan = i2c_scan_result(bus);
+
+  Serial.print("I2C");
+  Serial.print(bus);
+  Serial.print(" Scan:");
+  for(uint8_t addr = I2C_SCAN_FIRST; addr <= I2C_SCAN_LAST; addr++)
+  {
+    if(!i2c_scan_found(bus, addr))
+    {
+      continue;
+    }
+    Serial.print(" 0x");
+    Serial.print(addr, HEX);
+    for(size_t i = 0; i < sizeof(i2c_devices)/sizeof(i2c_devices[0]); i++)
+    {
+      if((i2c_devices[i].bus == bus) && (i2c_devices[i].addr == addr))
+      {
+        Serial.print(" ");
+        Serial.print(i2c_devices[i].name);
+        break;
+      }
+    }
+    Serial.print(",");
+  }
+  Serial.print(" ");
+  Serial.print(scan->count);
+  Serial.print(" devices, ");
+  Serial.print(scan->errors);
+  Serial.print(" errors, ");
+  Serial.print(scan->time_us);
+  Serial.println("us");
+}
+
+static void print_i2c_status(void)
+{
+  i2c_async_stats_t stats;
+
+  for(uint8_t bus = 0; bus < I2C_BUSES; bus++)
+  {
+    print_i2c_scan(bus);
+    i2c_async_get_stats(bus, &stats);
+    Serial.print("I2C");
+    Serial.print(bus);
+    Serial.print(": ");
+    Serial.print(stats.txns);
+    Serial.print(" txns, ");
+    Serial.print(stats.errors);
+    Serial.print(" errors, ");
+    Serial.print(stats.latency_avg_us);
+    Serial.print("us avg, ");
+    Serial.print(stats.latency_max_us);
+    Serial.print("us max, ");
+    Serial.print(stats.utilization);
+    Serial.println("% busy");
+  }
+  sensor_async_stats_t sensor;
+  sensor_async_get_stats(&sensor);
+  Serial.print("Sensor Reads: ");
+  Serial.print(sensor.samples);
+  Serial.print(" samples, ");
+  Serial.print(sensor.checks);
+  Serial.print(" data-ready checks, ");
+  Serial.print(sensor.errors);
+  Serial.println(" errors");
+}
+
 static bool on_save_settings(void *user)
 {
   (void)user;
@@ -356,6 +918,32 @@ static bool on_save_settings(void *user)
   return true;
 }
 
+// Cross-key checks before a commit; single set commands are not checked
+// because a dump restores the keys one by one in any order.
+static const char *validate_ranges(const SETTINGS *s)
+{
+  for(uint8_t i = 1; i < 5; i++)
+  {
+    if(s->range[i] <= s->range[i-1])
+    {
+      return "co2.t1 < co2.t2 < co2.t3 < co2.t4 < co2.t5 required";
+    }
+  }
+  return NULL;
+}
+
+static const char *validate_settings(void *user, const void *staged)
+{
+  const SETTINGS *s = (const SETTINGS *)staged;
+  (void)user;
+
+  if(!single_shot_ok(s->power_profile))
+  {
+    return "power.profile 2 (single shot) requires an SCD41";
+  }
+  return validate_ranges(s);
+}
+
 
 void status_led(unsigned int on)
 {
@@ -380,48 +968,46 @@ void status_led(unsigned int on)
 }
 
 
-void buzzer(unsigned int on)
+void buzzer(unsigned int on) //kehrt sofort zurueck, Ton laeuft im Ticker
 {
-  if(on == 0)
-  {
-    analogWrite(PIN_BUZZER, 0); //Buzzer aus
-  }
-  else if(on == 1)
+  buzzer_seq_stop(); //Buzzer aus
+  if(on == 1)
   {
-    analogWrite(PIN_BUZZER, 255/2); //Buzzer an
+    buzzer_seq_add(BUZZER_FREQ, 50, 0); //Buzzer an
   }
-  else if(on < 2000)
+  else if((on >= 2) && (on < 2000))
   {
-    analogWrite(PIN_BUZZER, 255/2); //Buzzer an
-    delay(on); //ms warten
-    analogWrite(PIN_BUZZER, 0); //Buzzer aus
+    buzzer_seq_add(BUZZER_FREQ, 50, on); //Buzzer fuer on ms an
   }
 
   return;
 }
 
 
-unsigned int light_sensor(void) //Auslesen des Lichtsensors
+void buzzer_pattern(unsigned int pattern) //Alarmmuster starten (0 = aus)
 {
-  unsigned int i;
-  uint32_t color = ws2812.getPixelColor(0); //aktuelle Farbe speichern
+  static unsigned int current=0;
 
-  //ws2812.setPixelColor(2, FARBE_AUS); //LED 3 aus
-  ws2812.fill(COLOR_OFF, 0, 4); //alle 4 LEDs aus
-  ws2812.show();
-
-  digitalWrite(PIN_LSENSOR_PWR, HIGH); //Lichtsensor an
-  delay(40); //40ms warten
-  i = analogRead(PIN_LSENSOR); //0...1024
-  delay(10); //10ms warten
-  i += analogRead(PIN_LSENSOR); //0...1024
-  i /= 2;
-  digitalWrite(PIN_LSENSOR_PWR, LOW); //Lichtsensor aus
+  if(pattern >= BUZZER_PATTERNS)
+  {
+    pattern = 0;
+  }
+  if((pattern == current) && ((pattern == 0) || buzzer_seq_busy()))
+  {
+    return; //laeuft bereits
+  }
+  current = pattern;
 
-  //ws2812.setPixelColor(2, color); //LED 3 an
-  leds(color);
+  if(pattern == 0)
+  {
+    buzzer_seq_stop();
+  }
+  else
+  {
+    buzzer_seq_play(buzzer_patterns[pattern].steps, buzzer_patterns[pattern].count, true);
+  }
 
-  return i;
+  return;
 }
 
 
@@ -449,80 +1035,368 @@ float pres_sensor(void)
 }
 
 
-unsigned int check_sensors(void) //Sensoren auslesen
+void pressure_compensation(void) //Luftdruck gefiltert an CO2-Sensor uebergeben
 {
-  if(features & FEATURE_SCD30)
+  static float pres_filter=0;
+
+  if((features & (FEATURE_LPS22HB|FEATURE_BMP280)) == 0)
+  {
+    return;
+  }
+
+  if(pres_filter == 0)
+  {
+    pres_filter = pres_value;
+  }
+  else
+  {
+    pres_filter += (pres_value - pres_filter) / DRUCK_FILTER; //Tiefpass
+  }
+
+  if((pres_filter < (pres_last-DRUCK_DIFF)) || (pres_filter > (pres_last+DRUCK_DIFF)))
+  {
+    pres_last = pres_filter;
+    if(features & FEATURE_SCD30)
+    {
+      i2c_async_lock(I2C_BUS0);
+      scd30.setAmbientPressure(pres_last); //hPa=mBar
+      i2c_async_unlock(I2C_BUS0);
+    }
+    else if(features & FEATURE_SCD4X)
+    {
+      scd4x_cmd_set_ambient_pressure(pres_last + 0.5f); //hPa=mBar, laeuft ohne Stopp der Messung
+    }
+  }
+
+  return;
+}
+
+
+uint16_t scd4x_start(void) //Messung je nach Stromsparprofil starten, Sensor muss im Idle sein (0=okay)
+{
+  if(settings.power_profile == PROFIL_SINGLE_SHOT) //nur SCD41, Sensor bleibt zwischen den Messungen im Idle
+  {
+    return 0;
+  }
+  else if(settings.power_profile == PROFIL_LOW_POWER)
   {
-    if(scd30.dataAvailable())
+    return scd4x.startLowPowerPeriodicMeasurement();
+  }
+  return scd4x.startPeriodicMeasurement();
+}
+
+
+uint8_t scd4x_get_variant(void) //get_sensor_variant (0x202F), nur im Idle
+{
+  uint8_t buf[3];
+
+  Wire.beginTransmission(ADDR_SCD4X);
+  Wire.write(0x20);
+  Wire.write(0x2F);
+  if(Wire.endTransmission() != 0) //NACK: aeltere Firmware kennt den Befehl nicht
+  {
+    return SCD4X_UNBEKANNT;
+  }
+  delay(1); //Ausfuehrungszeit 1ms
+  if(Wire.requestFrom(ADDR_SCD4X, 3) != 3)
+  {
+    return SCD4X_UNBEKANNT;
+  }
+  for(uint8_t i=0; i < 3; i++)
+  {
+    buf[i] = Wire.read();
+  }
+  if(sensirion_crc8(buf) != buf[2])
+  {
+    return SCD4X_UNBEKANNT;
+  }
+  return buf[0] >> 4;
+}
+
+
+void power_profile(bool restart) //Stromsparprofil an CO2-Sensor, WiFi und MCU uebergeben
+{
+  uint16_t interval = (features & FEATURE_SCD4X) ? INTERVALL_SCD4X : INTERVALL;
+  bool single = false;
+
+  i2c_async_lock(I2C_BUS0);
+  if(features & FEATURE_SCD4X)
+  {
+    if(restart) //beim Start laeuft der SCD4X schon im Modus des Profils (scd4x_start)
     {
-      co2_value  = scd30.getCO2();
-      temp_value = scd30.getTemperature();
-      humi_value = scd30.getHumidity();
-      if(features & FEATURE_LPS22HB)
-      {
-        pres_value  = lps22.readPressure()*10; //kPa -> hPa
-        temp2_value = lps22.readTemperature()-temp_offset;
-      }
-      if(features & FEATURE_BMP280)
+      scd4x.stopPeriodicMeasurement();
+      delay(500);
+      scd4x_start();
+    }
+    if(settings.power_profile == PROFIL_SINGLE_SHOT)
+    {
+      interval = settings.power_interval;
+      single = true;
+    }
+    else if(settings.power_profile == PROFIL_LOW_POWER)
+    {
+      interval = INTERVALL_SCD4X_LP;
+    }
+  }
+  else if(features & FEATURE_SCD30)
+  {
+    if(settings.power_profile != PROFIL_NORMAL)
+    {
+      interval = (settings.power_interval > 1800) ? 1800 : settings.power_interval;
+    }
+    scd30.setMeasurementInterval(interval); //setze Messintervall
+  }
+  i2c_async_unlock(I2C_BUS0);
+  sensor_async_mode(interval, single);
+
+  if((features & FEATURE_WINC1500) && (WiFi.status() == WL_CONNECTED))
+  {
+    wifi_power_save();
+  }
+  if(settings.power_profile != PROFIL_NORMAL)
+  {
+    power_begin(); //RTC-Wakeup fuer Standby
+  }
+
+  return;
+}
+
+
+void power_save(uint64_t t_ampel) //MCU bis zum naechsten Ereignis in Standby
+{
+  uint32_t ms;
+  uint64_t elapsed;
+
+  if((settings.power_profile == PROFIL_NORMAL) || remote_on || USBDevice.connected())
+  {
+    return; //USB funktioniert im Standby nicht
+  }
+  if(!button_idle() || buzzer_seq_busy() || led_anim_busy() || ambient_busy() ||
+     !i2c_async_idle(I2C_BUS0) || !i2c_async_idle(I2C_BUS1))
+  {
+    return; //Ticker oder DMA noch aktiv
+  }
+  if((features & FEATURE_WINC1500) && wifi_ap_mode(WiFi.status()))
+  {
+    return;
+  }
+
+  elapsed = rtc_clock_mono_ms() - t_ampel;
+  ms = (elapsed < 1000) ? (uint32_t)(1000 - elapsed) : 0; //naechster Ampeltakt
+  if(sensor_async_idle_ms() < ms)
+  {
+    ms = sensor_async_idle_ms();
+  }
+  power_standby(ms); //Taster und WINC1500-Interrupt wecken vorzeitig
+
+  return;
+}
+
+
+void time_sync(void) //Uhrzeit per SNTP (WINC1500) abgleichen, die Drift korrigiert rtc_clock
+{
+  static uint64_t t_try=0;
+  rtc_clock_stats_t stats;
+  uint64_t now = rtc_clock_mono_ms();
+  uint32_t utc;
+
+  if(((features & FEATURE_WINC1500) == 0) || (WiFi.status() != WL_CONNECTED))
+  {
+    return; //die Uhr laeuft ohne WiFi weiter
+  }
+  rtc_clock_get_stats(&stats);
+  if((stats.age_s != RTC_CLOCK_UNSYNCED) && (stats.age_s < ZEIT_SYNC))
+  {
+    return;
+  }
+  if((t_try != 0) && ((now - t_try) < (ZEIT_RETRY*1000UL)))
+  {
+    return;
+  }
+  t_try = now;
+
+  utc = WiFi.getTime(); //0 solange der WINC1500 noch keine Zeit hat
+  if(utc >= ZEIT_MIN)
+  {
+    rtc_clock_sync(utc);
+    if(serial_text())
+    {
+      Serial.print("Time synced: ");
+      Serial.println(utc);
+    }
+  }
+
+  return;
+}
+
+
+void boot_mark(const char *name) //Ende einer Startphase merken (einmal je Phase)
+{
+  for(uint8_t i=0; i<boot_count; i++)
+  {
+    if(strcmp(boot_phases[i].name, name) == 0)
+    {
+      return;
+    }
+  }
+  if(boot_count < BOOT_PHASEN)
+  {
+    boot_phases[boot_count].name = name;
+    boot_phases[boot_count].ms = millis();
+    boot_count++;
+  }
+}
+
+
+void boot_service(void) //Startablauf nach setup(), ein Schritt je loop()-Durchlauf
+{
+  static bool banner=false;
+
+  switch(boot_state)
+  {
+    case BOOT_WINC:
+      if(WiFi.status() != WL_NO_SHIELD) //ATWINC1500 gefunden (Reset und Firmwarestart)
       {
-        pres_value  = bmp280.readPressure()/100; //Pa -> hPa
-        temp2_value = bmp280.readTemperature()-temp_offset;
+        features |= FEATURE_WINC1500;
+        WiFi.setTimeout(WIFI_TIMEOUT);
       }
-      if((pres_value < (pres_last-DRUCK_DIFF)) || (pres_value > (pres_last+DRUCK_DIFF)))
+      else
       {
-        pres_last = pres_value;
-        scd30.setAmbientPressure(pres_value); //hPa=mBar
+        WiFi.end();
       }
-      if(humi_value < 0)
+      boot_mark("winc");
+      boot_state = BOOT_WIFI;
+      break;
+
+    case BOOT_WIFI:
+      if(features & FEATURE_WINC1500)
       {
-        humi_value = 0;
+        if(wifi_start() != 0) //verbinde WiFi Netzwerk
+        {
+          if(wifi_start_ap() != 0) //starte AP
+          {
+            features &= ~FEATURE_WINC1500;
+          }
+        }
+        boot_mark("wifi");
+        time_sync(); //Uhrzeit per SNTP holen (sonst erneut im Sekundentakt)
+        if(serial_text())
+        {
+          String fv = WiFi.firmwareVersion();
+          Serial.print("WINC1500 Firmware: ");
+          Serial.println(fv);
+          byte mac[6];
+          WiFi.macAddress(mac);
+          Serial.print("MAC: ");
+          Serial.print(mac[5], HEX); Serial.print(":"); Serial.print(mac[4], HEX); Serial.print(":"); Serial.print(mac[3], HEX); Serial.print(":");
+          Serial.print(mac[2], HEX); Serial.print(":"); Serial.print(mac[1], HEX); Serial.print(":"); Serial.print(mac[0], HEX); Serial.println("");
+          IPAddress ip;
+          ip = WiFi.localIP();
+          Serial.print("IP: "); print_ip_address_line(ip);
+          ip = WiFi.subnetMask();
+          Serial.print("NM: "); print_ip_address_line(ip);
+          ip = WiFi.gatewayIP();
+          Serial.print("GW: "); print_ip_address_line(ip);
+          Serial.println("");
+        }
       }
-      else if(humi_value > 100)
+      boot_state = BOOT_MQTT;
+      break;
+
+    case BOOT_MQTT:
+      if((features & FEATURE_WINC1500) && settings.mqtt_enabled)
       {
-        humi_value = 100;
+        mqtt_connect();
+        boot_mark("mqtt");
       }
-      return 1;
-    }
-  }
-  else if(features & FEATURE_SCD4X)
-  {
-    uint16_t v_co2;
-    float v_temp;
-    float v_humi;
-    if(scd4x.readMeasurement(v_co2, v_temp, v_humi) == 0)
-    {
-      co2_value  = v_co2;
-      temp_value = v_temp;
-      humi_value = v_humi;
-      if(features & FEATURE_LPS22HB)
+      boot_state = BOOT_CO2;
+      if(USBDevice.connected())
       {
-        pres_value  = lps22.readPressure()*10; //kPa -> hPa
-        temp2_value = lps22.readTemperature()-temp_offset;
+        features |= FEATURE_USB;
       }
-      if(features & FEATURE_BMP280)
+      if(serial_text())
       {
-        pres_value  = bmp280.readPressure()/100; //Pa -> hPa
-        temp2_value = bmp280.readTemperature()-temp_offset;
+        print_banner(); //Startmeldung mit den bisherigen Startphasen
+        banner = true;
       }
-      if((pres_value < (pres_last-DRUCK_DIFF)) || (pres_value > (pres_last+DRUCK_DIFF)))
+      break;
+
+    case BOOT_CO2:
+      if((sample_ms == 0) && (features & (FEATURE_SCD30|FEATURE_SCD4X)))
       {
-        pres_last = pres_value;
-        scd4x.stopPeriodicMeasurement();
-        delay(1000);
-        scd4x.setAmbientPressure(pres_value); //hPa=mBar
-        delay(500);
-        scd4x.startPeriodicMeasurement();
+        break; //noch kein Messwert
       }
-      if(humi_value < 0)
+      boot_state = BOOT_FERTIG;
+      if(USBDevice.connected())
       {
-        humi_value = 0;
+        features |= FEATURE_USB;
       }
-      else if(humi_value > 100)
+      if(serial_text())
       {
-        humi_value = 100;
+        if(banner)
+        {
+          print_boot_status();
+        }
+        else
+        {
+          print_banner(); //USB erst nach dem Verbindungsaufbau erkannt
+        }
       }
-      return 1;
+      break;
+  }
+
+  return;
+}
+
+
+void store_sample(void) //Messwert im Verlauf speichern
+{
+  history_rec_t rec;
+
+  rec.mono_s = (uint32_t)(sample_ms / 1000);
+  rec.co2    = co2_value;
+  rec.temp   = (int16_t)(temp_value * 100);
+  rec.humi   = (uint16_t)(humi_value * 100);
+  rec.pres   = (features & (FEATURE_LPS22HB|FEATURE_BMP280)) ? (uint16_t)(pres_value * 10) : 0;
+  history_add(&rec);
+
+  return;
+}
+
+
+unsigned int check_sensors(void) //Sensoren auslesen
+{
+  co2_sample_t co2;
+  pres_sample_t pres;
+
+  if(features & FEATURE_SCD4X)
+  {
+    scd4x_cmd_service();
+  }
+  sensor_async_poll(); //startet Transfers im Hintergrund
+
+  if(sensor_async_co2(&co2))
+  {
+    sample_ms  = rtc_clock_mono_ms();
+    co2_value  = co2.co2;
+    temp_value = co2.temp;
+    humi_value = co2.humi;
+    if(sensor_async_pres(&pres))
+    {
+      pres_value  = pres.pres;
+      temp2_value = pres.temp-temp_offset;
+    }
+    pressure_compensation();
+    if(humi_value < 0)
+    {
+      humi_value = 0;
     }
+    else if(humi_value > 100)
+    {
+      humi_value = 100;
+    }
+    store_sample();
+    return 1;
   }
 
   return 0;
@@ -531,7 +1405,16 @@ unsigned int check_sensors(void) //Sensoren auslesen
 
 void show_data(void) //Daten anzeigen
 {
-  if((features & FEATURE_USB) && settings.serial_output)
+  if((features & FEATURE_USB) && settings.serial_output && binproto_active())
+  {
+    history_rec_t rec;
+    uint32_t seq = history_next() - 1;
+    if(history_get(seq, &rec))
+    {
+      binproto_sample(seq, &rec); //Messwert als Frame
+    }
+  }
+  else if((features & FEATURE_USB) && settings.serial_output)
   {
     Serial.print("c: ");           //CO2
     Serial.println(co2_value);     //Wert in ppm
@@ -548,6 +1431,8 @@ void show_data(void) //Daten anzeigen
       Serial.print("u: ");         //Temperatur
       Serial.println(temp2_value); //Wert in °C
     }
+    Serial.print("s: ");           //Zeitstempel
+    Serial.println(rtc_clock_to_utc(sample_ms)); //Unix-Zeit UTC, 0 = keine Uhrzeit
     Serial.println();
   }
 
@@ -555,29 +1440,25 @@ void show_data(void) //Daten anzeigen
 }
 
 
-void serial_service(void)
+void settings_ctx(serial_settings_ctx_t *ctx) //Kontext fuer Text- und Binaerprotokoll
 {
-  char line_buf[192];
-  size_t len;
+  ctx->user = NULL;
+  ctx->remote_on = (remote_on != 0);
+  ctx->out = &Serial;
+  ctx->on_save = on_save_settings;
+  ctx->tx = &settings_tx;
+}
 
-  if((features & FEATURE_USB) == 0)
-  {
-    return;
-  }
 
-  if(Serial.available() == 0)
-  {
-    return;
-  }
+static void web_settings_ctx(serial_settings_ctx_t *ctx) //Kontext fuer /settings, schreiben nur mit web.settings=1
+{
+  settings_ctx(ctx);
+  ctx->remote_on = settings.web_settings;
+}
 
-  len = Serial.readBytesUntil('\n', line_buf, sizeof(line_buf) - 1);
-  line_buf[len] = 0;
-  if(len > 0 && line_buf[len - 1] == '\r')
-  {
-    line_buf[len - 1] = 0;
-  }
 
-  char *line = line_buf;
+void serial_command(char *line) //eine empfangene Zeile ausfuehren
+{
   while(*line && isspace((unsigned char)*line))
   {
     line++;
@@ -591,8 +1472,9 @@ void serial_service(void)
   if(strcasecmp(line, "remote on") == 0)
   {
     remote_on = 1;
+    ambient_enable(false);
     buzzer(0);
-    ws2812.setBrightness(30);
+    led_anim_brightness(30);
     leds(COLOR_MENU);
     Serial.println("OK");
     return;
@@ -600,7 +1482,9 @@ void serial_service(void)
   if(strcasecmp(line, "remote off") == 0)
   {
     remote_on = 0;
-    ws2812.setBrightness(settings.brightness);
+    settings_tx.open = false; //offene Transaktion verwerfen
+    led_anim_brightness(settings.brightness);
+    ambient_enable(true);
     Serial.println("OK");
     return;
   }
@@ -612,8 +1496,13 @@ void serial_service(void)
   if(strcasecmp(line, "status") == 0)
   {
     print_measurements();
+    print_boot_status();
+    print_time_status();
     print_wifi_status();
     print_mqtt_status();
+    print_button_status();
+    print_i2c_status();
+    print_power_status();
     return;
   }
   if(strcasecmp(line, "reset") == 0)
@@ -630,11 +1519,15 @@ void serial_service(void)
     while(1);
   }
 
+  if(strcasecmp(line, "mode binary") == 0)
+  {
+    Serial.println("OK");
+    binproto_begin(&Serial); //weiter mit Frames (binframe.h)
+    return;
+  }
+
   serial_settings_ctx_t ctx;
-  ctx.user = NULL;
-  ctx.remote_on = (remote_on != 0);
-  ctx.out = &Serial;
-  ctx.on_save = on_save_settings;
+  settings_ctx(&ctx);
   if(serial_settings_handle_line(line, settings_items, settings_items_count, &ctx))
   {
     return;
@@ -644,52 +1537,391 @@ void serial_service(void)
 }
 
 
-void urldecode(char *src) //URL Parameter dekodieren
+void serial_service(void) //empfangene Zeichen sammeln, nur vollstaendige Zeilen ausfuehren
 {
-  char a, b, *dst = src;
+  static line_reader_t reader;
+  static bool reader_init=false;
+  char *line;
+
+  if((features & FEATURE_USB) == 0)
+  {
+    return;
+  }
+
+  if(!reader_init)
+  {
+    reader_init = true;
+    line_reader_init(&reader);
+  }
 
-  while(*src) 
+  if(binproto_active()) //Binaerprotokoll
   {
-    if((*src == '%') && ((a = src[1]) && (b = src[2])) && (isxdigit((uint8_t)a) && isxdigit((uint8_t)b))) 
+    if(!Serial.dtr()) //Port vom Host geschlossen: zurueck zu den Textbefehlen
     {
-      if (a >= 'a')
-        a -= 'a' - 'A';
+      binproto_end();
+      return;
+    }
+    serial_settings_ctx_t ctx;
+    settings_ctx(&ctx);
+    binproto_poll(&ctx, settings_items, settings_items_count);
+    return;
+  }
 
-      if (a >= 'A')
-        a -= 'A' - 10;
-      else
-        a -= '0';
+  for(uint8_t i=0; (i < SERIAL_ZEILEN) && !binproto_active(); i++) //begrenzt die Zeit pro Durchlauf
+  {
+    line_status_t st = line_reader_poll(&reader, &Serial, &line);
+    if(st == LINE_NONE)
+    {
+      break;
+    }
+    if(st == LINE_OVERFLOW)
+    {
+      Serial.println("ERROR: Line too long");
+      continue;
+    }
+    serial_command(line);
+  }
 
-      if (b >= 'a')
-        b -= 'a' - 'A';
+  return;
+}
 
-      if (b >= 'A')
-        b -= 'A' - 10;
-      else
-        b -= '0';
 
-      *dst++ = 16 * a + b;
-      src += 3;
+static uint8_t events_band(void) //Ampelstufe wie in loop() angezeigt
+{
+  #if AMPEL_DURCHSCHNITT > 0
+    return ampel_band(co2_average);
+  #else
+    return ampel_band(co2_value);
+  #endif
+}
+
+
+static int events_render(char *buf, size_t size, uint8_t band) //Event mit letztem Messwert und Ampelstufe
+{
+  int len=0;
+
+  if(history_next() != history_first()) //id = Sequenznummer im Verlauf
+  {
+    len = snprintf(buf, size, "id: %lu\n", (unsigned long)(history_next() - 1));
+  }
+  len += snprintf(buf+len, size-len,
+      "data: {\"c\":%i,\"t\":%.1f,\"h\":%.1f,",
+      co2_value, temp_value, humi_value
+  );
+  if(features & (FEATURE_LPS22HB|FEATURE_BMP280))
+  {
+    len += snprintf(buf+len, size-len, "\"p\":%.1f,", pres_value);
+  }
+  len += snprintf(buf+len, size-len,
+      "\"l\":%i,\"b\":%u,\"s\":%lu}\n\n",
+      light_value, band, (unsigned long)rtc_clock_to_utc(sample_ms)
+  );
+
+  return len;
+}
+
+
+void events_service(void) //Server-Sent Events: neuer Messwert oder neue Ampelstufe an alle /events-Clients
+{
+  static uint32_t seq_sent=0;
+  static uint8_t band_sent=0xFF;
+  static uint64_t t_sent=0;
+  static char buf[160]; //ein Event fuer alle Clients
+  uint8_t band = events_band();
+  uint32_t seq = history_next();
+
+  if(httpd_streams() == 0)
+  {
+    seq_sent = seq;
+    band_sent = band;
+    return;
+  }
+
+  if((seq != seq_sent) || (band != band_sent))
+  {
+    seq_sent = seq;
+    band_sent = band;
+    t_sent = rtc_clock_mono_ms();
+    httpd_broadcast(buf, events_render(buf, sizeof(buf), band));
+  }
+  else if((rtc_clock_mono_ms()-t_sent) > (EVENTS_PING*1000UL))
+  {
+    t_sent = rtc_clock_mono_ms();
+    httpd_broadcast(":\n\n", 3); //Kommentar, haelt Proxies offen
+  }
+
+  return;
+}
+
+
+static void web_events(httpd_conn_t *c, const httpd_req_t *req) //GET /events, Server-Sent Events
+{
+  char buf[160];
+
+  if(!httpd_stream(c))
+  {
+    httpd_respond(c, 503, "text/plain", "Retry-After: 10\r\n");
+    httpd_print(c, "503 Too many subscribers\r\n");
+    return;
+  }
+  httpd_respond(c, 200, "text/event-stream", "Cache-Control: no-cache\r\n");
+  httpd_print(c, "retry: 5000\n\n");
+  httpd_write(c, buf, events_render(buf, sizeof(buf), events_band())); //aktueller Stand sofort
+}
+
+
+static void web_wifi_form(httpd_conn_t *c) //HTTP Post Daten verarbeiten
+{
+  char body[2*3*64+8]; //Aufbau: 1=xxx&2=yyy, urlencoded
+  char req[2][64+1];
+  unsigned int r=0, i=0;
+  char last_c=0;
+
+  httpd_read_body(c, body, sizeof(body));
+  req[0][0] = 0; //SSID
+  req[1][0] = 0; //Code
+  for(char *p=body; *p; p++)
+  {
+    if(*p == '&')
+    {
+      r = 0;
     }
-    else if (*src == '+')
+    else if((*p == '=') && isdigit(last_c)) //1=xxx
     {
-      *dst++ = ' ';
-      src++;
+      r = last_c-'0';
+      i = 0;
     }
-    else
+    else if((r > 0) && (r < 3) && (i < (sizeof(req[0])-1))) //1 bis 2
     {
-      *dst++ = *src++;
+      req[r-1][i++] = *p;
+      req[r-1][i] = 0;
     }
+    last_c = *p;
+  }
+  httpd_urldecode(req[0]); //Serial.println(req[0]);
+  httpd_urldecode(req[1]); //Serial.println(req[1]);
+  if(strcmp(req[0], settings.wifi_ssid) || strcmp(req[1], settings.wifi_code))
+  {
+    //todo: Leerzeichen am Ende entfernen
+    strcpy(settings.wifi_ssid, req[0]);
+    strcpy(settings.wifi_code, req[1]);
+    settings_write(&settings); //Einstellungen speichern
+  }
+}
+
+
+static void web_json(httpd_conn_t *c, const httpd_req_t *req) //JSON
+{
+  if(features & (FEATURE_LPS22HB|FEATURE_BMP280))
+  {
+    httpd_printf(c,
+        "{\r\n" \
+        " \"c\": %i,\r\n" \
+        " \"t\": %.1f,\r\n" \
+        " \"h\": %.1f,\r\n" \
+        " \"p\": %.1f,\r\n" \
+        " \"u\": %.1f,\r\n" \
+        " \"l\": %i,\r\n" \
+        " \"s\": %lu\r\n" \
+        "}\r\n",
+        co2_value, temp_value, humi_value, pres_value, temp2_value, light_value, (unsigned long)rtc_clock_to_utc(sample_ms)
+    );
+  }
+  else
+  {
+    httpd_printf(c,
+        "{\r\n" \
+        " \"c\": %i,\r\n" \
+        " \"t\": %.1f,\r\n" \
+        " \"h\": %.1f,\r\n" \
+        " \"l\": %i,\r\n" \
+        " \"s\": %lu\r\n" \
+        "}\r\n",
+        co2_value, temp_value, humi_value, light_value, (unsigned long)rtc_clock_to_utc(sample_ms)
+    );
+  }
+
+  return;
+}
+
+
+static void web_cmk_agent(httpd_conn_t *c, const httpd_req_t *req) //Checkmk Agent
+{
+  //CO2-Ampeln koennen so direkt ins Monitoring von checkmk.com 
+  //aufgenommen werden. Plugins sind nicht zwingend erforderlich.
+  //Da HTTP als Uebertragungsweg genutzt wird, "Data Source" 
+  //verwenden: wget -O - http://ip_address/cmk-agent
+  //Siehe: https://docs.checkmk.com/latest/de/datasource_programs.html
+  //Plaintext im von Checkmk erwarteten Format
+  //Siehe: https://docs.checkmk.com/latest/en/devel_check_plugins.html
+  httpd_printf(c,
+      "<<<check_mk>>>\r\n" \
+      "AgentOS: arduino\r\n" \
+      //Check-Plugin fuer den Server erforderlich, um die Metriken auszuwerten 
+      "<<<watterott_co2ampel_plugin>>>\r\n" \
+      "co2 %i\r\n" \
+      "temp %.1f\r\n" \
+      "humidity %.1f\r\n" \
+      "lighting %i\r\n",
+      co2_value, temp_value, humi_value, light_value
+  );
+  if(features & (FEATURE_LPS22HB|FEATURE_BMP280))
+  {
+    httpd_printf(c,
+        "pressure %.1f\r\n" \
+        "temp2 %.1f\r\n",
+        pres_value, temp2_value
+    );
+  }
+  //Ad-hoc Check, der kein Server-Plugin benoetigt, nutzt Schwellwerte der Ampel.
+  //Achtung: Nur eine Zeile - der Checkmk-Server nimmt die Bewertung selbst an
+  //Hand der uebergebenen Schwellwerte vor. Die lesen wir hier aus der Ampel aus:
+  httpd_printf(c,
+      "<<<local:sep(0)>>>\r\n" \
+      "P \"CO2 level (ppm)\" co2ppm=%i;%i;%i CO2/ventilation control with Watterott CO2-Ampel, thresholds taken from sensor board.\r\n",
+      co2_value, settings.range[1], settings.range[2]
+  );
+
+  return;
+}
+
+
+static void web_index(httpd_conn_t *c, const httpd_req_t *req) //HTML-Seite mit WiFi-Login
+{
+  if((strcmp(req->method, "POST") == 0) && (req->content_length > 0))
+  {
+    web_wifi_form(c);
+  }
+  httpd_print(c,
+      "<!DOCTYPE html>\r\n" \
+      "<html>\r\n" \
+      "<head>\r\n" \
+      "<meta charset=utf-8>\r\n" \
+      "<meta http-equiv=refresh content=120>\r\n" \
+      "<title>CO2-Ampel</title>\r\n" \
+      "<link rel=icon href=\"data:image/gif;base64,R0lGODlhAQABAAAAACwAAAAAAQABAAA=\">\r\n" \
+      "<style>\r\n" \
+      "body { font-size:1.0em; font-family:Lato,sans-serif; padding:10px; }\r\n" \
+      "#data { font-size:3.0em; }\r\n" \
+      "#wifi { font-size:1.0em; display:none; }\r\n" \
+      "#info { font-size:0.9em; }\r\n" \
+      "</style>\r\n" \
+      "<script>\r\n" \
+      "function wifi() {\r\n" \
+      "var box = document.getElementById('wifi');\r\n" \
+      "if(box.style.display != 'block') { box.style.display = 'block'; }\r\n" \
+      "else { box.style.display = 'none'; }\r\n" \
+      "}\r\n" \
+      "</script>\r\n" \
+      "</head>\r\n" \
+      "<body>\r\n"
+  );
+
+  httpd_printf(c,
+      "<div id=data>\r\n" \
+      "CO2 (ppm): %i<br/>\r\n" \
+      "Temperatur (&deg;C): %.1f<br/>\r\n" \
+      "Luftfeuchte (%% rel): %.1f<br/>\r\n",
+      co2_value, temp_value, humi_value
+  );
+  if(features & (FEATURE_LPS22HB|FEATURE_BMP280))
+  {
+    httpd_printf(c,
+        "Druck (hPa): %.1f<br/>\r\n" \
+        "Temperatur (&deg;C): %.1f<br/>\r\n",
+        pres_value, temp2_value
+    );
+  }
+  httpd_print(c, "</div>\r\n");
+
+  String fv = WiFi.firmwareVersion();
+  byte mac[6];
+  WiFi.macAddress(mac);
+  httpd_print(c,
+      "<br/><br/>\r\n" \
+      "<a href='/json'>JSON</a> - <a href='/cmk-agent'>Checkmk</a> - <a href='/settings'>Settings</a> - <a href='#' onclick='wifi();'>WiFi Login</a>\r\n" \
+      "<br/><br/>\r\n" \
+      "<div id=wifi>\r\n" \
+      "<form method=post>\r\n" \
+      "SSID <input name=1 size=30 maxlength=64 placeholder=SSID list=ssids value='"
+  );
+  httpd_escaped(c, settings.wifi_ssid, true);
+  httpd_print(c, "'><br/>\r\n<datalist id=ssids>\r\n"); //Netzwerke vom letzten Scan (AP-Start)
+  for(uint8_t i = 0; i < wifi_scan_count(); i++)
+  {
+    const wifi_scan_net_t *net = wifi_scan_get(i);
+    httpd_print(c, "<option value='");
+    httpd_escaped(c, net->ssid, true);
+    httpd_printf(c, "'>%i dBm%s</option>\r\n", net->rssi, (net->enc == ENC_TYPE_NONE) ? ", offen" : "");
+  }
+  httpd_printf(c,
+      "</datalist>\r\n" \
+      "Code <input name=2 size=30 maxlength=64 placeholder=Password value=''><br/>\r\n" \
+      "<input type=submit> (Neustart erforderlich, requires reboot)<br/>\r\n" \
+      "</form><br/>\r\n" \
+      "<div id=info>\r\n" \
+      "Firmware: v" VERSION ", \r\n" \
+      "WINC1500: %s, \r\n" \
+      "MAC: %02x:%02x:%02x:%02x:%02x:%02x\r\n" \
+      "</div>\r\n" \
+      "</div>\r\n" \
+      "</body>\r\n" \
+      "</html>\r\n",
+      /*settings.wifi_code, */ fv.c_str(),
+      mac[5], mac[4], mac[3], mac[2], mac[1], mac[0]
+  );
+
+  return;
+}
+
+
+static void web_portal(httpd_conn_t *c, const httpd_req_t *req) //Captive-Portal-Erkennung der Clients
+{
+  static char location[40]; //muss bis nach dem Senden gueltig bleiben
+
+  (void)req;
+  if(!wifi_ap_mode(WiFi.status()))
+  {
+    return; //im normalen WLAN 404
   }
-  *dst++ = '\0';
+  IPAddress ip = WiFi.localIP();
+  sprintf(location, "Location: http://%u.%u.%u.%u/\r\n", ip[0], ip[1], ip[2], ip[3]);
+  httpd_respond(c, 302, "text/html", location); //kein 204/"Success" -> Client oeffnet die Seite
+  httpd_print(c, "<a href='/'>CO2-Ampel</a>\r\n");
 
   return;
 }
 
 
+//Routen, sortiert nach Pfad (Binaersuche in httpd), type NULL = Handler antwortet selbst
+static constexpr httpd_route_t web_routes[] =
+{
+  { "/",                          HTTPD_GET|HTTPD_POST, "text/html",        web_index          },
+  { "/api/scan",                  HTTPD_GET,            NULL,               wifi_scan_http     },
+  { "/api/settings",              HTTPD_GET|HTTPD_POST, NULL,               settings_http_api  },
+  { "/canonical.html",            HTTPD_GET,            NULL,               web_portal         }, //Firefox
+  { "/cmk-agent",                 HTTPD_GET,            "text/plain",       web_cmk_agent      },
+  { "/connecttest.txt",           HTTPD_GET,            NULL,               web_portal         }, //Windows
+  { "/events",                    HTTPD_GET,            NULL,               web_events         },
+  { "/fwlink",                    HTTPD_GET,            NULL,               web_portal         }, //Windows
+  { "/gen_204",                   HTTPD_GET,            NULL,               web_portal         }, //Android
+  { "/generate_204",              HTTPD_GET,            NULL,               web_portal         }, //Android, ChromeOS
+  { "/history",                   HTTPD_GET,            NULL,               history_http       },
+  { "/hotspot-detect.html",       HTTPD_GET,            NULL,               web_portal         }, //Apple
+  { "/json",                      HTTPD_GET,            "application/json", web_json           },
+  { "/library/test/success.html", HTTPD_GET,            NULL,               web_portal         }, //Apple
+  { "/ncsi.txt",                  HTTPD_GET,            NULL,               web_portal         }, //Windows
+  { "/redirect",                  HTTPD_GET,            NULL,               web_portal         }, //Windows
+  { "/settings",                  HTTPD_GET|HTTPD_POST, NULL,               settings_http_page },
+  { "/success.txt",               HTTPD_GET,            NULL,               web_portal         }, //Firefox
+};
+static constexpr size_t web_routes_count = sizeof(web_routes) / sizeof(web_routes[0]);
+static_assert(cfg_keys_sorted(web_routes, 0, web_routes_count, true), "web_routes must be sorted by path, without duplicates");
+
+
 void webserver_service(void)
 {
-  static unsigned long t_check=0;
+  static uint64_t t_check=0;
   unsigned int status;
 
   if((features & FEATURE_WINC1500) == 0)
@@ -707,354 +1939,44 @@ void webserver_service(void)
           (status == WL_CONNECTION_LOST) || 
           (status == WL_DISCONNECTED)) //Verbindungsabbruch
   {
-    if((millis()-t_check) > (1*60000UL)) //1min
+    if((rtc_clock_mono_ms()-t_check) > (1*60000UL)) //1min
     {
-      t_check = millis();
+      t_check = rtc_clock_mono_ms();
       wifi_start();
     }
     return;
   }
 
-  t_check = millis(); //Zeit speichern fuer Neuverbindung nach 1min
+  t_check = rtc_clock_mono_ms(); //Zeit speichern fuer Neuverbindung nach 1min
 
-  WiFiClient client = server.available();
-  if(!client) //Client nicht verbunden
-  {
-    return;
-  }
-  //if(features & FEATURE_USB)
-  //{
-  //  Serial.println("WiFi client connected");
-  //}
-  boolean currentLineIsBlank=true;
-  unsigned int pos=0;
-  char buf[1024];
-  char req[2][64+1]; //HTTP request
-  req[0][0] = 0;
-  while(client.connected())
-  {
-    if((millis()-t_check) > (5*1000UL)) //Stop nach 5s
-    {
-      break;
-    }
-    if(client.available())
-    {
-      char c = client.read();
-      if(c == '\n' && currentLineIsBlank) //Header zu Ende
-      {
-        if(strncmp(req[0], "GET ", 4) && strncmp(req[0], "POST ", 5)) //kein GET oder POST
-        {
-          sprintf(buf, 
-              "HTTP/1.1 400 Bad Request\r\n" \
-              "Content-Type: text/plain\r\n" \
-              "Connection: close\r\n" \
-              "\r\n" \
-              "400 Bad Request\r\n"
-          );
-          client.print(buf);
-        }
-        else if(strncmp(req[0], "GET /json", 9) == 0) //JSON
-        {
-          if(features & (FEATURE_LPS22HB|FEATURE_BMP280))
-          {
-            sprintf(buf,
-                "HTTP/1.1 200 OK\r\n" \
-                "Content-Type: application/json\r\n" \
-                "Connection: close\r\n" \
-                "\r\n" \
-                "{\r\n" \
-                " \"c\": %i,\r\n" \
-                " \"t\": %.1f,\r\n" \
-                " \"h\": %.1f,\r\n" \
-                " \"p\": %.1f,\r\n" \
-                " \"u\": %.1f,\r\n" \
-                " \"l\": %i\r\n" \
-                "}\r\n",
-                co2_value, temp_value, humi_value, pres_value, temp2_value, light_value
-            );
-          }
-          else
-          {
-            sprintf(buf,
-                "HTTP/1.1 200 OK\r\n" \
-                "Content-Type: application/json\r\n" \
-                "Connection: close\r\n" \
-                "\r\n" \
-                "{\r\n" \
-                " \"c\": %i,\r\n" \
-                " \"t\": %.1f,\r\n" \
-                " \"h\": %.1f,\r\n" \
-                " \"l\": %i\r\n" \
-                "}\r\n",
-                co2_value, temp_value, humi_value, light_value
-            );
-          }
-          client.print(buf);
-        }
-        else if(strncmp(req[0], "GET /cmk-agent", 14) == 0) //Checkmk Agent
-        {
-          //CO2-Ampeln koennen so direkt ins Monitoring von checkmk.com 
-          //aufgenommen werden. Plugins sind nicht zwingend erforderlich.
-          //Da HTTP als Uebertragungsweg genutzt wird, "Data Source" 
-          //verwenden: wget -O - http://ip_address/cmk-agent
-          //Siehe: https://docs.checkmk.com/latest/de/datasource_programs.html
-          if(features & (FEATURE_LPS22HB|FEATURE_BMP280))
-          {
-            sprintf(buf,
-                "HTTP/1.1 200 OK\r\n" \
-                "Content-Type: text/plain\r\n" \
-                "Connection: close\r\n" \
-                "\r\n" \
-                //Plaintext im von Checkmk erwarteten Format
-                //Siehe: https://docs.checkmk.com/latest/en/devel_check_plugins.html
-                "<<<check_mk>>>\r\n" \
-                "AgentOS: arduino\r\n" \
-                //Check-Plugin fuer den Server erforderlich, um die Metriken auszuwerten 
-                "<<<watterott_co2ampel_plugin>>>\r\n" \
-                "co2 %i\r\n" \
-                "temp %.1f\r\n" \
-                "humidity %.1f\r\n" \
-                "lighting %i\r\n" \
-                "pressure %.1f\r\n" \
-                "temp2 %.1f\r\n" \
-                //Ad-hoc Check, der kein Server-Plugin benoetigt, nutzt Schwellwerte der Ampel.
-                //Achtung: Nur eine Zeile - der Checkmk-Server nimmt die Bewertung selbst an
-                //Hand der uebergebenen Schwellwerte vor. Die lesen wir hier aus der Ampel aus:
-                "<<<local:sep(0)>>>\r\n" \
-                "P \"CO2 level (ppm)\" co2ppm=%i;%i;%i CO2/ventilation control with Watterott CO2-Ampel, thresholds taken from sensor board.\r\n",
-                co2_value, temp_value, humi_value, light_value, pres_value, temp2_value,
-                co2_value, settings.range[1], settings.range[2]
-            );
-          }
-          else
-          {
-            sprintf(buf,
-                "HTTP/1.1 200 OK\r\n" \
-                "Content-Type: text/plain\r\n" \
-                "Connection: close\r\n" \
-                "\r\n" \
-                //Plaintext im von Checkmk erwarteten Format
-                //Siehe: https://docs.checkmk.com/latest/en/devel_check_plugins.html
-                "<<<check_mk>>>\r\n" \
-                "AgentOS: arduino\r\n" \
-                //Check-Plugin fuer den Server erforderlich, um die Metriken auszuwerten 
-                "<<<watterott_co2ampel_plugin>>>\r\n" \
-                "co2 %i\r\n" \
-                "temp %.1f\r\n" \
-                "humidity %.1f\r\n" \
-                "lighting %i\r\n" \
-                //Ad-hoc Check, der kein Server-Plugin benoetigt, nutzt Schwellwerte der Ampel.
-                //Achtung: Nur eine Zeile - der Checkmk-Server nimmt die Bewertung selbst an
-                //Hand der uebergebenen Schwellwerte vor. Die lesen wir hier aus der Ampel aus:
-                "<<<local:sep(0)>>>\r\n" \
-                "P \"CO2 level (ppm)\" co2ppm=%i;%i;%i CO2/ventilation control with Watterott CO2-Ampel, thresholds taken from sensor board.\r\n",
-                co2_value, temp_value, humi_value, light_value,
-                co2_value, settings.range[1], settings.range[2]
-            );
-          }
-          client.print(buf);
-        }
-        else if(strncmp(req[0], "GET /favicon", 12) == 0) //Favicon 
-        {
-          sprintf(buf, 
-              "HTTP/1.1 404 Not Found\r\n" \
-              "Content-Type: text/plain\r\n" \
-              "Connection: close\r\n" \
-              "\r\n" \
-              "404 Not Found\r\n"
-          );
-          client.print(buf);
-        }
-        else
-        {
-          //HTTP Post Daten verarbeiten
-          if((strncmp(req[0], "POST ", 5) == 0) && client.available())
-          {
-            req[0][0] = 0; //SSID
-            req[1][0] = 0; //Code
-            for(unsigned int r=0, i=0, last_c=0; client.available();)
-            {
-              c = client.read();
-              if(c == '&') //Aufbau: 1=xxx&2=yyy
-              {
-                r = 0;
-              }
-              else if((c == '=') && isdigit(last_c)) //1=xxx
-              {
-                r = last_c-'0';
-                i = 0;
-              }
-              else if((r > 0) && (r < 3)) //1 bis 2
-              {
-                req[r-1][i++] = c;
-                req[r-1][i] = 0;
-              }
-              last_c = c;
-            }
-            urldecode(req[0]); //Serial.println(req[0]);
-            urldecode(req[1]); //Serial.println(req[1]);
-            if(strcmp(req[0], settings.wifi_ssid) || strcmp(req[1], settings.wifi_code))
-            {
-              //todo: Leerzeichen am Ende entfernen
-              strcpy(settings.wifi_ssid, req[0]);
-              strcpy(settings.wifi_code, req[1]);
-              settings_write(&settings); //Einstellungen speichern
-            }
-          }
-          //HTTP Header+Daten
-          sprintf(buf,
-              "HTTP/1.1 200 OK\r\n" \
-              "Content-Type: text/html\r\n" \
-              "Connection: close\r\n" \
-              "\r\n"
-              "<!DOCTYPE html>\r\n" \
-              "<html>\r\n" \
-              "<head>\r\n" \
-              "<meta charset=utf-8>\r\n" \
-              "<meta http-equiv=refresh content=120>\r\n" \
-              "<title>CO2-Ampel</title>\r\n" \
-              "<link rel=icon href=\"data:image/gif;base64,R0lGODlhAQABAAAAACwAAAAAAQABAAA=\">\r\n" \
-              "<style>\r\n" \
-              "body { font-size:1.0em; font-family:Lato,sans-serif; padding:10px; }\r\n" \
-              "#data { font-size:3.0em; }\r\n" \
-              "#wifi { font-size:1.0em; display:none; }\r\n" \
-              "#info { font-size:0.9em; }\r\n" \
-              "</style>\r\n" \
-              "<script>\r\n" \
-              "function wifi() {\r\n" \
-              "var box = document.getElementById('wifi');\r\n" \
-              "if(box.style.display != 'block') { box.style.display = 'block'; }\r\n" \
-              "else { box.style.display = 'none'; }\r\n" \
-              "}\r\n" \
-              "</script>\r\n" \
-              "</head>\r\n" \
-              "<body>\r\n"
-          );
-          client.print(buf);
-
-          if(features & (FEATURE_LPS22HB|FEATURE_BMP280))
-          {
-            sprintf(buf,
-                "<div id=data>\r\n" \
-                "CO2 (ppm): %i<br/>\r\n" \
-                "Temperatur (&deg;C): %.1f<br/>\r\n" \
-                "Luftfeuchte (% rel): %.1f<br/>\r\n" \
-                "Druck (hPa): %.1f<br/>\r\n" \
-                "Temperatur (&deg;C): %.1f<br/>\r\n" \
-                "</div>\r\n",
-                co2_value, temp_value, humi_value, pres_value, temp2_value
-            );
-          }
-          else
-          {
-            sprintf(buf,
-                "<div id=data>\r\n" \
-                "CO2 (ppm): %i<br/>\r\n" \
-                "Temperatur (&deg;C): %.1f<br/>\r\n" \
-                "Luftfeuchte (% rel): %.1f<br/>\r\n" \
-                "</div>\r\n",
-                co2_value, temp_value, humi_value
-            );
-          }
-          client.print(buf);
+  httpd_service(); //Anfragen auf allen offenen Verbindungen beantworten
+  dns_captive_service(); //im AP-Modus DNS-Anfragen beantworten
+  events_service();
 
-          String fv = WiFi.firmwareVersion();
-          byte mac[6];
-          WiFi.macAddress(mac);
-          sprintf(buf,
-              "<br/><br/>\r\n" \
-              "<a href='/json'>JSON</a> - <a href='/cmk-agent'>Checkmk</a> - <a href='#' onclick='wifi();'>WiFi Login</a>\r\n" \
-              "<br/><br/>\r\n" \
-              "<div id=wifi>\r\n" \
-              "<form method=post>\r\n" \
-              "SSID <input name=1 size=30 maxlength=64 placeholder=SSID value='%s'><br/>\r\n" \
-              "Code <input name=2 size=30 maxlength=64 placeholder=Password value=''><br/>\r\n" \
-              "<input type=submit> (Neustart erforderlich, requires reboot)<br/>\r\n" \
-              "</form><br/>\r\n" \
-              "<div id=info>\r\n" \
-              "Firmware: v" VERSION ", \r\n" \
-              "WINC1500: %s, \r\n" \
-              "MAC: %02x:%02x:%02x:%02x:%02x:%02x\r\n" \
-              "</div>\r\n" \
-              "</div>\r\n" \
-              "</body>\r\n" \
-              "</html>\r\n",
-              settings.wifi_ssid, /*settings.wifi_code, */ fv.c_str(), 
-              mac[5], mac[4], mac[3], mac[2], mac[1], mac[0]
-          );
-          client.print(buf);
-        }
-        break;
-      }
-      else //save request
-      {
-        if(pos < (sizeof(req[0])-1))
-        {
-          req[0][pos++] = c;
-          req[0][pos] = 0;
-        }
-      }
-      if(c == '\n')
-      {
-        currentLineIsBlank = true;
-      }
-      else if(c != '\r')
-      {
-        currentLineIsBlank = false;
-      }
-    }
+  if(status == WL_CONNECTED) //Power-Save: wach bei Verkehr und vor dem naechsten MQTT-Publish
+  {
+    httpd_stats_t st;
+    httpd_get_stats(&st);
+    wifi_ps_service(st.open > 0, mqtt_next_ms()); //Keep-Alive-Verbindungen offen: nur leichter Power-Save
   }
 
-  delay(20); //20ms warten zum Senden
-  client.stop();
-
   return;
 }
 
 
-int check_i2c(Sercom *sercom, byte addr) //1=okay
+bool switch_pressed(void) //neuer Tastendruck seit button_flush()?
 {
-  int res = 0;
-
-  for(int t=3; (t!=0) && (res==0); t--) //try 3 times
-  {
-    sercom->I2CM.CTRLA.bit.ENABLE = 1; //enable master mode
-    delay(10); //wait 10ms
-    sercom->I2CM.ADDR.bit.ADDR = (addr<<1) | 0x00; //start transfer
-    delay(10); //wait 10ms
-    if(sercom->I2CM.INTFLAG.bit.MB || sercom->I2CM.INTFLAG.bit.SB) //data transmitted
-    {
-      if(!sercom->I2CM.STATUS.bit.RXNACK) //ack received
-      {
-        res = 1; //ok
-        break;
-      }
-    }
-  }
+  button_event_t ev;
 
-  /*
-  if(res == 0)
+  while(button_get(&ev))
   {
-    if(sercom == SERCOM1)
-    {
-      Wire.beginTransmission(addr);
-      if(Wire.endTransmission() == 0)
-      {
-        res = 1; //ok
-      }
-    }
-    else if(sercom == SERCOM2)
+    if(ev.type == BUTTON_DOWN)
     {
-      Wire1.beginTransmission(addr);
-      if(Wire1.endTransmission() == 0)
-      {
-        res = 1; //ok
-      }
+      return true;
     }
   }
-  */
 
-  return res;
+  return false;
 }
 
 
@@ -1076,7 +1998,7 @@ void self_test(void) //Testprogramm
     //ATWINC1500-Test
     if(WiFi.status() == WL_NO_SHIELD) //ATWINC1500 Fehler
     {
-      if(features & FEATURE_USB)
+      if(serial_text())
       {
         Serial.println("Error: ATWINC1500");
       }
@@ -1092,6 +2014,7 @@ void self_test(void) //Testprogramm
     {
       leds(FARBE_WEISS); //LEDs weiss
       buzzer(1000); //1s Buzzer an
+      delay(1000); //Anzeige 1s halten
     }
   #endif
 
@@ -1109,6 +2032,7 @@ void self_test(void) //Testprogramm
     {
       leds(FARBE_WEISS); //LEDs weiss
       buzzer(1000); //1s Buzzer an
+      delay(1000); //Anzeige 1s halten
     }
   #endif
 
@@ -1122,18 +2046,16 @@ void self_test(void) //Testprogramm
     pres_value = 0;
   #endif
   ws2812.fill(FARBE_AUS, 0, 4); //LEDs aus
+  button_flush();
   for(unsigned int okay=0; okay < 15;)
   {
-    if(digitalRead(PIN_SWITCH) == 0) //Taster gedrueckt?
+    if(switch_pressed()) //Taster gedrueckt?
     {
       break; //Abbruch
     }
     status_led(200); //Status-LED
 
-    digitalWrite(PIN_LSENSOR_PWR, HIGH); //Lichtsensor an
-    delay(50); //50ms warten
-    light = analogRead(PIN_LSENSOR); //0...1024
-    digitalWrite(PIN_LSENSOR_PWR, LOW); //Lichtsensor aus
+    light = ambient_read(); //0...1023
     if((light >= 50) && (light <= 1000)) //50-1000
     {
       okay |= (1<<0);
@@ -1205,9 +2127,10 @@ void air_test(void) //Frischluft-Test
   ws2812.fill(COLOR_WHITE, 0, 4); //LEDs weiss
   ws2812.show();
 
+  button_flush();
   while(1)
   {
-    if(digitalRead(PIN_SWITCH) == 0) //Taster gedrueckt?
+    if(switch_pressed()) //Taster gedrueckt?
     {
       break; //Abbruch
     }
@@ -1254,7 +2177,8 @@ void air_test(void) //Frischluft-Test
 
 unsigned int select_value(unsigned int value, unsigned int min, unsigned int max, unsigned int fill, uint32_t color, uint32_t color_off)
 {
-  unsigned int timeout, sw;
+  unsigned long t_event;
+  button_event_t ev;
 
   ws2812.fill(color_off, 0, 4);
   if(fill == 0)
@@ -1267,48 +2191,45 @@ unsigned int select_value(unsigned int value, unsigned int min, unsigned int max
   }
   ws2812.show();
 
-  for(sw=0, timeout=0; timeout<1000; timeout++) //10s Timeout
+  button_flush();
+  for(t_event=millis(); (millis()-t_event) < 10000;) //10s Timeout
   {
-    delay(10); //10ms warten
+    status_led(button_pressed()); //Status-LED an solange Taster gedrueckt
 
-    if(digitalRead(PIN_SWITCH) == LOW) //Taster gedrueckt
+    if(!button_get(&ev))
     {
-      status_led(1); //Status-LED an
-      sw++;
-      if(sw > 200)
-      {
-        leds(COLOR_OFF); //LEDs aus
-      }
-      timeout = 0;
+      continue;
+    }
+    t_event = millis();
+
+    if(ev.type == BUTTON_HOLD) //2s gedrueckt
+    {
+      leds(COLOR_OFF); //LEDs aus
+    }
+    else if(ev.type == BUTTON_LONG) //2s Tastendruck
+    {
+      break;
     }
-    else //Taster losgelassen
+    else if((ev.type == BUTTON_SHORT) || (ev.type == BUTTON_DOUBLE))
     {
-      status_led(0); //Status-LED aus
-      if(sw > 200) //2s Tastendruck
+      value++;
+      if(value > max)
       {
-        break;
+        value = min;
       }
-      else if(sw > 10) //100ms Tastendruck
+      ws2812.fill(color_off, 0, 4);
+      if(fill == 0)
       {
-        value++;
-        if(value > max)
-        {
-          value = min;
-        }
-        ws2812.fill(color_off, 0, 4);
-        if(fill == 0)
-        {
-          ws2812.setPixelColor(value, color);
-        }
-        else if(value > 0)
-        {
-          ws2812.fill(color, 0, value);
-        }
-        ws2812.show();
+        ws2812.setPixelColor(value, color);
       }
-      sw = 0;
+      else if(value > 0)
+      {
+        ws2812.fill(color, 0, value);
+      }
+      ws2812.show();
     }
   }
+  status_led(0); //Status-LED aus
   
   leds(COLOR_OFF); //LEDs aus
   delay(500); //500ms warten
@@ -1321,6 +2242,8 @@ void altitude_toffset(void) //Altitude und Temperaturoffset
 {
   unsigned int timeout, sw, value=0;
 
+  i2c_async_lock(I2C_BUS0); //Sensor-Bibliothek benutzt den Bus
+
   //Altitude
   if(features & FEATURE_SCD30)
   {
@@ -1346,7 +2269,7 @@ void altitude_toffset(void) //Altitude und Temperaturoffset
     scd4x.setSensorAltitude(value); //Meter ueber dem Meeresspiegel
   }
 
-  if(features & FEATURE_USB)
+  if(serial_text())
   {
     Serial.print("Altitude: ");
     Serial.println(value, DEC);
@@ -1377,7 +2300,9 @@ void altitude_toffset(void) //Altitude und Temperaturoffset
     scd4x.startPeriodicMeasurement();
   }
 
-  if(features & FEATURE_USB)
+  i2c_async_unlock(I2C_BUS0);
+
+  if(serial_text())
   {
     Serial.print("Temperature: ");
     Serial.println(value, DEC);
@@ -1386,7 +2311,7 @@ void altitude_toffset(void) //Altitude und Temperaturoffset
   //Buzzer
   settings.buzzer = select_value(settings.buzzer, 0, 1, 1, COLOR_GREEN, COLOR_WHITE);
 
-  if(features & FEATURE_USB)
+  if(serial_text())
   {
     Serial.print("Buzzer: ");
     Serial.println(settings.buzzer, DEC);
@@ -1414,10 +2339,11 @@ void calibration(void) //Kalibrierung
 
   if(features & FEATURE_SCD4X)
   {
-    interval = 5; //5s
+    interval = INTERVALL_SCD4X; //5s
   }
 
   //ASC
+  i2c_async_lock(I2C_BUS0); //Sensor-Bibliothek benutzt den Bus
   if(features & FEATURE_SCD30)
   {
     if(AUTO_KALIBRIERUNG) //ASC on
@@ -1460,14 +2386,16 @@ void calibration(void) //Kalibrierung
     delay(500);
     scd4x.startPeriodicMeasurement();
   }
+  i2c_async_unlock(I2C_BUS0);
 
+  button_flush();
   calibration_start:
 
   //Kalibrierung
   co2 = co2_last = co2_sensor();
   for(again=0, cycle=0; cycle < (180/interval);) //mindestens 3 Minuten
   {
-    if(digitalRead(PIN_SWITCH) == 0) //Taster gedrueckt?
+    if(switch_pressed()) //Taster gedrueckt?
     {
       abort = 1;
       break; //Abbruch
@@ -1514,7 +2442,7 @@ void calibration(void) //Kalibrierung
       }
       ws2812.show();
 
-      if(features & FEATURE_USB)
+      if(serial_text())
       {
         Serial.print("loop: ");
         Serial.println(cycle);
@@ -1525,6 +2453,7 @@ void calibration(void) //Kalibrierung
   }
   if(abort == 0)
   {
+    i2c_async_lock(I2C_BUS0);
     if(features & FEATURE_SCD30)
     {
       scd30.setForcedRecalibrationFactor(400); //400ppm = Frischluft
@@ -1539,6 +2468,7 @@ void calibration(void) //Kalibrierung
       delay(1000);
       scd4x.startPeriodicMeasurement();
     }
+    i2c_async_unlock(I2C_BUS0);
     if(again != 0)
     {
       Serial.println("Restart calibration");
@@ -1546,7 +2476,7 @@ void calibration(void) //Kalibrierung
     }
     leds(COLOR_BLUE);//LEDs blau
     buzzer(500); //500ms Buzzer an
-    if(features & FEATURE_USB)
+    if(serial_text())
     {
       Serial.println("Calibration OK");
     }
@@ -1561,7 +2491,7 @@ void menu(void)
 {
   unsigned int timeout, sw, value;
 
-  ws2812.setBrightness(30); //0...255
+  led_anim_brightness(30); //0...255
   leds(FARBE_VIOLETT); //LEDs violett
   delay(500); //500ms warten
   leds(FARBE_AUS); //LEDs aus
@@ -1577,7 +2507,7 @@ void menu(void)
     case 4: calibration();      break;
   }
 
-  ws2812.setBrightness(settings.brightness); //0...255
+  led_anim_brightness(settings.brightness); //0...255
   leds(ws2812.Color(20,20,20));//LEDs weiss
 
   return;
@@ -1589,7 +2519,7 @@ unsigned int wifi_start_ap(void)
   byte mac[6];
   char ssid[32];
 
-  if(features & FEATURE_USB)
+  if(serial_text())
   {
     Serial.println("WiFi AP start...");
   }
@@ -1599,10 +2529,15 @@ unsigned int wifi_start_ap(void)
 
   if(WiFi.status() != WL_IDLE_STATUS)
   {
+    httpd_close_all();
+    dns_captive_stop();
+    wifi_ps_stop();
     WiFi.end(); //WiFi.disconnect();
     //reset_mcu();
   }
 
+  wifi_scan_run(); //Netzwerke fuer die SSID-Auswahl, im AP-Modus kann der WINC1500 nicht scannen
+
   WiFi.hostname(ssid); //Hostname setzen
   if(WiFi.beginAP(ssid) != WL_AP_LISTENING)
   {
@@ -1610,29 +2545,61 @@ unsigned int wifi_start_ap(void)
     return 1;
   }
 
-  delay(5000); //5s warten
-
   server.begin(); //starte Webserver
+  httpd_begin(&server, web_routes, web_routes_count);
+  dns_captive_begin(WiFi.localIP()); //jeder Hostname -> Ampel
 
   return 0;
 }
 
 
+static uint32_t wifi_cred(void) //Pruefsumme ueber SSID und Passwort
+{
+  char buf[sizeof(settings.wifi_ssid) + sizeof(settings.wifi_code)];
+  size_t len = strlen(settings.wifi_ssid) + 1;
+
+  memcpy(buf, settings.wifi_ssid, len);
+  strcpy(buf + len, settings.wifi_code);
+
+  return settings_crc(buf, len + strlen(settings.wifi_code));
+}
+
+
+static void wifi_static_ip(void) //feste Adresse aus wifi.ip, ohne DHCP
+{
+  uint32_t gateway, subnet, dns;
+
+  if(settings.wifi_ip == 0) //0.0.0.0 = DHCP
+  {
+    return;
+  }
+  //nicht gesetzte Werte wie WiFi.config(ip): Gateway x.y.z.1, Netzmaske 255.255.255.0, DNS = Gateway
+  gateway = settings.wifi_gateway ? settings.wifi_gateway : ((settings.wifi_ip & 0x00FFFFFFUL) | 0x01000000UL);
+  subnet  = settings.wifi_subnet ? settings.wifi_subnet : 0x00FFFFFFUL;
+  dns     = settings.wifi_dns ? settings.wifi_dns : gateway;
+  WiFi.config(IPAddress(settings.wifi_ip), IPAddress(dns), IPAddress(gateway), IPAddress(subnet));
+}
+
+
 unsigned int wifi_start(void)
 {
   byte mac[6];
   char name[32];
+  unsigned long t0;
+  uint32_t cred;
+  wifi_cache_t cache;
+  bool wifi_fast;
 
   if(settings.wifi_ssid[0] == 0) //keine Logindaten
   {
-    if(features & FEATURE_USB)
+    if(serial_text())
     {
       Serial.println("WiFi not configured (ssid empty)");
     }
     return 1;
   }
 
-  if(features & FEATURE_USB)
+  if(serial_text())
   {
     Serial.println("WiFi connect...");
   }
@@ -1642,57 +2609,123 @@ unsigned int wifi_start(void)
 
   if(WiFi.status() != WL_IDLE_STATUS)
   {
+    httpd_close_all();
+    dns_captive_stop();
+    wifi_ps_stop();
     WiFi.end(); //WiFi.disconnect();
     //reset_mcu();
   }
 
   WiFi.hostname(name); //Hostname setzen
-  if(strlen(settings.wifi_code) > 0) //Passwort
+  wifi_static_ip();
+  wifi_power_save(); //Listen-Intervall wird beim Verbinden an den AP gemeldet
+  //WiFi.begin() kehrt nach Verbindung (inkl. DHCP), Abbruch oder WIFI_TIMEOUT zurueck
+  status_led(1); //Status-LED an waehrend des Verbindungsaufbaus
+  t0 = millis();
+  cred = wifi_cred();
+  wifi_fast = wifi_cache_read(&cache) && (cache.cred == cred);
+  if(wifi_fast) //gleiche Zugangsdaten wie bei der letzten Verbindung
+  {
+    WiFi.setTimeout(WIFI_FAST_TIMEOUT);
+    WiFi.begin(); //WINC1500 verbindet mit seinem gespeicherten Profil (zuletzt genutzter AP)
+    WiFi.setTimeout(WIFI_TIMEOUT);
+    if((WiFi.status() != WL_CONNECTED) || strcmp(WiFi.SSID(), settings.wifi_ssid))
+    {
+      wifi_fast = false; //AP nicht erreichbar oder anderes Profil -> normale Suche auf allen Kanaelen
+      WiFi.disconnect();
+    }
+  }
+  if(!wifi_fast)
   {
-    WiFi.begin(settings.wifi_ssid, settings.wifi_code); //verbinde WiFi Netzwerk mit Passwort
+    if(strlen(settings.wifi_code) > 0) //Passwort
+    {
+      WiFi.begin(settings.wifi_ssid, settings.wifi_code); //verbinde WiFi Netzwerk mit Passwort
+    }
+    else
+    {
+      WiFi.begin(settings.wifi_ssid); //verbinde WiFi Netzwerk ohne Passwort
+    }
   }
-  else
+  status_led(0);
+
+  if(!(WiFi.status() == WL_CONNECTED)) //Verbindung fehlgeschlagen
+  {
+    return 1;
+  }
+
+  wifi_connect_ms = millis() - t0;
+  wifi_connect_fast = wifi_fast;
+  if(!wifi_fast)
+  {
+    memset(&cache, 0, sizeof(cache));
+    cache.cred = cred;
+    cache.connect_ms = wifi_connect_ms; //Dauer der vollen Suche zum Vergleich
+  }
+  WiFi.BSSID(cache.bssid);
+  cache.ip = WiFi.localIP();
+  cache.gateway = WiFi.gatewayIP();
+  cache.subnet = WiFi.subnetMask();
+  wifi_cache_write(&cache); //nur bei Aenderung (neue Zugangsdaten, anderer AP, andere Adresse)
+  wifi_conn = cache;
+
+  server.begin(); //starte Webserver
+  httpd_begin(&server, web_routes, web_routes_count);
+
+  return 0;
+}
+
+
+static bool wifi_ap_mode(int status) //Access Point aktiv, mit oder ohne verbundene Clients
+{
+  return (status == WL_AP_LISTENING) || (status == WL_AP_CONNECTED);
+}
+
+
+void wifi_power_save(void) //WINC1500 Power-Save nach wifi.power oder Profil, umgeschaltet in wifi_ps_service()
+{
+  wifi_ps_mode_t mode;
+
+  if(settings.wifi_power != 0)
+  {
+    mode = (wifi_ps_mode_t)(settings.wifi_power - 1);
+  }
+  else if(settings.power_profile == PROFIL_SINGLE_SHOT)
   {
-    WiFi.begin(settings.wifi_ssid); //verbinde WiFi Netzwerk ohne Passwort
+    mode = WIFI_PS_DEEP; //Deep Power-Save, nur alle wifi.listen Beacons wach
   }
-
-  //auf Verbindung warten
-  for(unsigned int t=0; WiFi.status() == WL_IDLE_STATUS; t++)
+  else if(settings.power_profile == PROFIL_LOW_POWER)
   {
-    if(t >= 6) //6s
-    {
-      break;
-    }
-    status_led(1000); //Status-LED
+    mode = WIFI_PS_AUTO;
   }
-
-  if(!(WiFi.status() == WL_CONNECTED)) //Verbindung fehlgeschlagen
+  else
   {
-    return 1;
+    mode = WIFI_PS_OFF;
   }
-
-  server.begin(); //starte Webserver
-
-  return 0;
+  wifi_ps_begin(mode, settings.wifi_listen);
 }
 
 
 void reset_mcu(void)
 {
-  if(features & FEATURE_USB)
+  if(serial_text())
   {
     Serial.println("Reset...");
   }
 
   status_led(0);
   buzzer(0);
-  ws2812.setBrightness(HELLIGKEIT_DUNKEL); //dunkel
+  led_anim_brightness(HELLIGKEIT_DUNKEL); //dunkel
   leds(FARBE_WEISS); //LEDs weiss
 
   if(features & FEATURE_WINC1500)
   {
+    httpd_close_all();
+    dns_captive_stop();
+    wifi_ps_stop();
     WiFi.end(); //WiFi.disconnect();
   }
+  i2c_async_lock(I2C_BUS0); //laufende Transfers beenden
+  i2c_async_lock(I2C_BUS1);
   if(features & FEATURE_SCD30)
   {
     scd30.StopMeasurement();
@@ -1741,9 +2774,113 @@ void get_device_id(char *buffer, size_t buffer_size)
 //--- Settings Storage Functions (Flash Memory) ---
 
 // Liest Einstellungen aus Flash
-void settings_read(SETTINGS *data)
+uint32_t settings_crc(const void *data, size_t len) //CRC-32 (IEEE 802.3)
+{
+  const uint8_t *p = (const uint8_t *)data;
+  uint32_t crc = 0xFFFFFFFFUL;
+
+  while(len--)
+  {
+    crc ^= *p++;
+    for(uint8_t i=0; i < 8; i++)
+    {
+      crc = (crc >> 1) ^ (0xEDB88320UL & (0 - (crc & 1)));
+    }
+  }
+
+  return ~crc;
+}
+
+
+void settings_defaults(SETTINGS *s) //Standardwerte aus dem Schema
+{
+  memset(s, 0, sizeof(SETTINGS));
+  SETTINGS_SCHEMA(ITEM_DEF_NUM, ITEM_DEF_BOOL, ITEM_DEF_STR, ITEM_DEF_IP)
+  s->valid = true;
+
+  return;
+}
+
+
+void settings_check(SETTINGS *s) //Werte ausserhalb des Schemas auf Standard setzen
+{
+  SETTINGS_SCHEMA(ITEM_CHECK_NUM, ITEM_CHECK_BOOL, ITEM_CHECK_STR, ITEM_CHECK_IP)
+  if(validate_ranges(s) != NULL) //Schwellwerte nicht aufsteigend
+  {
+    s->range[0] = DEFAULT_T1;
+    s->range[1] = DEFAULT_T2;
+    s->range[2] = DEFAULT_T3;
+    s->range[3] = DEFAULT_T4;
+    s->range[4] = DEFAULT_T5;
+  }
+  s->valid = true;
+
+  return;
+}
+
+
+static bool migrate_v1(SETTINGS *s) //Version 1 (ohne Header) -> 2, gleiches Layout
+{
+  //alte Gueltigkeitspruefung, einzelne Werte prueft danach settings_check()
+  return (*(const uint8_t *)&s->valid == 1) && (s->brightness <= 255) && (s->range[0] >= 100);
+}
+
+typedef bool (*settings_migration_fn)(SETTINGS *s);
+static const settings_migration_fn settings_migrations[SETTINGS_VERSION] =
 {
-  memcpy(data, (const void*)SETTINGS_FLASH_ADDR, sizeof(SETTINGS));
+  NULL,       //0: ungueltig
+  migrate_v1, //1 -> 2
+};
+
+
+uint8_t settings_load(SETTINGS *data) //Einstellungen lesen, bei Bedarf migrieren
+{
+  const volatile SETTINGS_IMAGE *img = SETTINGS_FLASH_ADDR;
+  const void *src;
+  uint16_t version, size;
+
+  //schneller Start: aktuelle Version mit gueltiger CRC wird nicht weiter geprueft
+  if((img->magic == SETTINGS_MAGIC) && (img->version == SETTINGS_VERSION) && (img->size == sizeof(SETTINGS)) &&
+     (settings_crc((const void*)&img->data, sizeof(SETTINGS)) == img->crc))
+  {
+    memcpy(data, (const void*)&img->data, sizeof(SETTINGS));
+    return SETTINGS_OK;
+  }
+
+  if(img->magic == SETTINGS_MAGIC)
+  {
+    version = img->version;
+    size    = img->size;
+    src     = (const void*)&img->data;
+    if((version == 0) || (version > SETTINGS_VERSION) || (size > (SETTINGS_AREA - offsetof(SETTINGS_IMAGE, data))) ||
+       (settings_crc(src, size) != img->crc))
+    {
+      settings_defaults(data);
+      return SETTINGS_DEFAULTS;
+    }
+  }
+  else //Version 1: SETTINGS ohne Header
+  {
+    //nur die Felder von Version 1, dahinter stehen im Flash die Reste der
+    //damals ganz geschriebenen Pages (RAM nach settings), keine Einstellungen
+    version = 1;
+    size    = SETTINGS_V1_SIZE;
+    src     = (const void*)img;
+  }
+
+  memset(data, 0, sizeof(SETTINGS));
+  memcpy(data, src, (size < sizeof(SETTINGS)) ? size : sizeof(SETTINGS));
+  for(; version < SETTINGS_VERSION; version++)
+  {
+    if(!settings_migrations[version](data))
+    {
+      settings_defaults(data);
+      return SETTINGS_DEFAULTS;
+    }
+  }
+  settings_check(data);
+
+  return SETTINGS_MIGRATED;
 }
 
 // Schreibt Einstellungen in Flash
@@ -1755,7 +2892,20 @@ void settings_write(const SETTINGS *data)
   const uint32_t flash_addr = (uint32_t)SETTINGS_FLASH_ADDR;
   const uint32_t page_size = 64;
   const uint32_t row_size = 256;
-  const uint32_t num_rows = (sizeof(SETTINGS) + row_size - 1) / row_size;
+  const uint32_t num_rows = (sizeof(SETTINGS_IMAGE) + row_size - 1) / row_size;
+
+  // Image with header, padded to whole pages
+  static union
+  {
+    SETTINGS_IMAGE img;
+    uint32_t words[((sizeof(SETTINGS_IMAGE) + 63) / 64) * 16];
+  } image;
+  memset(&image, 0xFF, sizeof(image));
+  image.img.magic = SETTINGS_MAGIC;
+  image.img.version = SETTINGS_VERSION;
+  image.img.size = sizeof(SETTINGS);
+  memcpy(&image.img.data, data, sizeof(SETTINGS));
+  image.img.crc = settings_crc(&image.img.data, sizeof(SETTINGS));
 
   // Disable interrupts during flash operations
   __disable_irq();
@@ -1772,8 +2922,8 @@ void settings_write(const SETTINGS *data)
   }
 
   // Write data page by page
-  const uint32_t *src = (const uint32_t *)data;
-  uint32_t num_pages = (sizeof(SETTINGS) + page_size - 1) / page_size;
+  const uint32_t *src = image.words;
+  uint32_t num_pages = (sizeof(SETTINGS_IMAGE) + page_size - 1) / page_size;
 
   for(uint32_t page = 0; page < num_pages; page++)
   {
@@ -1808,7 +2958,7 @@ void mqtt_connect(void)
 
   if((features & FEATURE_WINC1500) == 0)
   {
-    if(features & FEATURE_USB)
+    if(serial_text())
     {
       Serial.println("MQTT: WiFi hardware not available");
     }
@@ -1817,7 +2967,7 @@ void mqtt_connect(void)
 
   if(WiFi.status() != WL_CONNECTED)
   {
-    if(features & FEATURE_USB)
+    if(serial_text())
     {
       Serial.println("MQTT: WiFi not connected");
     }
@@ -1835,7 +2985,7 @@ void mqtt_connect(void)
     client_id[sizeof(client_id)-1] = '\0';
   }
 
-  if(features & FEATURE_USB)
+  if(serial_text())
   {
     Serial.print("MQTT connecting to ");
     Serial.print(settings.mqtt_broker);
@@ -1855,6 +3005,7 @@ void mqtt_connect(void)
 
   //MQTT Client initialisieren
   mqttClient.begin(settings.mqtt_broker, settings.mqtt_port, mqttWifiClient);
+  mqttClient.setKeepAlive(settings.mqtt_interval + MQTT_KEEPALIVE); //Funk bleibt zwischen den Publishes im Power-Save
 
   //Verbinden
   boolean connected = false;
@@ -1871,14 +3022,14 @@ void mqtt_connect(void)
 
   if(connected)
   {
-    if(features & FEATURE_USB)
+    if(serial_text())
     {
       Serial.println("MQTT connected successfully");
     }
   }
   else
   {
-    if(features & FEATURE_USB)
+    if(serial_text())
     {
       Serial.print("MQTT connection failed - ");
 
@@ -1920,7 +3071,7 @@ void mqtt_connect(void)
 
 void mqtt_reconnect(void)
 {
-  static unsigned long last_attempt = 0;
+  static uint64_t last_attempt = 0;
 
   if(!settings.mqtt_enabled)
   {
@@ -1928,12 +3079,13 @@ void mqtt_reconnect(void)
   }
 
   //Nur alle 30 Sekunden neu versuchen
-  if((millis() - last_attempt) < 30000UL)
+  if((rtc_clock_mono_ms() - last_attempt) < 30000UL)
   {
     return;
   }
 
-  last_attempt = millis();
+  last_attempt = rtc_clock_mono_ms();
+  wifi_ps_traffic();
   mqtt_connect();
 }
 
@@ -1968,6 +3120,14 @@ void mqtt_publish_sensors(void)
   mqttClient.publish(topic, chip_id, true, 0); //retained, damit immer verfügbar
   */
   
+  //Zeitstempel des Messwerts (Unix-Zeit UTC), nur mit gueltiger Uhrzeit
+  if(rtc_clock_valid())
+  {
+    sprintf(topic, "%s/%s/timestamp", settings.mqtt_topic_prefix, device_id);
+    sprintf(value, "%lu", (unsigned long)rtc_clock_to_utc(sample_ms));
+    mqttClient.publish(topic, value, false, 0);
+  }
+
   //CO2
   sprintf(topic, "%s/%s/co2", settings.mqtt_topic_prefix, device_id);
   sprintf(value, "%d", co2_value);
@@ -1996,7 +3156,7 @@ void mqtt_publish_sensors(void)
     mqttClient.publish(topic, value, false, 0);
   }
 
-  if(features & FEATURE_USB)
+  if(serial_text())
   {
     Serial.print("MQTT published to ");
     Serial.print(settings.mqtt_topic_prefix);
@@ -2006,10 +3166,21 @@ void mqtt_publish_sensors(void)
 }
 
 
-void mqtt_service(void)
+static uint32_t mqtt_next_ms(void) //Zeit bis zum naechsten Publish, 0xFFFFFFFF = keiner geplant
 {
-  static unsigned long last_publish = 0;
+  uint64_t elapsed = rtc_clock_mono_ms() - mqtt_last_publish;
+  uint32_t interval = settings.mqtt_interval * 1000UL;
+
+  if(!settings.mqtt_enabled || ((features & FEATURE_WINC1500) == 0) || !mqttClient.connected())
+  {
+    return 0xFFFFFFFFUL;
+  }
+  return (elapsed < interval) ? (uint32_t)(interval - elapsed) : 0;
+}
+
 
+void mqtt_service(void)
+{
   if(!settings.mqtt_enabled)
   {
     return;
@@ -2031,9 +3202,10 @@ void mqtt_service(void)
   }
 
   //Periodisches Publishing
-  if((millis() - last_publish) > (settings.mqtt_interval * 1000UL))
+  if((rtc_clock_mono_ms() - mqtt_last_publish) > (settings.mqtt_interval * 1000UL))
   {
-    last_publish = millis();
+    mqtt_last_publish = rtc_clock_mono_ms();
+    wifi_ps_traffic(); //Funk wach bis zu den ACKs
     mqtt_publish_sensors();
   }
 }
@@ -2042,6 +3214,8 @@ void mqtt_service(void)
 void setup()
 {
   int run_menu=0;
+  uint8_t pres_addr=ADDR_LPS22HB;
+  uint16_t co2_last;
 
   //setze Pins
   pinMode(6, INPUT_PULLUP); //PA08 SDA1
@@ -2067,13 +3241,43 @@ void setup()
   {
     run_menu = 1;
   }
+  rtc_clock_begin(); //RTC als Uhr (64 Bit, laeuft auch im Standby)
+  button_begin(PIN_SWITCH); //Taster-Interrupt + Entprellung (Ticker 1kHz)
+  buzzer_seq_begin(PIN_BUZZER); //Buzzer an TCC0 (Tonfolgen im Ticker)
+  ambient_begin(PIN_LSENSOR, PIN_LSENSOR_PWR); //Lichtsensor (ADC mit Mittelung)
+
+  //Einstellungen (vor den LEDs: Farben, Grenzwerte, Helligkeit)
+  settings_state = settings_load(&settings); //Einstellungen lesen (CRC, Version)
+  if(settings_state != SETTINGS_OK)
+  {
+    settings_write(&settings); //neue bzw. migrierte Einstellungen speichern
+  }
+  ambient_config(settings.light_dark, settings.light_bright, settings.light_interval);
+  settings_http_begin(settings_items, settings_items_count, web_settings_ctx); //Web: /settings, /api/settings
+  boot_mark("settings");
 
-  //WS2812
+  //WS2812: letzte Ampelstufe aus dem Flash sofort anzeigen, sonst weiss bis zur ersten Messung
   ws2812.begin();
-  ws2812.setBrightness(HELLIGKEIT); //0...255
-  ws2812.fill(FARBE_AUS, 0, NUM_LEDS); //LEDs aus
-  ws2812.fill(ws2812.Color(20,20,20), 0, 4); //4 LEDs weiss
-  ws2812.show();
+  ws2812.setBrightness(settings.brightness); //0...255
+  #if LED_DMA
+  led_anim_begin(&ws2812, LED_TYP, ws2812_show, ws2812.isDMA()); //Animationen (Ticker 100Hz)
+  #else
+  led_anim_begin(&ws2812, LED_TYP, ws2812_show, false); //Bit-Banging nur aus loop() (led_anim_service)
+  #endif
+  if(band_store_read(&co2_last))
+  {
+    co2_value = co2_average = co2_last;
+    band_saved = ampel_band(co2_last);
+    ampel(co2_last);
+  }
+  else
+  {
+    co2_value = co2_average = STARTWERT;
+    ws2812.fill(FARBE_AUS, 0, NUM_LEDS); //LEDs aus
+    ws2812.fill(ws2812.Color(20,20,20), 0, 4); //4 LEDs weiss
+    ws2812.show();
+  }
+  boot_mark("leds");
 
   //Wire/I2C
   Wire.begin();
@@ -2081,20 +3285,25 @@ void setup()
   Wire1.begin();
   Wire1.setClock(100000); //100kHz ATECC+LPS22HB+BMP280
 
-  //serielle Schnittstelle (USB)
+  //serielle Schnittstelle (USB), Startmeldung erst am Ende des Starts (boot_service)
   Serial.begin(BAUDRATE); //seriellen Port starten
-  Serial.setTimeout(500); //500ms Timeout beim Lesen
-  //while(!Serial); //warten auf USB-Verbindung
-
-  delay(250); //250ms warten
+  if(USBDevice.connected()) //(Serial) nutzt Flow-Control zur Erkennung
+  {
+    features |= FEATURE_USB;
+  }
 
-  if(WiFi.status() != WL_NO_SHIELD) //ATWINC1500 gefunden
+  //beide Busse einmal absuchen, die Treiber werden aus der Geraeteliste gebunden
+  i2c_scan(I2C_BUS0);
+  while(!i2c_scan_found(I2C_BUS0, ADDR_SCD30) && !i2c_scan_found(I2C_BUS0, ADDR_SCD4X) && (millis() < CO2_ANLAUF))
   {
-    features |= FEATURE_WINC1500;
+    delay(50); //CO2-Sensor noch im Anlauf
+    i2c_scan(I2C_BUS0);
   }
+  i2c_scan(I2C_BUS1);
+  boot_mark("i2c");
 
   //LPS22HB
-  if(check_i2c(SERCOM2, ADDR_LPS22HB)) //LPS22HB gefunden
+  if(i2c_scan_found(I2C_BUS1, ADDR_LPS22HB)) //LPS22HB gefunden
   {
     if(lps22.begin())
     {
@@ -2103,23 +3312,25 @@ void setup()
   }
 
   //BMP280
-  if(check_i2c(SERCOM2, ADDR_BMP280)) //BMP280 gefunden
+  if(i2c_scan_found(I2C_BUS1, ADDR_BMP280)) //BMP280 gefunden
   {
     if(bmp280.begin(ADDR_BMP280))
     {
       features |= FEATURE_BMP280;
+      pres_addr = ADDR_BMP280;
     }
   }
-  else if(check_i2c(SERCOM2, ADDR_BMP280+1)) //BMP280 gefunden
+  else if(i2c_scan_found(I2C_BUS1, ADDR_BMP280+1)) //BMP280 gefunden
   {
     if(bmp280.begin(ADDR_BMP280+1))
     {
       features |= FEATURE_BMP280;
+      pres_addr = ADDR_BMP280+1;
     }
   }
 
-  //SCD30+SCD4X
-  if(check_i2c(SERCOM0, ADDR_SCD30)) //SCD30 gefunden
+  //SCD30+SCD4X, Temperaturoffset
+  if(i2c_scan_found(I2C_BUS0, ADDR_SCD30)) //SCD30 gefunden
   {
     for(int t=5; t!=0; t--) //try 5 times
     {
@@ -2133,129 +3344,77 @@ void setup()
     }
     scd30.setMeasurementInterval(INTERVALL); //setze Messintervall
     //scd30.setAmbientPressure(1000); //0 oder 700-1400, Luftdruck in hPa
+    if(features & FEATURE_SCD30)
+    {
+      float offset = scd30.getTemperatureOffset();
+      temp_offset = offset;
+      if(settings_state == SETTINGS_DEFAULTS) //Standard Temperaturoffset (Pro mit WiFi und Drucksensor)
+      {
+        temp_offset = TEMP_OFFSET;
+        if((offset == 0) || (offset > 12))
+        {
+          scd30.setTemperatureOffset(temp_offset);
+        }
+      }
+    }
   }
-  if(check_i2c(SERCOM0, ADDR_SCD4X)) //SCD4X gefunden
+  if(i2c_scan_found(I2C_BUS0, ADDR_SCD4X)) //SCD4X gefunden
   {
     for(int t=5; t!=0; t--) //try 5 times
     {
+      float offset;
       Wire.begin();
       scd4x.begin(Wire);
-      scd4x.stopPeriodicMeasurement();
-      delay(100);
-      if(scd4x.startPeriodicMeasurement() == 0)
+      //nach dem Einschalten ist der Sensor im Idle, der Offset ist ohne Wartezeit lesbar
+      if(scd4x.getTemperatureOffset(offset) != 0) //Messung laeuft noch (Reset ohne Stromausfall)
       {
-        features |= FEATURE_SCD4X;
-        break;
+        scd4x.stopPeriodicMeasurement();
+        delay(500); //stop_periodic_measurement braucht 500ms
+        if(scd4x.getTemperatureOffset(offset) != 0)
+        {
+          status_led(1000); //Status-LED
+          continue;
+        }
       }
-      status_led(1000); //Status-LED
-    }
-  }
-
-  //Temperaturoffset
-  if(features & FEATURE_SCD30)
-  {
-    temp_offset = scd30.getTemperatureOffset();
-  }
-  else if(features & FEATURE_SCD4X)
-  {
-    float offset;
-    scd4x.stopPeriodicMeasurement();
-    delay(500);
-    if(scd4x.getTemperatureOffset(offset) == 0)
-    {
       temp_offset = offset;
-    }
-    delay(500);
-    scd4x.startPeriodicMeasurement();
-  }
-  if(temp_offset >= 20)
-  {
-    temp_offset = TEMP_OFFSET;
-  }
-
-  //Einstellungen
-  settings_read(&settings); //Einstellungen lesen
-  if((settings.valid == false) || (settings.brightness > 255) || (settings.range[0] < 100))
-  {
-    settings.serial_output = false;
-    settings.brightness   = HELLIGKEIT;
-    settings.range[0]     = DEFAULT_T1;
-    settings.range[1]     = DEFAULT_T2;
-    settings.range[2]     = DEFAULT_T3;
-    settings.range[3]     = DEFAULT_T4;
-    settings.range[4]     = DEFAULT_T5;
-    settings.buzzer       = BUZZER;
-    settings.wifi_ssid[0] = 0;
-    strcpy(settings.wifi_ssid, WIFI_SSID);
-    settings.wifi_code[0] = 0;
-    strcpy(settings.wifi_code, WIFI_CODE);
-
-    //MQTT Standardeinstellungen
-    settings.mqtt_enabled = MQTT_ENABLED;
-    settings.mqtt_broker[0] = 0;
-    strcpy(settings.mqtt_broker, MQTT_BROKER);
-    settings.mqtt_port = MQTT_PORT;
-    settings.mqtt_user[0] = 0;
-    strcpy(settings.mqtt_user, MQTT_USER);
-    settings.mqtt_pass[0] = 0;
-    strcpy(settings.mqtt_pass, MQTT_PASS);
-    settings.mqtt_client_id[0] = 0;
-    strcpy(settings.mqtt_client_id, MQTT_CLIENT_ID);
-    settings.mqtt_topic_prefix[0] = 0;
-    strcpy(settings.mqtt_topic_prefix, MQTT_TOPIC_PREFIX);
-    settings.mqtt_interval = MQTT_INTERVAL;
-
-    //LED Color Defaults
-    settings.color_t1   = DEFAULT_COLOR_T1;
-    settings.color_t2  = DEFAULT_COLOR_T2;
-    settings.color_t3 = DEFAULT_COLOR_T3;
-    settings.color_t4    = DEFAULT_COLOR_T4;
-    settings.valid        = true;
-    settings_write(&settings);
-    //Standard Temperaturoffset (always Pro with WiFi and pressure sensor)
-    temp_offset = TEMP_OFFSET;
-    if(features & FEATURE_SCD30)
-    {
-      float offset;
-      offset = scd30.getTemperatureOffset();
-      if((offset == 0) || (offset > 12))
+      if(settings_state == SETTINGS_DEFAULTS) //Standard Temperaturoffset (Pro mit WiFi und Drucksensor)
       {
-        scd30.setTemperatureOffset(temp_offset); //Temperaturoffset
+        temp_offset = TEMP_OFFSET;
+        if((offset == 0) || (offset > 12))
+        {
+          scd4x.setTemperatureOffset(temp_offset);
+        }
       }
-    }
-    else if(features & FEATURE_SCD4X)
-    {
-      float offset;
-      scd4x.getTemperatureOffset(offset);
-      if((offset == 0) || (offset > 12))
+      scd4x_variant = scd4x_get_variant();
+      if((scd4x_variant == SCD4X_SCD40) && (settings.power_profile == PROFIL_SINGLE_SHOT))
+      {
+        settings.power_profile = PROFIL_LOW_POWER; //SCD40: kein Single-Shot
+      }
+      if(scd4x_start() == 0) //Messung gleich im Modus des Stromsparprofils starten
       {
-        scd4x.setTemperatureOffset(temp_offset); //Temperaturoffset
+        features |= FEATURE_SCD4X;
+        scd4x_cmd_begin(I2C_BUS0, ADDR_SCD4X); //Befehle waehrend laufender Messung
+        break;
       }
+      status_led(1000); //Status-LED
     }
   }
-  else
+  if(temp_offset >= 20)
   {
-    if(settings.serial_output > 1)
-    {
-      settings.serial_output = true;
-    }
+    temp_offset = TEMP_OFFSET;
   }
-  ws2812.setBrightness(settings.brightness); //0...255
 
-  //USB-Verbindung
-  if(USBDevice.connected()) //(Serial) nutzt Flow-Control zur Erkennung
+  //Sensoren asynchron auslesen (DMA), Bibliotheken nur noch mit i2c_async_lock()
+  //Abfrage nur zum erwarteten Messzeitpunkt (Data-Ready), kein Warten auf die erste Messung
+  if(features & FEATURE_SCD30)
   {
-    features |= FEATURE_USB;
-    delay(1500); //1500ms warten
-    Serial.println("\nCO2 Ampel Pro NG v" VERSION);
-    Serial.print("Features:");
-    if(features & FEATURE_SCD30)    { Serial.print(" SCD30"); }
-    if(features & FEATURE_SCD4X)    { Serial.print(" SCD4X"); }
-    if(features & FEATURE_LPS22HB)  { Serial.print(" LPS22HB"); }
-    if(features & FEATURE_BMP280)   { Serial.print(" BMP280"); }
-    if(features & FEATURE_WINC1500) { Serial.print(" WINC1500"); }
-    Serial.println("\n");
+    sensor_async_rdy_pin(SCD30_RDY_PIN);
   }
+  sensor_async_begin((features & FEATURE_SCD30) ? SENSOR_SCD30 : (features & FEATURE_SCD4X) ? SENSOR_SCD4X : SENSOR_NONE,
+                     (features & FEATURE_SCD30) ? INTERVALL : INTERVALL_SCD4X,
+                     (features & FEATURE_LPS22HB) ? SENSOR_LPS22HB : (features & FEATURE_BMP280) ? SENSOR_BMP280 : SENSOR_NONE,
+                     pres_addr);
+  boot_mark("sensors");
 
   //Service-Menue
   if(run_menu)
@@ -2263,66 +3422,10 @@ void setup()
     menu(); //Menue aufrufen
   }
 
-  //Plus-Version
-  if(features & FEATURE_WINC1500)
-  {
-    if(WiFi.status() != WL_NO_SHIELD) //ATWINC1500 gefunden
-    {
-      if(wifi_start() != 0) //verbinde WiFi Netzwerk
-      {
-        if(wifi_start_ap() != 0) //starte AP
-        {
-          features &= ~FEATURE_WINC1500;
-        }
-      }
-      delay(2000); //2s warten
-      if(features & FEATURE_USB)
-      {
-        String fv = WiFi.firmwareVersion();
-        Serial.print("WINC1500 Firmware: ");
-        Serial.println(fv);
-        byte mac[6];
-        WiFi.macAddress(mac);
-        Serial.print("MAC: ");
-        Serial.print(mac[5], HEX); Serial.print(":"); Serial.print(mac[4], HEX); Serial.print(":"); Serial.print(mac[3], HEX); Serial.print(":");
-        Serial.print(mac[2], HEX); Serial.print(":"); Serial.print(mac[1], HEX); Serial.print(":"); Serial.print(mac[0], HEX); Serial.println("");
-        IPAddress ip;
-        ip = WiFi.localIP();
-        Serial.print("IP: "); print_ip_address_line(ip);
-        ip = WiFi.subnetMask();
-        Serial.print("NM: "); print_ip_address_line(ip);
-        ip = WiFi.gatewayIP();
-        Serial.print("GW: "); print_ip_address_line(ip);
-        Serial.println("");
-      }
-      //MQTT verbinden
-      if(settings.mqtt_enabled)
-      {
-        delay(1000); //1s warten
-        mqtt_connect();
-      }
-    }
-    else
-    {
-      features &= ~FEATURE_WINC1500;
-      WiFi.end();
-    }
-  }
-
   //Messung starten
-  co2_value = co2_average = STARTWERT;
-  if(features & FEATURE_SCD30)
-  {
-    scd30.setMeasurementInterval(INTERVALL); //setze Messintervall
-    delay(INTERVALL*1000UL); //Intervallsekunden warten
-  }
-  else if(features & FEATURE_SCD4X)
+  if((features & (FEATURE_SCD30|FEATURE_SCD4X)) == 0)
   {
-    //Intervall 5s
-  }
-  else
-  {
-    if(features & FEATURE_USB)
+    if(serial_text())
     {
       Serial.println("Error: CO2 sensor not found");
     }
@@ -2331,6 +3434,12 @@ void setup()
     leds(FARBE_AUS);
     co2_value = co2_average = settings.range[2]; // Set to red threshold
   }
+  power_profile(false); //Stromsparprofil anwenden, SCD4X laeuft schon im richtigen Modus
+
+  ambient_enable(true); //Lichtsensor-Abtastung starten (Ticker)
+
+  //WiFi und MQTT verbinden danach in loop() (boot_service), waehrenddessen wird gemessen
+  boot_mark("setup");
 
   return;
 }
@@ -2338,58 +3447,91 @@ void setup()
 
 void ampel(unsigned int co2)
 {
-  static unsigned int blinken=0;
+  unsigned int pattern=0;
 
-  //LEDs
+  //LEDs (Ueberblenden/Blinken laeuft im Ticker, unabhaengig vom 1s-Takt)
   if(co2 < settings.range[0]) //blau (very fresh air)
   {
-    blinken = 0;
-    leds(settings.color_t1);
+    led_anim_fade(settings.color_t1, AMPEL_FADE_MS);
   }
   else if(co2 < settings.range[1]) //gruen (good)
   {
-    blinken = 0;
-    leds(settings.color_t2);
+    led_anim_fade(settings.color_t2, AMPEL_FADE_MS);
   }
   else if(co2 < settings.range[2]) //gelb (warning)
   {
-    blinken = 0;
-    leds(settings.color_t3);
+    led_anim_fade(settings.color_t3, AMPEL_FADE_MS);
   }
   else if(co2 < settings.range[3]) //rot (alert)
   {
-    blinken = 0;
-    leds(settings.color_t4);
+    led_anim_fade(settings.color_t4, AMPEL_FADE_MS);
   }
   else //rot blinken (critical - blinking)
   {
-    if(blinken == 0)
-    {
-      leds(ws2812.Color(10,0,0)); //rot schwache Helligkeit
-    }
-    else
-    {
-      leds(settings.color_t4); //rot
-    }
-    blinken = 1-blinken; //invertieren
+    #if AMPEL_ATMEN > 0
+      led_anim_breathe(settings.color_t4, 10000/AMPEL_BLINK_DHZ);
+    #else
+      led_anim_blink(settings.color_t4, ws2812.Color(10,0,0), AMPEL_BLINK_DHZ); //rot / rot schwache Helligkeit
+    #endif
   }
 
-  //Buzzer
-  if(co2 < settings.range[4])
+  //Buzzer (Muster je CO2-Stufe, Takt im Ticker)
+  if(co2 >= settings.range[4])
   {
-    buzzer(0); //Buzzer aus
+    pattern = settings.buzzer_pattern[2];
   }
-  else
+  else if(co2 >= settings.range[3])
   {
-    if((blinken == 0) && (buzzer_timer == 0) && settings.buzzer)
-    {
-      buzzer(1); //Buzzer an
-    }
-    else
-    {
-      buzzer(0); //Buzzer aus
-    }
+    pattern = settings.buzzer_pattern[1];
+  }
+  else if(co2 >= settings.range[2])
+  {
+    pattern = settings.buzzer_pattern[0];
+  }
+  if((buzzer_timer > 0) || (settings.buzzer == 0))
+  {
+    pattern = 0;
+  }
+  buzzer_pattern(pattern);
+
+  return;
+}
+
+
+uint8_t ampel_band(unsigned int co2) //Ampelstufe 0-4 wie in ampel()
+{
+  uint8_t band=0;
+
+  while((band < 4) && (co2 >= settings.range[band]))
+  {
+    band++;
+  }
+
+  return band;
+}
+
+
+void band_save(unsigned int co2) //Ampelstufe fuer den naechsten Start sichern (band_store)
+{
+  static uint64_t t_save=0;
+  uint8_t band;
+
+  if((sample_ms == 0) || ((features & (FEATURE_SCD30|FEATURE_SCD4X)) == 0))
+  {
+    return; //nur echte Messwerte
+  }
+  band = ampel_band(co2);
+  if(band == band_saved)
+  {
+    return;
   }
+  if((t_save != 0) && ((rtc_clock_mono_ms() - t_save) < (BAND_SPEICHERN*1000UL)))
+  {
+    return; //Flash schonen, Stufe springt an der Grenze hin und her
+  }
+  t_save = rtc_clock_mono_ms();
+  band_saved = band;
+  band_store_write(co2);
 
   return;
 }
@@ -2397,11 +3539,17 @@ void ampel(unsigned int co2)
 
 void loop()
 {
-  static unsigned int dark=0, sw=0;
-  static unsigned long t_switch=0, t_ampel=0, t_light=~((LICHT_INTERVALL*1000UL*60UL)-60000UL); //Lichtsensor nach 60s pruefen
-  static unsigned long t_wifi=0;
+  static unsigned int dark=0;
+  static uint64_t t_ampel=0; //rtc_clock_mono_ms(), laeuft nicht ueber
+  static uint64_t t_wifi=0;
   unsigned int overwrite=0;
 
+  //Stromsparen: Standby bis zum naechsten Ereignis
+  power_save(t_ampel);
+
+  //von der Animation berechnetes Bild senden (nur ohne DMA, sonst sendet der Ticker)
+  led_anim_service();
+
   //serielle Befehle verarbeiten
   serial_service();
 
@@ -2411,16 +3559,22 @@ void loop()
   //MQTT-Daten verarbeiten
   mqtt_service();
 
-  if(features & FEATURE_WINC1500)
+  //Startablauf (WiFi, MQTT) fortsetzen
+  if(boot_state != BOOT_FERTIG)
+  {
+    boot_service();
+  }
+
+  if((features & FEATURE_WINC1500) && (boot_state > BOOT_WIFI))
   {
     int wifi_status = WiFi.status();
-    if((wifi_status != WL_CONNECTED) && (wifi_status != WL_AP_LISTENING))
+    if((wifi_status != WL_CONNECTED) && !wifi_ap_mode(wifi_status))
     {
       if(settings.wifi_ssid[0] != 0)
       {
-        if((millis() - t_wifi) > 30000)
+        if((rtc_clock_mono_ms() - t_wifi) > 30000)
         {
-          t_wifi = millis();
+          t_wifi = rtc_clock_mono_ms();
           if(wifi_start() == 0 && settings.mqtt_enabled)
           {
             mqtt_connect();
@@ -2431,20 +3585,16 @@ void loop()
   }
 
   //Taster pruefen
-  if(digitalRead(PIN_SWITCH) == LOW) //Taster gedrueckt
+  button_event_t ev;
+  while(button_get(&ev))
   {
-    if(sw == 0)
+    if((ev.type == BUTTON_DOWN) || (ev.type == BUTTON_HOLD))
     {
-      sw = 1;
-      t_switch = millis(); //Zeit speichern
+      continue; //erst beim Loslassen auswerten
     }
-  }
-  else if(sw != 0) //Taster losgelassen
-  {
-    sw = 0;
     buzzer(0); //Buzzer aus
     buzzer_timer = BUZZER_DELAY; //Buzzer Startverzögerung
-    if((millis()-t_switch) > 3000) //3s Tastendruck
+    if((ev.type == BUTTON_LONG) && (ev.duration_ms > 3000)) //3s Tastendruck
     {
       if(features & FEATURE_WINC1500)
       {
@@ -2452,21 +3602,33 @@ void loop()
         wifi_start_ap();
       }
     }
-    else if((millis()-t_switch) > 100) //100ms Tastendruck
+    else if(ev.duration_ms > 100) //100ms Tastendruck
     {
       settings.brightness = settings.brightness/2; //Helligkeit halbieren
       if(settings.brightness < HELLIGKEIT_DUNKEL)
       {
         settings.brightness = HELLIGKEIT;
       }
-      ws2812.setBrightness(settings.brightness);
+      led_anim_brightness(settings.brightness);
       overwrite = 1;
     }
   }
 
-  if((millis()-t_ampel) > 1000) //Ampelfunktion nur jede Sekunde ausfuehren
+  //Sensordaten auslesen (jeder neue Messwert genau einmal)
+  if(check_sensors())
+  {
+    boot_mark("co2");
+    show_data();
+    events_service(); //sofort, nicht erst nach dem naechsten Standby
+    if(dark == 0)
+    {
+      status_led(2); //Status-LED
+    }
+  }
+
+  if((rtc_clock_mono_ms()-t_ampel) > 1000) //Ampelfunktion nur jede Sekunde ausfuehren
   {
-    t_ampel = millis(); //Zeit speichern
+    t_ampel = rtc_clock_mono_ms(); //Zeit speichern
 
     if(buzzer_timer > 0)
     {
@@ -2483,59 +3645,51 @@ void loop()
     //  features &= ~FEATURE_USB;
     //}
 
-    //Sensordaten auslesen
-    if(check_sensors())
-    {
-      show_data();
-      if(dark == 0)
-      {
-        status_led(2); //Status-LED
-      }
-    }
-
     co2_average = (co2_average + co2_sensor()) / 2; //Berechnung jede Sekunde
+
+    //Uhrzeit abgleichen
+    time_sync();
   }
   else if(overwrite == 0)
   {
     return;
   }
 
-  //Ampel
-  if(remote_on == 0)
+  //Ampel (ohne gesicherte Stufe bleiben die LEDs bis zur ersten Messung weiss)
+  if((remote_on == 0) && ((sample_ms != 0) || (band_saved != 0xFF) || ((features & (FEATURE_SCD30|FEATURE_SCD4X)) == 0)))
   {
     #if AMPEL_DURCHSCHNITT > 0
       ampel(co2_average);
+      band_save(co2_average);
     #else
       ampel(co2_value);
+      band_save(co2_value);
     #endif
   }
 
-  //Lichtsensor
-  if(remote_on == 0)
+  //Lichtsensor (Abtastung im Ticker, geglaettet mit Hysterese)
+  uint16_t light;
+  bool light_dark;
+  if(ambient_poll(&light, &light_dark))
   {
-    if((millis()-t_light) > (LICHT_INTERVALL*1000UL*60UL))
+    light_value = light;
+    if(light_dark)
     {
-      t_light = millis(); //Zeit speichern
-
-      light_value = light_sensor();
-      if(light_value < LICHT_DUNKEL)
+      if(dark == 0)
       {
-        if(dark == 0)
+        dark = 1;
+        if(settings.brightness > HELLIGKEIT_DUNKEL)
         {
-          dark = 1;
-          if(settings.brightness > HELLIGKEIT_DUNKEL)
-          {
-            ws2812.setBrightness(HELLIGKEIT_DUNKEL); //dunkel
-          }
+          led_anim_brightness(HELLIGKEIT_DUNKEL); //dunkel
         }
       }
-      else
+    }
+    else
+    {
+      if(dark == 1)
       {
-        if(dark == 1)
-        {
-          dark = 0;
-          ws2812.setBrightness(settings.brightness); //hell
-        }
+        dark = 0;
+        led_anim_brightness(settings.brightness); //hell
       }
     }
   }
@@ -0,0 +1,104 @@
+#include "power.h"
+#include "rtc_clock.h"
+
+extern "C" void SysTick_DefaultHandler(void); // Arduino core: millis() + 1
+
+static bool pwr_ready = false;
+static uint32_t pwr_window_ms = 0;
+static uint32_t pwr_standby_ms = 0;
+static uint32_t pwr_wakeups = 0;
+
+static void gclk_sync(void)
+{
+  while(GCLK->STATUS.bit.SYNCBUSY);
+}
+
+static void eic_sync(void)
+{
+  while(EIC->STATUS.bit.SYNCBUSY);
+}
+
+void power_begin(void)
+{
+  if(pwr_ready)
+  {
+    return;
+  }
+
+  rtc_clock_begin(); // RTC and GCLK6 (OSC32K, runs in STANDBY)
+
+  // EIC: its clock may only change while it is disabled. The pin configuration is kept.
+  EIC->CTRL.bit.ENABLE = 0;
+  eic_sync();
+  GCLK->CLKCTRL.reg = GCLK_CLKCTRL_ID_EIC | GCLK_CLKCTRL_GEN(RTC_CLOCK_GCLK) | GCLK_CLKCTRL_CLKEN;
+  gclk_sync();
+  EIC->CTRL.bit.ENABLE = 1;
+  eic_sync();
+
+  // Errata: the NVM must not power down in STANDBY, otherwise the wakeup may fail.
+  NVMCTRL->CTRLB.bit.SLEEPPRM = NVMCTRL_CTRLB_SLEEPPRM_DISABLED_Val;
+
+  pwr_ready = true;
+}
+
+uint32_t power_standby(uint32_t ms)
+{
+  uint32_t start, slept;
+
+  if(!pwr_ready || (ms < POWER_MIN_MS))
+  {
+    return 0;
+  }
+  if(ms > 3600000UL)
+  {
+    ms = 3600000UL;
+  }
+
+  start = rtc_clock_ticks();
+  rtc_clock_alarm(start + ((ms * RTC_CLOCK_HZ) / 1000));
+  EIC->WAKEUP.reg = EIC->INTENSET.reg; // every enabled pin interrupt ends the pause
+
+  SCB->SCR |= SCB_SCR_SLEEPDEEP_Msk;
+  __DSB();
+  __WFI();
+  SCB->SCR &= ~SCB_SCR_SLEEPDEEP_Msk;
+
+  rtc_clock_alarm_off();
+  slept = ((rtc_clock_ticks() - start) * 1000UL) / RTC_CLOCK_HZ;
+
+  // SysTick was stopped with the CPU clock: catch up on the lost milliseconds.
+  // SysTick must not tick in between, but one lock over a long pause (up to
+  // 3.6 million calls) would stall USB, WINC1500 and ticker, so interrupts
+  // are served between the batches.
+  for(uint32_t done = 0; done < slept; )
+  {
+    uint32_t n = ((slept - done) > POWER_CATCHUP) ? POWER_CATCHUP : (slept - done);
+
+    noInterrupts();
+    for(uint32_t i = 0; i < n; i++)
+    {
+      SysTick_DefaultHandler();
+    }
+    interrupts();
+    done += n;
+  }
+
+  pwr_standby_ms += slept;
+  pwr_wakeups++;
+
+  return slept;
+}
+
+void power_get_stats(power_stats_t *stats)
+{
+  uint32_t now = millis();
+  uint32_t window = now - pwr_window_ms;
+
+  stats->standby_ms = pwr_standby_ms;
+  stats->active_ms = (window > pwr_standby_ms) ? (window - pwr_standby_ms) : 0;
+  stats->wakeups = pwr_wakeups;
+
+  pwr_window_ms = now;
+  pwr_standby_ms = 0;
+  pwr_wakeups = 0;
+}
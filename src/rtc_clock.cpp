@@ -0,0 +1,189 @@
+#include "rtc_clock.h"
+
+static bool clk_ready = false;
+static volatile uint32_t clk_hi = 0; // counter overflows
+
+// UTC(mono) = sync_utc + (mono - sync_mono) * (1 + drift), all in ms
+static bool clk_valid = false;
+static uint64_t clk_sync_mono = 0;
+static uint64_t clk_sync_utc = 0;
+static uint64_t clk_base_mono = 0; // start of the drift measurement
+static uint64_t clk_base_utc = 0;
+static int32_t clk_drift = 0;
+static bool clk_drift_valid = false;
+static int32_t clk_step = 0;
+static uint32_t clk_syncs = 0;
+
+static void gclk_sync(void)
+{
+  while(GCLK->STATUS.bit.SYNCBUSY);
+}
+
+static void rtc_sync(void)
+{
+  while(RTC->MODE0.STATUS.bit.SYNCBUSY);
+}
+
+void RTC_Handler(void)
+{
+  uint8_t flags = RTC->MODE0.INTFLAG.reg;
+
+  if(flags & RTC_MODE0_INTFLAG_OVF)
+  {
+    clk_hi++;
+  }
+  RTC->MODE0.INTFLAG.reg = flags; // CMP0 only wakes the MCU
+}
+
+static uint64_t rtc_ticks64(void)
+{
+  uint32_t hi, lo;
+
+  noInterrupts();
+  lo = RTC->MODE0.COUNT.reg;
+  hi = clk_hi;
+  if(RTC->MODE0.INTFLAG.bit.OVF && (lo < 0x80000000UL)) // overflow not handled yet
+  {
+    hi++;
+  }
+  interrupts();
+
+  return ((uint64_t)hi << 32) | lo;
+}
+
+static uint64_t utc_ms(uint64_t mono)
+{
+  int64_t d = (int64_t)(mono - clk_sync_mono);
+
+  return clk_sync_utc + d + ((d * clk_drift) / 1000000);
+}
+
+void rtc_clock_begin(void)
+{
+  if(clk_ready)
+  {
+    return;
+  }
+
+  // GCLK6 = OSC32K, kept running in STANDBY
+  SYSCTRL->OSC32K.bit.RUNSTDBY = 1;
+  GCLK->GENDIV.reg = GCLK_GENDIV_ID(RTC_CLOCK_GCLK) | GCLK_GENDIV_DIV(1);
+  gclk_sync();
+  GCLK->GENCTRL.reg = GCLK_GENCTRL_ID(RTC_CLOCK_GCLK) | GCLK_GENCTRL_SRC_OSC32K | GCLK_GENCTRL_GENEN | GCLK_GENCTRL_RUNSTDBY;
+  gclk_sync();
+
+  PM->APBAMASK.reg |= PM_APBAMASK_RTC;
+  GCLK->CLKCTRL.reg = GCLK_CLKCTRL_ID_RTC | GCLK_CLKCTRL_GEN(RTC_CLOCK_GCLK) | GCLK_CLKCTRL_CLKEN;
+  gclk_sync();
+  RTC->MODE0.CTRL.reg = RTC_MODE0_CTRL_SWRST;
+  rtc_sync();
+  RTC->MODE0.CTRL.reg = RTC_MODE0_CTRL_MODE_COUNT32 | RTC_MODE0_CTRL_PRESCALER_DIV32;
+  rtc_sync();
+  RTC->MODE0.READREQ.reg = RTC_READREQ_RCONT | RTC_READREQ_RREQ; // COUNT readable without waiting
+  rtc_sync();
+  RTC->MODE0.INTENCLR.reg = RTC_MODE0_INTENCLR_MASK;
+  RTC->MODE0.INTFLAG.reg = RTC_MODE0_INTFLAG_MASK;
+  RTC->MODE0.INTENSET.reg = RTC_MODE0_INTENSET_OVF;
+  RTC->MODE0.CTRL.bit.ENABLE = 1;
+  rtc_sync();
+
+  NVIC_ClearPendingIRQ(RTC_IRQn);
+  NVIC_SetPriority(RTC_IRQn, 3);
+  NVIC_EnableIRQ(RTC_IRQn);
+
+  clk_ready = true;
+}
+
+uint64_t rtc_clock_mono_ms(void)
+{
+  if(!clk_ready)
+  {
+    return millis();
+  }
+
+  return (rtc_ticks64() * 1000) / RTC_CLOCK_HZ;
+}
+
+uint32_t rtc_clock_ticks(void)
+{
+  return RTC->MODE0.COUNT.reg;
+}
+
+void rtc_clock_alarm(uint32_t ticks)
+{
+  RTC->MODE0.COMP[0].reg = ticks;
+  rtc_sync();
+  RTC->MODE0.INTFLAG.reg = RTC_MODE0_INTFLAG_CMP0;
+  RTC->MODE0.INTENSET.reg = RTC_MODE0_INTENSET_CMP0;
+}
+
+void rtc_clock_alarm_off(void)
+{
+  RTC->MODE0.INTENCLR.reg = RTC_MODE0_INTENCLR_CMP0;
+}
+
+void rtc_clock_sync(uint32_t unix_s)
+{
+  uint64_t mono = rtc_clock_mono_ms();
+  uint64_t utc = ((uint64_t)unix_s * 1000) + 500; // the server time is truncated to full seconds
+
+  if(!clk_valid)
+  {
+    clk_base_mono = mono;
+    clk_base_utc = utc;
+  }
+  else
+  {
+    int64_t span = (int64_t)(mono - clk_base_mono);
+
+    clk_step = (int32_t)((int64_t)utc - (int64_t)utc_ms(mono));
+    if(span >= (RTC_CLOCK_DRIFT_MIN * 1000LL))
+    {
+      int64_t err = (int64_t)(utc - clk_base_utc) - span;
+      int32_t ppm = (int32_t)((err * 1000000) / span);
+
+      if((ppm > -RTC_CLOCK_DRIFT_MAX) && (ppm < RTC_CLOCK_DRIFT_MAX))
+      {
+        // The server time only has 1 s resolution: average over several syncs.
+        clk_drift = clk_drift_valid ? (((3 * clk_drift) + ppm) / 4) : ppm;
+        clk_drift_valid = true;
+      }
+      // else: the server time jumped, start a new measurement
+      clk_base_mono = mono;
+      clk_base_utc = utc;
+    }
+  }
+
+  clk_sync_mono = mono;
+  clk_sync_utc = utc;
+  clk_valid = true;
+  clk_syncs++;
+}
+
+bool rtc_clock_valid(void)
+{
+  return clk_valid;
+}
+
+uint32_t rtc_clock_utc(void)
+{
+  return rtc_clock_to_utc(rtc_clock_mono_ms());
+}
+
+uint32_t rtc_clock_to_utc(uint64_t mono_ms)
+{
+  if(!clk_valid)
+  {
+    return 0;
+  }
+
+  return utc_ms(mono_ms) / 1000;
+}
+
+void rtc_clock_get_stats(rtc_clock_stats_t *stats)
+{
+  stats->syncs = clk_syncs;
+  stats->age_s = clk_valid ? (uint32_t)((rtc_clock_mono_ms() - clk_sync_mono) / 1000) : RTC_CLOCK_UNSYNCED;
+  stats->drift_ppm = clk_drift;
+  stats->last_step_ms = clk_step;
+}
@@ -0,0 +1,116 @@
+#include "scd4x_cmd.h"
+#include "i2c_async.h"
+#include "sensor_async.h"
+
+typedef struct
+{
+  uint16_t cmd;
+  uint16_t arg;
+  uint8_t exec_ms; // execution time from the data sheet
+} scd4x_cmd_t;
+
+#define CMD_SET_AMBIENT_PRESSURE  0xE000
+
+static uint8_t cmd_bus = 0;
+static uint8_t cmd_addr = 0;
+static bool cmd_ready = false;
+static scd4x_cmd_t cmd_queue[SCD4X_CMD_QUEUE];
+static uint8_t cmd_head = 0;
+static uint8_t cmd_tail = 0;
+static i2c_txn_t cmd_txn;
+static uint8_t cmd_buf[5];
+static volatile bool cmd_pending = false;
+static volatile uint32_t cmd_errors = 0;
+
+static void cmd_done(i2c_txn_t *t)
+{
+  if(t->status != I2C_ASYNC_OK)
+  {
+    cmd_errors++;
+  }
+  cmd_pending = false;
+}
+
+static bool cmd_push(uint16_t cmd, uint16_t arg, uint8_t exec_ms)
+{
+  // Same command already waiting: only the newest argument matters.
+  for(uint8_t i = cmd_head; i != cmd_tail; i = (i + 1) & (SCD4X_CMD_QUEUE - 1))
+  {
+    if(cmd_queue[i].cmd == cmd)
+    {
+      cmd_queue[i].arg = arg;
+      return true;
+    }
+  }
+
+  uint8_t next = (cmd_tail + 1) & (SCD4X_CMD_QUEUE - 1);
+  if(next == cmd_head)
+  {
+    return false;
+  }
+  cmd_queue[cmd_tail].cmd = cmd;
+  cmd_queue[cmd_tail].arg = arg;
+  cmd_queue[cmd_tail].exec_ms = exec_ms;
+  cmd_tail = next;
+
+  return true;
+}
+
+void scd4x_cmd_begin(uint8_t bus, uint8_t addr)
+{
+  cmd_bus = bus;
+  cmd_addr = addr;
+  cmd_head = cmd_tail = 0;
+  cmd_pending = false;
+  cmd_ready = true;
+}
+
+bool scd4x_cmd_set_ambient_pressure(uint16_t hpa)
+{
+  bool ok = cmd_push(CMD_SET_AMBIENT_PRESSURE, hpa, 1);
+
+  scd4x_cmd_service();
+
+  return ok;
+}
+
+void scd4x_cmd_service(void)
+{
+  if(!cmd_ready || (cmd_head == cmd_tail) || cmd_pending)
+  {
+    return;
+  }
+
+  scd4x_cmd_t *c = &cmd_queue[cmd_head];
+  cmd_buf[0] = c->cmd >> 8;
+  cmd_buf[1] = c->cmd & 0xFF;
+  cmd_buf[2] = c->arg >> 8;
+  cmd_buf[3] = c->arg & 0xFF;
+  cmd_buf[4] = sensirion_crc8(&cmd_buf[2]);
+
+  cmd_txn.addr = cmd_addr;
+  cmd_txn.wbuf = cmd_buf;
+  cmd_txn.wlen = 5;
+  cmd_txn.delay_ms = c->exec_ms;
+  cmd_txn.rbuf = NULL;
+  cmd_txn.rlen = 0;
+  cmd_txn.done = cmd_done;
+
+  cmd_pending = true;
+  if(!i2c_async_submit(cmd_bus, &cmd_txn))
+  {
+    cmd_pending = false; // bus queue full, retry on the next call
+    return;
+  }
+  cmd_head = (cmd_head + 1) & (SCD4X_CMD_QUEUE - 1);
+}
+
+bool scd4x_cmd_busy(void)
+{
+  return cmd_pending;
+}
+
+uint32_t scd4x_cmd_errors(void)
+{
+  return cmd_errors;
+}
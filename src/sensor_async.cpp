@@ -0,0 +1,569 @@
+#include "sensor_async.h"
+#include "i2c_async.h"
+#include "ticker.h"
+
+#include <string.h>
+
+#define ADDR_SCD30   0x61
+#define ADDR_SCD4X   0x62
+#define ADDR_LPS22HB 0x5C
+
+static uint8_t co2_type = SENSOR_NONE;
+static uint8_t pres_type = SENSOR_NONE;
+
+// CO2 sensor (I2C_BUS0)
+static i2c_txn_t co2_txn;
+static uint8_t co2_cmd[2];
+static uint8_t co2_buf[18];
+static volatile bool co2_busy = false;
+static volatile bool co2_new = false;
+static volatile bool co2_ready = false;  // data-ready seen (RDY pin or status word)
+static volatile bool co2_retry = false;  // last check came too early
+static co2_sample_t co2_sample;
+static uint32_t co2_period = 0;          // ms between two samples of the sensor
+static volatile uint32_t co2_anchor = 0; // estimated time of the last sample
+static volatile uint32_t co2_wakeup = 0; // next data-ready check (single shot: next trigger)
+static bool co2_single = false;          // SCD41 single-shot mode
+static volatile bool co2_shot = false;   // single shot triggered, result pending
+static int8_t co2_rdy_pin = -1;
+
+// Pressure sensor (I2C_BUS1)
+static i2c_txn_t pres_txn;
+static uint8_t pres_cmd[2];
+static uint8_t pres_buf[24];
+static uint8_t pres_raw[6];
+static volatile bool pres_busy = false;
+static volatile bool pres_new = false;
+static bool pres_due = false;
+static bool pres_valid = false;
+static pres_sample_t pres_sample;
+static uint32_t pres_t = 0;
+
+// BMP280 calibration (NVM 0x88...0x9F)
+static bool bmp_calib = false;
+static uint16_t dig_T1, dig_P1;
+static int16_t dig_T2, dig_T3, dig_P2, dig_P3, dig_P4, dig_P5, dig_P6, dig_P7, dig_P8, dig_P9;
+
+static volatile uint32_t sensor_samples = 0;
+static volatile uint32_t sensor_checks = 0;
+static volatile uint32_t sensor_errors = 0;
+
+uint8_t sensirion_crc8(const uint8_t *data)
+{
+  uint8_t crc = 0xFF;
+
+  for(uint8_t i = 0; i < 2; i++)
+  {
+    crc ^= data[i];
+    for(uint8_t bit = 0; bit < 8; bit++)
+    {
+      crc = (crc & 0x80) ? ((crc << 1) ^ 0x31) : (crc << 1);
+    }
+  }
+
+  return crc;
+}
+
+// Checks and compacts n Sensirion words (2 bytes + CRC each) in place.
+static bool sensirion_words(uint8_t *buf, uint8_t n)
+{
+  for(uint8_t i = 0; i < n; i++)
+  {
+    if(sensirion_crc8(&buf[i * 3]) != buf[(i * 3) + 2])
+    {
+      return false;
+    }
+    buf[(i * 2) + 0] = buf[(i * 3) + 0];
+    buf[(i * 2) + 1] = buf[(i * 3) + 1];
+  }
+
+  return true;
+}
+
+static uint16_t be16(const uint8_t *p)
+{
+  return ((uint16_t)p[0] << 8) | p[1];
+}
+
+static void txn_setup(i2c_txn_t *t, uint8_t addr, const uint8_t *w, uint8_t wlen, uint16_t delay_ms,
+                      uint8_t *r, uint8_t rlen, i2c_done_fn done)
+{
+  t->addr = addr;
+  t->wbuf = w;
+  t->wlen = wlen;
+  t->delay_ms = delay_ms;
+  t->rbuf = r;
+  t->rlen = rlen;
+  t->done = done;
+}
+
+static void co2_cmd_set(uint16_t cmd)
+{
+  co2_cmd[0] = cmd >> 8;
+  co2_cmd[1] = cmd & 0xFF;
+}
+
+static void co2_fail(void)
+{
+  sensor_errors++;
+  co2_busy = false;
+}
+
+// New data signalled by the status word. The sample was taken after the
+// previous (not ready) check; if the first check was already ready, the
+// anchor is moved one step back so the next wakeup probes a bit earlier
+// and the schedule follows the clock drift of the sensor.
+static void co2_sync(void)
+{
+  uint32_t now = millis();
+
+  co2_anchor = co2_retry ? now : (now - SENSOR_ASYNC_STEP_MS);
+  co2_retry = false;
+  co2_ready = true;
+}
+
+// --- SCD30: get data ready (0x0202), read measurement (0x0300) ---
+
+static void scd30_read_done(i2c_txn_t *t)
+{
+  uint32_t u;
+
+  if((t->status != I2C_ASYNC_OK) || !sensirion_words(co2_buf, 6))
+  {
+    co2_fail();
+    return;
+  }
+
+  // Big-endian IEEE754 floats: CO2, temperature, humidity
+  u = ((uint32_t)be16(&co2_buf[0]) << 16) | be16(&co2_buf[2]);
+  float co2;
+  memcpy(&co2, &u, sizeof(co2));
+  u = ((uint32_t)be16(&co2_buf[4]) << 16) | be16(&co2_buf[6]);
+  memcpy(&co2_sample.temp, &u, sizeof(float));
+  u = ((uint32_t)be16(&co2_buf[8]) << 16) | be16(&co2_buf[10]);
+  memcpy(&co2_sample.humi, &u, sizeof(float));
+  co2_sample.co2 = co2;
+
+  sensor_samples++;
+  co2_new = true;
+  co2_busy = false;
+}
+
+static void scd30_ready_done(i2c_txn_t *t)
+{
+  if((t->status != I2C_ASYNC_OK) || !sensirion_words(co2_buf, 1))
+  {
+    co2_fail();
+    return;
+  }
+  if(be16(co2_buf) != 1)
+  {
+    co2_retry = true; // no new data yet
+    co2_busy = false;
+    return;
+  }
+
+  co2_sync();
+  co2_busy = false;
+}
+
+static void scd30_read(void)
+{
+  co2_cmd_set(0x0300);
+  txn_setup(&co2_txn, ADDR_SCD30, co2_cmd, 2, 3, co2_buf, 18, scd30_read_done);
+}
+
+// --- SCD4x: get_data_ready_status (0xE4B8), read_measurement (0xEC05) ---
+
+static void scd4x_read_done(i2c_txn_t *t)
+{
+  if((t->status != I2C_ASYNC_OK) || !sensirion_words(co2_buf, 3))
+  {
+    co2_fail();
+    return;
+  }
+
+  co2_sample.co2 = be16(&co2_buf[0]);
+  co2_sample.temp = -45.0f + (175.0f * be16(&co2_buf[2]) / 65536.0f);
+  co2_sample.humi = 100.0f * be16(&co2_buf[4]) / 65536.0f;
+
+  sensor_samples++;
+  co2_new = true;
+  co2_busy = false;
+}
+
+static void scd4x_ready_done(i2c_txn_t *t)
+{
+  if((t->status != I2C_ASYNC_OK) || !sensirion_words(co2_buf, 1))
+  {
+    co2_fail();
+    return;
+  }
+  if((be16(co2_buf) & 0x07FF) == 0)
+  {
+    co2_retry = true; // no new data yet
+    co2_busy = false;
+    return;
+  }
+
+  co2_sync();
+  co2_busy = false;
+}
+
+static void scd4x_read(void)
+{
+  co2_cmd_set(0xEC05);
+  txn_setup(&co2_txn, ADDR_SCD4X, co2_cmd, 2, 1, co2_buf, 9, scd4x_read_done);
+}
+
+static void scd4x_shot_done(i2c_txn_t *t)
+{
+  if(t->status != I2C_ASYNC_OK)
+  {
+    co2_fail();
+    return;
+  }
+
+  co2_shot = true;
+  co2_retry = true; // the sample is taken within the measurement time
+  co2_wakeup = millis() + SENSOR_SCD4X_SHOT_MS;
+  co2_busy = false;
+}
+
+static void co2_rdy_isr(void)
+{
+  co2_anchor = millis();
+  co2_retry = false;
+  co2_ready = true;
+}
+
+// Data-ready check, or the measurement read once the sensor has signalled new data.
+// In single-shot mode the measurement is triggered first.
+static void co2_start(bool read)
+{
+  if(co2_single && !co2_shot && !read)
+  {
+    co2_cmd_set(0x219D); // measure_single_shot
+    txn_setup(&co2_txn, ADDR_SCD4X, co2_cmd, 2, 0, NULL, 0, scd4x_shot_done);
+  }
+  else if(read)
+  {
+    if(co2_type == SENSOR_SCD30)
+    {
+      scd30_read();
+    }
+    else
+    {
+      scd4x_read();
+    }
+  }
+  else
+  {
+    sensor_checks++;
+    if(co2_type == SENSOR_SCD30)
+    {
+      co2_cmd_set(0x0202);
+      txn_setup(&co2_txn, ADDR_SCD30, co2_cmd, 2, 3, co2_buf, 3, scd30_ready_done);
+    }
+    else
+    {
+      co2_cmd_set(0xE4B8);
+      txn_setup(&co2_txn, ADDR_SCD4X, co2_cmd, 2, 1, co2_buf, 3, scd4x_ready_done);
+    }
+  }
+
+  co2_busy = true;
+  if(!i2c_async_submit(I2C_BUS0, &co2_txn))
+  {
+    co2_busy = false;
+  }
+}
+
+// --- LPS22HB: one-shot (CTRL_REG2 = ONE_SHOT | IF_ADD_INC), burst 0x28...0x2C ---
+
+static void pres_done(i2c_txn_t *t)
+{
+  if(t->status != I2C_ASYNC_OK)
+  {
+    sensor_errors++;
+  }
+  else
+  {
+    memcpy(pres_raw, pres_buf, 6);
+    pres_new = true;
+  }
+  pres_busy = false;
+}
+
+static void lps22_oneshot_done(i2c_txn_t *t)
+{
+  if(t->status != I2C_ASYNC_OK)
+  {
+    sensor_errors++;
+    pres_busy = false;
+    return;
+  }
+
+  pres_cmd[0] = 0x28; // PRESS_OUT_XL
+  txn_setup(&pres_txn, pres_txn.addr, pres_cmd, 1, 0, pres_buf, 5, pres_done);
+  if(!i2c_async_submit(I2C_BUS1, &pres_txn))
+  {
+    pres_busy = false;
+  }
+}
+
+// --- BMP280: calibration 0x88 (24 bytes) once, then burst 0xF7...0xFC (normal mode) ---
+
+static void bmp280_calib_done(i2c_txn_t *t)
+{
+  if(t->status == I2C_ASYNC_OK)
+  {
+    const uint8_t *c = pres_buf;
+    dig_T1 = c[0] | (c[1] << 8);
+    dig_T2 = c[2] | (c[3] << 8);
+    dig_T3 = c[4] | (c[5] << 8);
+    dig_P1 = c[6] | (c[7] << 8);
+    dig_P2 = c[8] | (c[9] << 8);
+    dig_P3 = c[10] | (c[11] << 8);
+    dig_P4 = c[12] | (c[13] << 8);
+    dig_P5 = c[14] | (c[15] << 8);
+    dig_P6 = c[16] | (c[17] << 8);
+    dig_P7 = c[18] | (c[19] << 8);
+    dig_P8 = c[20] | (c[21] << 8);
+    dig_P9 = c[22] | (c[23] << 8);
+    bmp_calib = true;
+  }
+  else
+  {
+    sensor_errors++;
+  }
+  pres_busy = false;
+}
+
+static void pres_start(void)
+{
+  pres_busy = true;
+  if(pres_type == SENSOR_LPS22HB)
+  {
+    pres_cmd[0] = 0x11; // CTRL_REG2
+    pres_cmd[1] = 0x11; // IF_ADD_INC | ONE_SHOT
+    txn_setup(&pres_txn, pres_txn.addr, pres_cmd, 2, SENSOR_LPS22HB_ONESHOT, NULL, 0, lps22_oneshot_done);
+  }
+  else if(!bmp_calib)
+  {
+    pres_cmd[0] = 0x88;
+    txn_setup(&pres_txn, pres_txn.addr, pres_cmd, 1, 0, pres_buf, 24, bmp280_calib_done);
+  }
+  else
+  {
+    pres_cmd[0] = 0xF7; // PRESS_MSB
+    txn_setup(&pres_txn, pres_txn.addr, pres_cmd, 1, 0, pres_buf, 6, pres_done);
+  }
+  if(!i2c_async_submit(I2C_BUS1, &pres_txn))
+  {
+    pres_busy = false;
+  }
+}
+
+// Integer compensation from the BMP280 data sheet (pressure in Q24.8 Pa).
+static void bmp280_compensate(const uint8_t *raw, pres_sample_t *s)
+{
+  int32_t adc_P = ((int32_t)raw[0] << 12) | ((int32_t)raw[1] << 4) | (raw[2] >> 4);
+  int32_t adc_T = ((int32_t)raw[3] << 12) | ((int32_t)raw[4] << 4) | (raw[5] >> 4);
+  int32_t v1, v2, t_fine;
+  int64_t p1, p2, p;
+
+  v1 = ((((adc_T >> 3) - ((int32_t)dig_T1 << 1))) * ((int32_t)dig_T2)) >> 11;
+  v2 = (((((adc_T >> 4) - ((int32_t)dig_T1)) * ((adc_T >> 4) - ((int32_t)dig_T1))) >> 12) * ((int32_t)dig_T3)) >> 14;
+  t_fine = v1 + v2;
+  s->temp = ((t_fine * 5 + 128) >> 8) / 100.0f;
+
+  p1 = ((int64_t)t_fine) - 128000;
+  p2 = p1 * p1 * (int64_t)dig_P6;
+  p2 = p2 + ((p1 * (int64_t)dig_P5) << 17);
+  p2 = p2 + (((int64_t)dig_P4) << 35);
+  p1 = ((p1 * p1 * (int64_t)dig_P3) >> 8) + ((p1 * (int64_t)dig_P2) << 12);
+  p1 = (((((int64_t)1) << 47) + p1)) * ((int64_t)dig_P1) >> 33;
+  if(p1 == 0)
+  {
+    return; // avoid division by zero
+  }
+  p = 1048576 - adc_P;
+  p = (((p << 31) - p2) * 3125) / p1;
+  p1 = (((int64_t)dig_P9) * (p >> 13) * (p >> 13)) >> 25;
+  p2 = (((int64_t)dig_P8) * p) >> 19;
+  p = ((p + p1 + p2) >> 8) + (((int64_t)dig_P7) << 4);
+  s->pres = (uint32_t)p / 25600.0f; // Q24.8 Pa -> hPa
+}
+
+void sensor_async_begin(uint8_t co2, uint16_t co2_period_s, uint8_t pres, uint8_t pres_addr)
+{
+  co2_type = co2;
+  pres_type = pres;
+  co2_period = co2_period_s * 1000UL;
+  co2_wakeup = millis(); // phase unknown: check right away, then every step
+
+  if(co2_type != SENSOR_NONE)
+  {
+    if(!i2c_async_begin(I2C_BUS0))
+    {
+      co2_type = SENSOR_NONE;
+    }
+  }
+  if(pres_type != SENSOR_NONE)
+  {
+    pres_txn.addr = (pres_type == SENSOR_LPS22HB) ? ADDR_LPS22HB : pres_addr;
+    if(!i2c_async_begin(I2C_BUS1))
+    {
+      pres_type = SENSOR_NONE;
+    }
+  }
+}
+
+void sensor_async_mode(uint16_t co2_period_s, bool single_shot)
+{
+  ticker_lock();
+  co2_period = co2_period_s * 1000UL;
+  co2_single = single_shot && (co2_type == SENSOR_SCD4X);
+  co2_shot = false;
+  co2_retry = false;
+  co2_wakeup = millis();
+  ticker_unlock();
+}
+
+uint32_t sensor_async_idle_ms(void)
+{
+  uint32_t now = millis();
+  int32_t left;
+
+  if(co2_busy || co2_ready || co2_new || pres_busy || pres_due)
+  {
+    return 0;
+  }
+  if(co2_type == SENSOR_NONE)
+  {
+    left = (int32_t)((pres_t + SENSOR_ASYNC_PRES_MS) - now);
+  }
+  else
+  {
+    left = (int32_t)(co2_wakeup - now);
+  }
+
+  return (left > 0) ? left : 0;
+}
+
+void sensor_async_rdy_pin(int8_t pin)
+{
+  co2_rdy_pin = pin;
+  if(pin < 0)
+  {
+    return;
+  }
+
+  pinMode(pin, INPUT);
+  attachInterrupt(digitalPinToInterrupt(pin), co2_rdy_isr, RISING);
+  if(digitalRead(pin) == HIGH) // edge already passed
+  {
+    co2_rdy_isr();
+  }
+}
+
+void sensor_async_poll(void)
+{
+  uint32_t now = millis();
+
+  if((co2_type != SENSOR_NONE) && !co2_busy && !co2_new)
+  {
+    if(co2_ready)
+    {
+      // Read each new sample exactly once and predict the next one. With the
+      // RDY pin the wakeup is only a fallback for a missed edge.
+      co2_ready = false;
+      if(co2_single)
+      {
+        co2_shot = false;
+        co2_wakeup = co2_anchor + co2_period - SENSOR_SCD4X_SHOT_MS;
+      }
+      else
+      {
+        co2_wakeup = co2_anchor + ((co2_rdy_pin < 0) ? co2_period : (2 * co2_period));
+      }
+      pres_due = true;
+      co2_start(true);
+    }
+    else if((int32_t)(now - co2_wakeup) >= 0)
+    {
+      co2_wakeup = now + SENSOR_ASYNC_STEP_MS; // next try if it is too early
+      co2_start(false);
+    }
+  }
+
+  if((pres_type != SENSOR_NONE) && !pres_busy)
+  {
+    if(co2_type == SENSOR_NONE)
+    {
+      pres_due = ((now - pres_t) >= SENSOR_ASYNC_PRES_MS);
+    }
+    if(pres_due)
+    {
+      // Once per CO2 sample, taken over with the next one.
+      pres_due = false;
+      pres_t = now;
+      pres_start();
+    }
+  }
+}
+
+bool sensor_async_co2(co2_sample_t *s)
+{
+  if(!co2_new)
+  {
+    return false;
+  }
+
+  // The sample is only rewritten by the next read, which is not started before co2_new is taken.
+  *s = co2_sample;
+  co2_new = false;
+
+  return true;
+}
+
+bool sensor_async_pres(pres_sample_t *s)
+{
+  if(pres_new)
+  {
+    uint8_t raw[6];
+
+    noInterrupts();
+    memcpy(raw, pres_raw, sizeof(raw));
+    pres_new = false;
+    interrupts();
+
+    if(pres_type == SENSOR_LPS22HB)
+    {
+      int32_t p = ((int32_t)raw[2] << 16) | ((int32_t)raw[1] << 8) | raw[0];
+      if(p & 0x800000)
+      {
+        p |= 0xFF000000; // sign extension
+      }
+      pres_sample.pres = p / 4096.0f;
+      pres_sample.temp = (int16_t)((raw[4] << 8) | raw[3]) / 100.0f;
+    }
+    else
+    {
+      bmp280_compensate(raw, &pres_sample);
+    }
+    pres_valid = true;
+  }
+
+  *s = pres_sample;
+
+  return pres_valid;
+}
+
+void sensor_async_get_stats(sensor_async_stats_t *stats)
+{
+  stats->samples = sensor_samples;
+  stats->checks = sensor_checks;
+  stats->errors = sensor_errors;
+}
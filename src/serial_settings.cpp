@@ -175,29 +175,57 @@ static void print_value(Print *out, const cfg_item_t *item)
       break;
     case CFG_IP:
       {
-        IPAddress *ip = (IPAddress *)item->ptr;
-        out->print((*ip)[0]);
+        uint32_t ip = *(uint32_t *)item->ptr;
+        out->print(ip & 0xFF);
         out->print(".");
-        out->print((*ip)[1]);
+        out->print((ip >> 8) & 0xFF);
         out->print(".");
-        out->print((*ip)[2]);
+        out->print((ip >> 16) & 0xFF);
         out->print(".");
-        out->print((*ip)[3]);
+        out->print(ip >> 24);
       }
       break;
   }
 }
 
-static const cfg_item_t *find_item(const cfg_item_t *items, size_t count, const char *key)
+static size_t item_size(const cfg_item_t *item)
 {
-  for(size_t i = 0; i < count; i++)
+  switch(item->type)
   {
-    if(strcasecmp(items[i].key, key) == 0)
-    {
-      return &items[i];
-    }
+    case CFG_U8:
+      return sizeof(uint8_t);
+    case CFG_U16:
+      return sizeof(uint16_t);
+    case CFG_U32:
+    case CFG_COLOR:
+      return sizeof(uint32_t);
+    case CFG_BOOL:
+      return sizeof(bool);
+    case CFG_STRING:
+      return item->max_len + 1;
+    case CFG_IP:
+      return sizeof(uint32_t);
   }
-  return NULL;
+  return 0;
+}
+
+// Where set writes the value: the staged copy while a transaction is open.
+static void *item_target(const serial_settings_ctx_t *ctx, const cfg_item_t *item)
+{
+  serial_settings_tx_t *tx = ctx->tx;
+
+  if((tx == NULL) || !tx->open)
+  {
+    return item->ptr;
+  }
+  return (char *)tx->stage + ((char *)item->ptr - (char *)tx->base);
+}
+
+// After a commit: true if the item differs from the value before.
+static bool tx_changed(const serial_settings_tx_t *tx, const cfg_item_t *item)
+{
+  size_t ofs = (char *)item->ptr - (char *)tx->base;
+  return memcmp((char *)tx->stage + ofs, item->ptr, item_size(item)) != 0;
 }
 
 static void print_error(Print *out, const char *msg)
@@ -217,6 +245,229 @@ static void print_ok(Print *out)
   }
 }
 
+const char *serial_settings_store(const serial_settings_ctx_t *ctx, const cfg_item_t *item, const cfg_value_t *v)
+{
+  void *target = item_target(ctx, item);
+
+  switch(item->type)
+  {
+    case CFG_U8:
+    case CFG_U16:
+    case CFG_U32:
+    case CFG_COLOR:
+      if(item->min_val <= item->max_val)
+      {
+        if(v->u < item->min_val || v->u > item->max_val)
+        {
+          return "Out of range";
+        }
+      }
+      if(item->type == CFG_U8)
+      {
+        *(uint8_t *)target = (uint8_t)v->u;
+      }
+      else if(item->type == CFG_U16)
+      {
+        *(uint16_t *)target = (uint16_t)v->u;
+      }
+      else
+      {
+        *(uint32_t *)target = (uint32_t)v->u;
+      }
+      break;
+    case CFG_BOOL:
+      *(bool *)target = (v->u != 0);
+      break;
+    case CFG_STRING:
+      {
+        if(v->s == NULL)
+        {
+          return "Invalid string";
+        }
+        size_t len = strlen(v->s);
+        if(item->max_len > 0 && len > item->max_len)
+        {
+          return "String too long";
+        }
+        strncpy((char *)target, v->s, item->max_len);
+        ((char *)target)[item->max_len] = 0;
+      }
+      break;
+    case CFG_IP:
+      *(uint32_t *)target = v->u;
+      break;
+  }
+
+  if(item->apply && (target == item->ptr)) // staged values are applied on commit
+  {
+    if(!item->apply(ctx->user, item))
+    {
+      return "Apply failed";
+    }
+  }
+
+  return NULL;
+}
+
+void serial_settings_load(const cfg_item_t *item, cfg_value_t *v)
+{
+  v->u = 0;
+  v->s = NULL;
+  switch(item->type)
+  {
+    case CFG_U8:
+      v->u = *(uint8_t *)item->ptr;
+      break;
+    case CFG_U16:
+      v->u = *(uint16_t *)item->ptr;
+      break;
+    case CFG_U32:
+    case CFG_COLOR:
+      v->u = *(uint32_t *)item->ptr;
+      break;
+    case CFG_BOOL:
+      v->u = *(bool *)item->ptr ? 1 : 0;
+      break;
+    case CFG_STRING:
+      v->s = (const char *)item->ptr;
+      break;
+    case CFG_IP:
+      v->u = *(uint32_t *)item->ptr;
+      break;
+  }
+}
+
+const char *serial_settings_parse(const cfg_item_t *item, const char *text, cfg_value_t *v)
+{
+  v->u = 0;
+  v->s = NULL;
+  switch(item->type)
+  {
+    case CFG_U8:
+    case CFG_U16:
+    case CFG_U32:
+    case CFG_COLOR:
+      if(!parse_u32(text, &v->u))
+      {
+        return "Invalid number";
+      }
+      break;
+    case CFG_BOOL:
+      {
+        bool b = false;
+        if(!parse_bool(text, &b))
+        {
+          return "Invalid bool";
+        }
+        v->u = b ? 1 : 0;
+      }
+      break;
+    case CFG_STRING:
+      v->s = text;
+      break;
+    case CFG_IP:
+      {
+        IPAddress ip;
+        if(!parse_ip(text, &ip))
+        {
+          return "Invalid IP";
+        }
+        v->u = (uint32_t)ip[0] | ((uint32_t)ip[1] << 8) | ((uint32_t)ip[2] << 16) | ((uint32_t)ip[3] << 24);
+      }
+      break;
+  }
+  return NULL;
+}
+
+void serial_settings_print(Print *out, const cfg_item_t *item)
+{
+  print_value(out, item);
+}
+
+const char *serial_settings_begin(const serial_settings_ctx_t *ctx)
+{
+  if(ctx->tx == NULL)
+  {
+    return "Transactions not supported";
+  }
+  if(ctx->tx->open)
+  {
+    return "Transaction already open";
+  }
+
+  memcpy(ctx->tx->stage, ctx->tx->base, ctx->tx->size);
+  ctx->tx->open = true;
+  return NULL;
+}
+
+const char *serial_settings_commit(const serial_settings_ctx_t *ctx, const cfg_item_t *items, size_t item_count)
+{
+  serial_settings_tx_t *tx = ctx->tx;
+
+  if((tx == NULL) || !tx->open)
+  {
+    return "No transaction";
+  }
+  tx->open = false; // a failed commit discards the staged values
+
+  if(tx->validate)
+  {
+    const char *err = tx->validate(ctx->user, tx->stage);
+    if(err)
+    {
+      return err;
+    }
+  }
+
+  // Swap instead of copy: stage then holds the old values, so the
+  // changed items (and their apply hooks) can be found afterwards.
+  for(size_t k = 0; k < tx->size; k++)
+  {
+    char c = ((char *)tx->base)[k];
+    ((char *)tx->base)[k] = ((char *)tx->stage)[k];
+    ((char *)tx->stage)[k] = c;
+  }
+
+  size_t count = 0;
+  bool ok = true;
+  for(size_t i = 0; i < item_count; i++)
+  {
+    if(!tx_changed(tx, &items[i]))
+    {
+      continue;
+    }
+    count++;
+    if(items[i].apply == NULL)
+    {
+      continue;
+    }
+    bool done = false; // every hook runs once
+    for(size_t j = 0; j < i; j++)
+    {
+      if((items[j].apply == items[i].apply) && tx_changed(tx, &items[j]))
+      {
+        done = true;
+        break;
+      }
+    }
+    if(!done && !items[i].apply(ctx->user, &items[i]))
+    {
+      ok = false;
+    }
+  }
+  if(!ok)
+  {
+    return "Apply failed";
+  }
+
+  if((count > 0) && ctx->on_save && !ctx->on_save(ctx->user))
+  {
+    return "Save failed";
+  }
+
+  return NULL;
+}
+
 bool serial_settings_handle_line(char *line,
                                  const cfg_item_t *items,
                                  size_t item_count,
@@ -253,20 +504,22 @@ bool serial_settings_handle_line(char *line,
       arg[arg_len - 2] = 0;
     }
 
-    for(size_t i = 0; i < item_count; i++)
+    // The table is sorted, so all keys with the prefix follow each other.
+    size_t len = strlen(arg);
+    for(size_t i = cfg_key_lower_bound(items, item_count, arg); i < item_count; i++)
     {
       if(is_prefix)
       {
-        if(strncasecmp(items[i].key, arg, strlen(arg)) != 0)
+        if(strncasecmp(items[i].key, arg, len) != 0)
         {
-          continue;
+          break;
         }
       }
       else
       {
         if(strcasecmp(items[i].key, arg) != 0)
         {
-          continue;
+          break;
         }
       }
 
@@ -310,91 +563,26 @@ bool serial_settings_handle_line(char *line,
     trim_in_place(key);
     trim_in_place(value);
 
-    const cfg_item_t *item = find_item(items, item_count, key);
+    const cfg_item_t *item = cfg_key_find(items, item_count, key);
     if(item == NULL)
     {
       print_error(ctx->out, "Unknown key");
       return true;
     }
 
-    switch(item->type)
+    cfg_value_t v;
+    const char *err = serial_settings_parse(item, value, &v);
+    if(err)
     {
-      case CFG_U8:
-      case CFG_U16:
-      case CFG_U32:
-      case CFG_COLOR:
-        {
-          uint32_t parsed = 0;
-          if(!parse_u32(value, &parsed))
-          {
-            print_error(ctx->out, "Invalid number");
-            return true;
-          }
-          if(item->min_val <= item->max_val)
-          {
-            if(parsed < item->min_val || parsed > item->max_val)
-            {
-              print_error(ctx->out, "Out of range");
-              return true;
-            }
-          }
-          if(item->type == CFG_U8)
-          {
-            *(uint8_t *)item->ptr = (uint8_t)parsed;
-          }
-          else if(item->type == CFG_U16)
-          {
-            *(uint16_t *)item->ptr = (uint16_t)parsed;
-          }
-          else
-          {
-            *(uint32_t *)item->ptr = (uint32_t)parsed;
-          }
-        }
-        break;
-      case CFG_BOOL:
-        {
-          bool b = false;
-          if(!parse_bool(value, &b))
-          {
-            print_error(ctx->out, "Invalid bool");
-            return true;
-          }
-          *(bool *)item->ptr = b;
-        }
-        break;
-      case CFG_STRING:
-        {
-          size_t len = strlen(value);
-          if(item->max_len > 0 && len > item->max_len)
-          {
-            print_error(ctx->out, "String too long");
-            return true;
-          }
-          strncpy((char *)item->ptr, value, item->max_len);
-          ((char *)item->ptr)[item->max_len] = 0;
-        }
-        break;
-      case CFG_IP:
-        {
-          IPAddress ip;
-          if(!parse_ip(value, &ip))
-          {
-            print_error(ctx->out, "Invalid IP");
-            return true;
-          }
-          *(IPAddress *)item->ptr = ip;
-        }
-        break;
+      print_error(ctx->out, err);
+      return true;
     }
 
-    if(item->apply)
+    err = serial_settings_store(ctx, item, &v);
+    if(err)
     {
-      if(!item->apply(ctx->user, item))
-      {
-        print_error(ctx->out, "Apply failed");
-        return true;
-      }
+      print_error(ctx->out, err);
+      return true;
     }
 
     print_ok(ctx->out);
@@ -409,6 +597,12 @@ bool serial_settings_handle_line(char *line,
       return true;
     }
 
+    if(ctx->tx && ctx->tx->open)
+    {
+      print_error(ctx->out, "Transaction open");
+      return true;
+    }
+
     if(ctx->on_save)
     {
       if(ctx->on_save(ctx->user))
@@ -427,6 +621,48 @@ bool serial_settings_handle_line(char *line,
     return true;
   }
 
+  if(match_cmd(line, "begin", &arg))
+  {
+    if(!ctx->remote_on)
+    {
+      print_error(ctx->out, "Remote control not enabled");
+      return true;
+    }
+    const char *err = serial_settings_begin(ctx);
+    if(err)
+    {
+      print_error(ctx->out, err);
+      return true;
+    }
+    print_ok(ctx->out);
+    return true;
+  }
+
+  if(match_cmd(line, "abort", &arg))
+  {
+    if((ctx->tx == NULL) || !ctx->tx->open)
+    {
+      print_error(ctx->out, "No transaction");
+      return true;
+    }
+
+    ctx->tx->open = false;
+    print_ok(ctx->out);
+    return true;
+  }
+
+  if(match_cmd(line, "commit", &arg))
+  {
+    const char *err = serial_settings_commit(ctx, items, item_count);
+    if(err)
+    {
+      print_error(ctx->out, err);
+      return true;
+    }
+    print_ok(ctx->out);
+    return true;
+  }
+
   if(match_cmd(line, "dump", &arg))
   {
     for(size_t i = 0; i < item_count; i++)
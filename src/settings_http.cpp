@@ -0,0 +1,364 @@
+#include "settings_http.h"
+
+// Formats values with serial_settings_print() into the response.
+class conn_print : public Print
+{
+public:
+  conn_print(httpd_conn_t *c) : c(c) {}
+  size_t write(uint8_t b)
+  {
+    httpd_write(c, &b, 1);
+    return 1;
+  }
+  size_t write(const uint8_t *buf, size_t size)
+  {
+    httpd_write(c, buf, size);
+    return size;
+  }
+
+private:
+  httpd_conn_t *c;
+};
+
+typedef struct
+{
+  uint16_t next; // next item to render
+  bool html;
+} sh_ctx_t;
+
+static const cfg_item_t *sh_items = NULL;
+static size_t sh_count = 0;
+static void (*sh_get_ctx)(serial_settings_ctx_t *ctx) = NULL;
+
+static char sh_result[96]; // result of the POST for the page
+
+#define SH_READ_ONLY  "Read only, enable writes with set web.settings=1 over USB"
+
+static bool sh_secret(const cfg_item_t *item)
+{
+  size_t len = strlen(item->key);
+  return (len >= 5) && (strcmp(item->key + len - 5, ".pass") == 0);
+}
+
+static void sh_value(httpd_conn_t *c, const cfg_item_t *item, bool html)
+{
+  conn_print out(c);
+
+  if(sh_secret(item))
+  {
+    return;
+  }
+  if(item->type == CFG_STRING)
+  {
+    httpd_escaped(c, (const char *)item->ptr, html);
+  }
+  else
+  {
+    serial_settings_print(&out, item);
+  }
+}
+
+static void sh_json_item(httpd_conn_t *c, const cfg_item_t *item, bool first)
+{
+  cfg_value_t v;
+  bool quoted = (item->type == CFG_STRING) || (item->type == CFG_COLOR) || (item->type == CFG_IP);
+
+  httpd_printf(c, "%s\r\n \"%s\": ", first ? "" : ",", item->key);
+  if(item->type == CFG_BOOL)
+  {
+    serial_settings_load(item, &v);
+    httpd_print(c, v.u ? "true" : "false");
+    return;
+  }
+  if(quoted)
+  {
+    httpd_print(c, "\"");
+  }
+  sh_value(c, item, false);
+  if(quoted)
+  {
+    httpd_print(c, "\"");
+  }
+}
+
+static void sh_html_item(httpd_conn_t *c, const cfg_item_t *item)
+{
+  cfg_value_t v;
+
+  httpd_printf(c, "<tr><td>%s</td><td>", item->key);
+  switch(item->type)
+  {
+    case CFG_BOOL:
+      serial_settings_load(item, &v);
+      httpd_printf(c, "<select name='%s'><option value=0%s>0</option><option value=1%s>1</option></select>",
+                   item->key, v.u ? "" : " selected", v.u ? " selected" : "");
+      break;
+    case CFG_STRING:
+      if(sh_secret(item))
+      {
+        httpd_printf(c, "<input name='%s' type=password maxlength=%u placeholder='(unchanged)'>", item->key, (unsigned int)item->max_len);
+        break;
+      }
+      httpd_printf(c, "<input name='%s' maxlength=%u value='", item->key, (unsigned int)item->max_len);
+      sh_value(c, item, true);
+      httpd_print(c, "'>");
+      break;
+    case CFG_U8:
+    case CFG_U16:
+    case CFG_U32:
+      httpd_printf(c, "<input name='%s' type=number min=%lu max=%lu value='", item->key,
+                   (unsigned long)item->min_val, (unsigned long)item->max_val);
+      sh_value(c, item, true);
+      httpd_print(c, "'>");
+      break;
+    default: // color, IP
+      httpd_printf(c, "<input name='%s' value='", item->key);
+      sh_value(c, item, true);
+      httpd_print(c, "'>");
+      break;
+  }
+  httpd_print(c, "</td></tr>\r\n");
+}
+
+// Renders the items in parts, one per httpd_service().
+static bool sh_body(httpd_conn_t *c, void *ctx)
+{
+  sh_ctx_t *x = (sh_ctx_t *)ctx;
+
+  while((x->next < sh_count) && (httpd_space(c) >= SETTINGS_HTTP_LINE))
+  {
+    if(x->html)
+    {
+      sh_html_item(c, &sh_items[x->next]);
+    }
+    else
+    {
+      sh_json_item(c, &sh_items[x->next], x->next == 0);
+    }
+    x->next++;
+  }
+  if(x->next < sh_count)
+  {
+    return true;
+  }
+  if(x->html)
+  {
+    httpd_print(c,
+        "</table>\r\n" \
+        "<input type=submit value=Save>\r\n" \
+        "</form>\r\n" \
+        "</body>\r\n" \
+        "</html>\r\n"
+    );
+  }
+  else
+  {
+    httpd_print(c, "\r\n}\r\n");
+  }
+  return false;
+}
+
+// Writes are allowed when get_ctx sets remote_on (web.settings).
+static bool sh_writable(void)
+{
+  serial_settings_ctx_t ctx;
+
+  sh_get_ctx(&ctx);
+  return ctx.remote_on;
+}
+
+// Reads the POST body pair by pair into one transaction. bad gets the key
+// that failed. Returns NULL or the error message.
+static const char *sh_apply(httpd_conn_t *c, bool form, char *bad, size_t bad_size)
+{
+  serial_settings_ctx_t ctx;
+  char pair[SETTINGS_HTTP_PAIR];
+  char ch[2];
+  const char *err;
+  bool more = true;
+
+  bad[0] = 0;
+  sh_get_ctx(&ctx);
+  ctx.out = NULL;
+  err = serial_settings_begin(&ctx);
+  if(err)
+  {
+    return err; // a serial transaction is open
+  }
+
+  while(more && !err)
+  {
+    size_t n = 0;
+    bool too_long = false;
+
+    more = false;
+    while(httpd_read_body(c, ch, sizeof(ch)) == 1)
+    {
+      if(ch[0] == '&')
+      {
+        more = true;
+        break;
+      }
+      if(n < (sizeof(pair) - 1))
+      {
+        pair[n++] = ch[0];
+      }
+      else
+      {
+        too_long = true;
+      }
+    }
+    pair[n] = 0;
+    if(n == 0)
+    {
+      continue;
+    }
+
+    char *value = strchr(pair, '=');
+    if(value)
+    {
+      *value++ = 0;
+      httpd_urldecode(value);
+    }
+    httpd_urldecode(pair);
+    strncpy(bad, pair, bad_size - 1);
+    bad[bad_size - 1] = 0;
+
+    const cfg_item_t *item = cfg_key_find(sh_items, sh_count, pair);
+    cfg_value_t v;
+    if(!item)
+    {
+      err = "Unknown key";
+    }
+    else if(!value)
+    {
+      err = "Missing =";
+    }
+    else if(too_long)
+    {
+      err = "String too long";
+    }
+    else if(form && sh_secret(item) && (value[0] == 0))
+    {
+      continue; // password field left empty
+    }
+    else if((err = serial_settings_parse(item, value, &v)) == NULL)
+    {
+      err = serial_settings_store(&ctx, item, &v); // staged, checked against the range
+    }
+  }
+
+  if(err)
+  {
+    ctx.tx->open = false; // abort, nothing was changed
+    return err;
+  }
+  bad[0] = 0;
+  return serial_settings_commit(&ctx, sh_items, sh_count); // validate, apply, one save
+}
+
+void settings_http_begin(const cfg_item_t *items, size_t count, void (*get_ctx)(serial_settings_ctx_t *ctx))
+{
+  sh_items = items;
+  sh_count = count;
+  sh_get_ctx = get_ctx;
+}
+
+void settings_http_api(httpd_conn_t *c, const httpd_req_t *req)
+{
+  sh_ctx_t *x;
+
+  if((strcmp(req->method, "POST") == 0) && !sh_writable())
+  {
+    httpd_respond(c, 403, "application/json", NULL);
+    httpd_printf(c, "{\"ok\":false,\"error\":\"%s\"}\r\n", SH_READ_ONLY);
+    return; // the unread body is skipped by httpd
+  }
+  if(strcmp(req->method, "POST") == 0)
+  {
+    char bad[32];
+    const char *err = sh_apply(c, false, bad, sizeof(bad));
+
+    httpd_respond(c, err ? 400 : 200, "application/json", NULL);
+    if(err)
+    {
+      httpd_printf(c, "{\"ok\":false,\"error\":\"%s\",\"key\":\"", err);
+      httpd_escaped(c, bad, false);
+      httpd_print(c, "\"}\r\n");
+    }
+    else
+    {
+      httpd_print(c, "{\"ok\":true}\r\n");
+    }
+    return;
+  }
+
+  httpd_respond(c, 200, "application/json", "Cache-Control: no-cache\r\n");
+  httpd_print(c, "{");
+  x = (sh_ctx_t *)httpd_body(c, sh_body);
+  if(x)
+  {
+    x->html = false;
+  }
+}
+
+void settings_http_page(httpd_conn_t *c, const httpd_req_t *req)
+{
+  sh_ctx_t *x;
+  int status = 200;
+
+  sh_result[0] = 0;
+  if(!sh_writable())
+  {
+    snprintf(sh_result, sizeof(sh_result), "%s", SH_READ_ONLY);
+    if(strcmp(req->method, "POST") == 0)
+    {
+      status = 403;
+    }
+  }
+  else if(strcmp(req->method, "POST") == 0)
+  {
+    char bad[32];
+    const char *err = sh_apply(c, true, bad, sizeof(bad));
+    if(err)
+    {
+      snprintf(sh_result, sizeof(sh_result), "Error: %s %s", bad, err);
+    }
+    else
+    {
+      strcpy(sh_result, "Saved (WiFi changes after a reboot)");
+    }
+  }
+
+  httpd_respond(c, status, "text/html", "Cache-Control: no-cache\r\n");
+  httpd_print(c,
+      "<!DOCTYPE html>\r\n" \
+      "<html>\r\n" \
+      "<head>\r\n" \
+      "<meta charset=utf-8>\r\n" \
+      "<title>CO2-Ampel Settings</title>\r\n" \
+      "<link rel=icon href=\"data:image/gif;base64,R0lGODlhAQABAAAAACwAAAAAAQABAAA=\">\r\n" \
+      "<style>\r\n" \
+      "body { font-size:1.0em; font-family:Lato,sans-serif; padding:10px; }\r\n" \
+      "td { padding:2px 8px; }\r\n" \
+      "</style>\r\n" \
+      "</head>\r\n" \
+      "<body>\r\n" \
+      "<a href='/'>CO2-Ampel</a>\r\n"
+  );
+  if(sh_result[0])
+  {
+    httpd_print(c, "<p><b>");
+    httpd_escaped(c, sh_result, true);
+    httpd_print(c, "</b></p>\r\n");
+  }
+  httpd_print(c,
+      "<form method=post>\r\n" \
+      "<table>\r\n"
+  );
+  x = (sh_ctx_t *)httpd_body(c, sh_body);
+  if(x)
+  {
+    x->html = true;
+  }
+}
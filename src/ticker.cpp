@@ -0,0 +1,108 @@
+#include "ticker.h"
+
+typedef struct
+{
+  ticker_fn fn;
+  uint16_t period;
+  uint16_t count;
+} ticker_slot_t;
+
+static ticker_slot_t ticker_slots[TICKER_SLOTS];
+static volatile uint8_t ticker_used = 0;
+static bool ticker_started = false;
+static uint8_t ticker_lock_depth = 0;
+
+static void tc4_sync(void)
+{
+  while(TC4->COUNT16.STATUS.bit.SYNCBUSY);
+}
+
+void ticker_begin(void)
+{
+  if(ticker_started)
+  {
+    return;
+  }
+
+  PM->APBCMASK.reg |= PM_APBCMASK_TC4;
+  GCLK->CLKCTRL.reg = GCLK_CLKCTRL_ID_TC4_TC5 | GCLK_CLKCTRL_GEN_GCLK0 | GCLK_CLKCTRL_CLKEN;
+  while(GCLK->STATUS.bit.SYNCBUSY);
+
+  TC4->COUNT16.CTRLA.reg = TC_CTRLA_SWRST;
+  tc4_sync();
+  while(TC4->COUNT16.CTRLA.bit.SWRST);
+
+  // 48 MHz / 64 = 750 kHz, match on CC0 resets the counter (MFRQ)
+  TC4->COUNT16.CTRLA.reg = TC_CTRLA_MODE_COUNT16 | TC_CTRLA_WAVEGEN_MFRQ | TC_CTRLA_PRESCALER_DIV64;
+  tc4_sync();
+  TC4->COUNT16.CC[0].reg = (F_CPU / 64 / TICKER_HZ) - 1;
+  tc4_sync();
+  TC4->COUNT16.INTENSET.reg = TC_INTENSET_MC0;
+
+  NVIC_ClearPendingIRQ(TC4_IRQn);
+  NVIC_SetPriority(TC4_IRQn, 3);
+  NVIC_EnableIRQ(TC4_IRQn);
+
+  TC4->COUNT16.CTRLA.bit.ENABLE = 1;
+  tc4_sync();
+
+  ticker_started = true;
+}
+
+bool ticker_attach(ticker_fn fn, uint16_t period_ms)
+{
+  if(fn == NULL || ticker_used >= TICKER_SLOTS)
+  {
+    return false;
+  }
+
+  uint16_t period = (uint32_t)period_ms * TICKER_HZ / 1000;
+  if(period == 0)
+  {
+    period = 1;
+  }
+
+  ticker_lock();
+  ticker_slots[ticker_used].fn = fn;
+  ticker_slots[ticker_used].period = period;
+  ticker_slots[ticker_used].count = period;
+  ticker_used++;
+  ticker_unlock();
+
+  return true;
+}
+
+void ticker_lock(void)
+{
+  NVIC_DisableIRQ(TC4_IRQn);
+  __DSB();
+  __ISB();
+  ticker_lock_depth++;
+}
+
+void ticker_unlock(void)
+{
+  if(ticker_lock_depth > 0)
+  {
+    ticker_lock_depth--;
+  }
+  if(ticker_lock_depth == 0 && ticker_started)
+  {
+    NVIC_EnableIRQ(TC4_IRQn);
+  }
+}
+
+void TC4_Handler(void)
+{
+  TC4->COUNT16.INTFLAG.reg = TC_INTFLAG_MC0;
+
+  for(uint8_t i = 0; i < ticker_used; i++)
+  {
+    ticker_slot_t *s = &ticker_slots[i];
+    if(--s->count == 0)
+    {
+      s->count = s->period;
+      s->fn();
+    }
+  }
+}
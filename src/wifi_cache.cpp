@@ -0,0 +1,99 @@
+#include "wifi_cache.h"
+#include "binframe.h"
+
+#define CACHE_WORDS  (sizeof(wifi_cache_t) / 4)
+
+static_assert(sizeof(wifi_cache_t) == 32, "wifi_cache_t must be half a flash page");
+
+static int cache_next = -1; // next free slot, -1 = row not scanned yet
+
+static const volatile uint32_t *cache_slot(int i)
+{
+  return (const volatile uint32_t *)WIFI_CACHE_ADDR + (i * CACHE_WORDS);
+}
+
+static bool cache_empty(int i)
+{
+  const volatile uint32_t *p = cache_slot(i);
+
+  for(uint8_t w = 0; w < CACHE_WORDS; w++)
+  {
+    if(p[w] != 0xFFFFFFFFUL)
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+static uint16_t cache_crc(const wifi_cache_t *e)
+{
+  return binframe_crc16((const uint8_t *)e, offsetof(wifi_cache_t, crc));
+}
+
+static void cache_scan(void)
+{
+  cache_next = WIFI_CACHE_SLOTS;
+  for(int i = 0; i < WIFI_CACHE_SLOTS; i++)
+  {
+    if(cache_empty(i))
+    {
+      cache_next = i;
+      break;
+    }
+  }
+}
+
+bool wifi_cache_read(wifi_cache_t *entry)
+{
+  if(cache_next < 0)
+  {
+    cache_scan();
+  }
+  for(int i = cache_next - 1; i >= 0; i--) // newest first, skips interrupted writes
+  {
+    memcpy(entry, (const void *)cache_slot(i), sizeof(wifi_cache_t));
+    if(entry->crc == cache_crc(entry))
+    {
+      return true;
+    }
+  }
+  return false;
+}
+
+void wifi_cache_write(const wifi_cache_t *entry)
+{
+  wifi_cache_t e, last;
+  uint32_t words[CACHE_WORDS];
+
+  e = *entry;
+  e.crc = cache_crc(&e);
+  if(wifi_cache_read(&last) && (memcmp(&last, &e, sizeof(e)) == 0))
+  {
+    return; // unchanged, no flash write
+  }
+  memcpy(words, &e, sizeof(words));
+
+  __disable_irq();
+  if(cache_next >= WIFI_CACHE_SLOTS)
+  {
+    NVMCTRL->ADDR.reg = WIFI_CACHE_ADDR / 2;
+    NVMCTRL->CTRLA.reg = NVMCTRL_CTRLA_CMDEX_KEY | NVMCTRL_CTRLA_CMD_ER;
+    while(!NVMCTRL->INTFLAG.bit.READY);
+    cache_next = 0;
+  }
+
+  // Page buffer is all 0xFF after PBC, so only the new entry is programmed
+  NVMCTRL->CTRLA.reg = NVMCTRL_CTRLA_CMDEX_KEY | NVMCTRL_CTRLA_CMD_PBC;
+  while(!NVMCTRL->INTFLAG.bit.READY);
+  volatile uint32_t *dst = (volatile uint32_t *)cache_slot(cache_next);
+  for(uint8_t w = 0; w < CACHE_WORDS; w++)
+  {
+    dst[w] = words[w];
+  }
+  NVMCTRL->CTRLA.reg = NVMCTRL_CTRLA_CMDEX_KEY | NVMCTRL_CTRLA_CMD_WP;
+  while(!NVMCTRL->INTFLAG.bit.READY);
+  __enable_irq();
+
+  cache_next++;
+}
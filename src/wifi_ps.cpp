@@ -0,0 +1,117 @@
+#include "wifi_ps.h"
+
+typedef enum
+{
+  PS_STOPPED = 0,
+  PS_AWAKE,
+  PS_LIGHT,
+  PS_SLEEP
+} ps_level_t;
+
+static wifi_ps_mode_t ps_mode = WIFI_PS_OFF;
+static uint8_t ps_listen = 1;
+static ps_level_t ps_level = PS_STOPPED;
+static uint32_t ps_since = 0;   // millis() of the last accounting
+static uint32_t ps_traffic = 0; // millis() of the last traffic
+static uint32_t ps_ms[4];
+static uint32_t ps_switches = 0;
+
+static void ps_account(void)
+{
+  uint32_t now = millis();
+
+  ps_ms[ps_level] += now - ps_since;
+  ps_since = now;
+}
+
+static void ps_set(ps_level_t level)
+{
+  if(level == ps_level)
+  {
+    return;
+  }
+  ps_account();
+  if((ps_level != PS_STOPPED) && (level != PS_STOPPED))
+  {
+    ps_switches++;
+  }
+  ps_level = level;
+
+  switch(level)
+  {
+    case PS_AWAKE:
+      m2m_wifi_set_sleep_mode(M2M_NO_PS, 1);
+      break;
+    case PS_LIGHT:
+      m2m_wifi_set_sleep_mode(M2M_PS_AUTOMATIC, 1);
+      break;
+    case PS_SLEEP:
+      m2m_wifi_set_sleep_mode((ps_mode == WIFI_PS_DEEP) ? M2M_PS_DEEP_AUTOMATIC : M2M_PS_AUTOMATIC, 1); // broadcasts for ARP
+      break;
+    default:
+      break;
+  }
+}
+
+void wifi_ps_begin(wifi_ps_mode_t mode, uint8_t listen)
+{
+  tstrM2mLsnInt lsn;
+
+  ps_mode = mode;
+  ps_listen = (listen > 0) ? listen : 1;
+  ps_level = PS_STOPPED; // the WINC may have been reset, send the mode again
+  ps_set(PS_AWAKE);
+  memset(&lsn, 0, sizeof(lsn));
+  lsn.u16LsnInt = ps_listen;
+  m2m_wifi_set_lsn_int(&lsn);
+  ps_traffic = millis();
+}
+
+void wifi_ps_stop(void)
+{
+  ps_account();
+  ps_level = PS_STOPPED;
+}
+
+void wifi_ps_traffic(void)
+{
+  ps_traffic = millis();
+  if(ps_level != PS_STOPPED)
+  {
+    ps_set(PS_AWAKE);
+  }
+}
+
+void wifi_ps_service(bool busy, uint32_t next_ms)
+{
+  if(ps_level == PS_STOPPED)
+  {
+    return;
+  }
+  if((ps_mode == WIFI_PS_OFF) || ((millis() - ps_traffic) < WIFI_PS_HOLD_MS) || (next_ms < WIFI_PS_LEAD_MS))
+  {
+    ps_set(PS_AWAKE);
+  }
+  else if(busy)
+  {
+    ps_set(PS_LIGHT);
+  }
+  else
+  {
+    ps_set(PS_SLEEP);
+  }
+}
+
+void wifi_ps_get_stats(wifi_ps_stats_t *stats)
+{
+  ps_account();
+  stats->awake_ms = ps_ms[PS_AWAKE];
+  stats->light_ms = ps_ms[PS_LIGHT];
+  stats->sleep_ms = ps_ms[PS_SLEEP];
+  stats->switches = ps_switches;
+  stats->mode = ps_mode;
+  stats->listen = ps_listen;
+
+  memset(ps_ms, 0, sizeof(ps_ms));
+  ps_switches = 0;
+}
@@ -0,0 +1,93 @@
+#include "wifi_scan.h"
+
+static wifi_scan_net_t scan_nets[WIFI_SCAN_MAX];
+static uint8_t scan_count = 0;
+static bool scan_done = false;
+static uint32_t scan_ms = 0;
+
+// Inserts net sorted by RSSI, replaces a weaker entry with the same SSID.
+static void scan_add(const wifi_scan_net_t *net)
+{
+  uint8_t pos;
+
+  for(uint8_t i = 0; i < scan_count; i++)
+  {
+    if(strcmp(scan_nets[i].ssid, net->ssid) == 0)
+    {
+      if(scan_nets[i].rssi >= net->rssi)
+      {
+        return;
+      }
+      memmove(&scan_nets[i], &scan_nets[i + 1], (scan_count - i - 1) * sizeof(wifi_scan_net_t));
+      scan_count--;
+      break;
+    }
+  }
+  for(pos = 0; (pos < scan_count) && (scan_nets[pos].rssi >= net->rssi); pos++);
+  if(pos >= WIFI_SCAN_MAX)
+  {
+    return; // weaker than all others
+  }
+  if(scan_count >= WIFI_SCAN_MAX)
+  {
+    scan_count = WIFI_SCAN_MAX - 1; // drop the weakest
+  }
+  memmove(&scan_nets[pos + 1], &scan_nets[pos], (scan_count - pos) * sizeof(wifi_scan_net_t));
+  scan_nets[pos] = *net;
+  scan_count++;
+}
+
+uint8_t wifi_scan_run(void)
+{
+  int8_t n = WiFi.scanNetworks();
+
+  scan_count = 0;
+  for(int8_t i = 0; i < n; i++)
+  {
+    wifi_scan_net_t net;
+    const char *ssid = WiFi.SSID(i);
+    if((ssid == NULL) || (ssid[0] == 0))
+    {
+      continue; // hidden
+    }
+    strncpy(net.ssid, ssid, sizeof(net.ssid) - 1);
+    net.ssid[sizeof(net.ssid) - 1] = 0;
+    net.rssi = WiFi.RSSI(i);
+    net.enc = WiFi.encryptionType(i);
+    net.channel = WiFi.channel(i);
+    scan_add(&net);
+  }
+  scan_done = true;
+  scan_ms = millis();
+  return scan_count;
+}
+
+uint8_t wifi_scan_count(void)
+{
+  return scan_count;
+}
+
+const wifi_scan_net_t *wifi_scan_get(uint8_t i)
+{
+  return (i < scan_count) ? &scan_nets[i] : NULL;
+}
+
+uint32_t wifi_scan_age(void)
+{
+  return scan_done ? ((millis() - scan_ms) / 1000) : 0xFFFFFFFF;
+}
+
+void wifi_scan_http(httpd_conn_t *c, const httpd_req_t *req)
+{
+  (void)req;
+  httpd_respond(c, 200, "application/json", "Cache-Control: no-store\r\n");
+  httpd_print(c, "[");
+  for(uint8_t i = 0; i < scan_count; i++)
+  {
+    httpd_print(c, (i > 0) ? ",{\"ssid\":\"" : "{\"ssid\":\"");
+    httpd_escaped(c, scan_nets[i].ssid, false);
+    httpd_printf(c, "\",\"rssi\":%d,\"enc\":%s,\"ch\":%u}", scan_nets[i].rssi,
+      (scan_nets[i].enc != ENC_TYPE_NONE) ? "true" : "false", scan_nets[i].channel);
+  }
+  httpd_print(c, "]");
+}
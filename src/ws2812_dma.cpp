@@ -0,0 +1,116 @@
+#include "ws2812_dma.h"
+#include "dmac.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include "wiring_private.h"
+
+// SPI pattern for one nibble: every WS2812 bit b becomes the three SPI bits 1 b 0.
+static const uint16_t ws2812_nibble[16] =
+{
+  0x924, 0x926, 0x934, 0x936, 0x9A4, 0x9A6, 0x9B4, 0x9B6,
+  0xD24, 0xD26, 0xD34, 0xD36, 0xDA4, 0xDA6, 0xDB4, 0xDB6
+};
+
+NeoPixelDMA::NeoPixelDMA(uint16_t n, int16_t pin, neoPixelType type)
+  : Adafruit_NeoPixel(n, pin, type), spi_buf(NULL), spi_len(0), dma_channel(-1)
+{
+}
+
+NeoPixelDMA::~NeoPixelDMA()
+{
+  if(dma_channel >= 0)
+  {
+    dmac_abort(dma_channel);
+  }
+  free(spi_buf);
+}
+
+void NeoPixelDMA::begin(void)
+{
+  Adafruit_NeoPixel::begin();
+
+  if((pin < 0) || (g_APinDescription[pin].ulPort != PORTA) || (g_APinDescription[pin].ulPin != 22))
+  {
+    return; // only PA22 is routed to SERCOM3/PAD0
+  }
+#ifdef NEO_KHZ400
+  if(!is800KHz)
+  {
+    return;
+  }
+#endif
+
+  spi_len = (numBytes * 3) + WS2812_LATCH_BYTES;
+  spi_buf = (uint8_t *)malloc(spi_len);
+  if(spi_buf == NULL)
+  {
+    spi_len = 0;
+    return;
+  }
+  memset(spi_buf, 0, spi_len);
+
+  dmac_begin();
+  dma_channel = dmac_channel_alloc(SERCOM3_DMAC_ID_TX, NULL);
+  if(dma_channel < 0)
+  {
+    free(spi_buf);
+    spi_buf = NULL;
+    spi_len = 0;
+    return;
+  }
+
+  // SERCOM3 as SPI master, only DO (PAD0) is muxed to a pin
+  PM->APBCMASK.reg |= PM_APBCMASK_SERCOM3;
+  GCLK->CLKCTRL.reg = GCLK_CLKCTRL_ID_SERCOM3_CORE | GCLK_CLKCTRL_GEN_GCLK0 | GCLK_CLKCTRL_CLKEN;
+  while(GCLK->STATUS.bit.SYNCBUSY);
+
+  SERCOM3->SPI.CTRLA.bit.ENABLE = 0;
+  while(SERCOM3->SPI.SYNCBUSY.bit.ENABLE);
+  SERCOM3->SPI.CTRLA.bit.SWRST = 1;
+  while(SERCOM3->SPI.CTRLA.bit.SWRST || SERCOM3->SPI.SYNCBUSY.bit.SWRST);
+
+  SERCOM3->SPI.CTRLA.reg = SERCOM_SPI_CTRLA_MODE_SPI_MASTER |
+                           SERCOM_SPI_CTRLA_DOPO(0) | // DO=PAD0, SCK=PAD1
+                           SERCOM_SPI_CTRLA_DIPO(3);  // unused
+  SERCOM3->SPI.CTRLB.reg = SERCOM_SPI_CTRLB_CHSIZE(0); // 8 bit, RX off
+  while(SERCOM3->SPI.SYNCBUSY.bit.CTRLB);
+  SERCOM3->SPI.BAUD.reg = (F_CPU / (2 * WS2812_SPI_HZ)) - 1; // 48 MHz -> 2.4 MHz
+  SERCOM3->SPI.CTRLA.bit.ENABLE = 1;
+  while(SERCOM3->SPI.SYNCBUSY.bit.ENABLE);
+
+  pinPeripheral(pin, PIO_SERCOM);
+}
+
+bool NeoPixelDMA::canShow(void)
+{
+  if(dma_channel < 0)
+  {
+    return Adafruit_NeoPixel::canShow();
+  }
+  return !dmac_busy(dma_channel);
+}
+
+void NeoPixelDMA::show(void)
+{
+  if(dma_channel < 0)
+  {
+    Adafruit_NeoPixel::show();
+    return;
+  }
+
+  // Previous frame incl. latch may still be on the wire (< 0.5 ms).
+  while(dmac_busy(dma_channel));
+
+  // pixels[] is already in wire order (GRB) and scaled by the brightness.
+  uint8_t *dst = spi_buf;
+  for(uint16_t i = 0; i < numBytes; i++)
+  {
+    uint32_t bits = ((uint32_t)ws2812_nibble[pixels[i] >> 4] << 12) | ws2812_nibble[pixels[i] & 0x0F];
+    *dst++ = bits >> 16;
+    *dst++ = bits >> 8;
+    *dst++ = bits;
+  }
+
+  dmac_transfer(dma_channel, spi_buf, &SERCOM3->SPI.DATA.reg, spi_len, true, false);
+}
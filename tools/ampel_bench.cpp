@@ -0,0 +1,153 @@
+/*
+  Throughput benchmark for the binary protocol (include/binframe.h).
+
+  Build on the PC:
+    g++ -O2 -std=gnu++11 -Iinclude -Itools tools/ampel_bench.cpp tools/ampel_client.cpp src/binframe.cpp -o ampel_bench
+
+  ./ampel_bench                 frame codec only (COBS + CRC16), no device
+  ./ampel_bench /dev/ttyACM0    settings dump text vs. binary, history download
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "ampel_client.h"
+
+static double now_s(void)
+{
+  return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static int bench_codec(void)
+{
+  uint8_t frame[BINFRAME_MAX], enc[BINFRAME_ENC_MAX], dec[BINFRAME_ENC_MAX];
+  const unsigned rounds = 200000;
+  size_t len = BINFRAME_HDR, enc_len = 0, bytes = 0;
+  binframe_rec_t r;
+
+  // one full BF_HISTORY reply
+  frame[0] = BF_HISTORY | BF_REPLY;
+  frame[1] = 1;
+  frame[2] = BF_FLAG_MORE;
+  for(uint32_t i = 0; (len + BINFRAME_REC_LEN) <= (BINFRAME_HDR + BINFRAME_PAYLOAD); i++)
+  {
+    r.seq = i;
+    r.time = 1760000000UL + i * 5;
+    r.co2 = (uint16_t)(400 + i);
+    r.temp = 2150;
+    r.humi = 4500;
+    r.pres = 10132;
+    binframe_put_rec(&frame[len], &r);
+    len += BINFRAME_REC_LEN;
+  }
+  size_t recs = (len - BINFRAME_HDR) / BINFRAME_REC_LEN;
+
+  double t0 = now_s();
+  for(unsigned i = 0; i < rounds; i++)
+  {
+    frame[1] = (uint8_t)i;
+    enc_len = binframe_encode(frame, binframe_seal(frame, len), enc);
+    bytes += enc_len;
+  }
+  double t1 = now_s();
+  for(unsigned i = 0; i < rounds; i++)
+  {
+    size_t n = binframe_decode(enc, enc_len - 1, dec);
+    if(binframe_check(dec, n) != (int)(len - BINFRAME_HDR))
+    {
+      printf("decode error\n");
+      return 1;
+    }
+  }
+  double t2 = now_s();
+
+  printf("frame: %zu records, %zu bytes on the wire (%.1f bytes/record)\n", recs, enc_len, (double)enc_len / recs);
+  printf("encode: %.1f MB/s, decode+check: %.1f MB/s\n",
+         bytes / (t1 - t0) / 1e6, bytes / (t2 - t1) / 1e6);
+  printf("text output per sample (show_data): ~60 bytes\n");
+  return 0;
+}
+
+static int bench_device(const char *port)
+{
+  ampel_client c;
+  std::vector<std::string> lines;
+  std::vector<ampel_setting> settings;
+  std::vector<binframe_rec_t> recs;
+  std::string version;
+  const int rounds = 10;
+
+  if(!c.open(port))
+  {
+    printf("cannot open %s\n", port);
+    return 1;
+  }
+
+  // text: "abort" ends the dump with an ERROR line
+  c.text_command("remote on", lines);
+  size_t text_bytes = 0;
+  double t0 = now_s();
+  for(int i = 0; i < rounds; i++)
+  {
+    c.text_command("dump\nabort", lines);
+    for(size_t k = 0; k < lines.size(); k++)
+    {
+      text_bytes += lines[k].size() + 2;
+    }
+  }
+  double t_text = (now_s() - t0) / rounds;
+  printf("text dump:   %6.1f ms, %zu lines, %zu bytes\n", t_text * 1000, lines.size() - 1, text_bytes / rounds);
+
+  if(!c.enter_binary(&version))
+  {
+    printf("binary mode not supported\n");
+    return 1;
+  }
+  printf("firmware %s\n", version.c_str());
+
+  t0 = now_s();
+  for(int i = 0; i < rounds; i++)
+  {
+    if(!c.dump(settings))
+    {
+      printf("dump failed\n");
+      return 1;
+    }
+  }
+  double t_bin = (now_s() - t0) / rounds;
+  printf("binary dump: %6.1f ms, %zu keys (%.1fx)\n", t_bin * 1000, settings.size(), t_text / t_bin);
+
+  t0 = now_s();
+  if(!c.history(0, 0xFFFF, recs))
+  {
+    printf("history failed\n");
+    return 1;
+  }
+  double t_hist = now_s() - t0;
+  if(!recs.empty())
+  {
+    printf("history:     %6.1f ms, %zu records (seq %u-%u), %.0f records/s, %.1f kB/s\n",
+           t_hist * 1000, recs.size(), recs.front().seq, recs.back().seq,
+           recs.size() / t_hist, recs.size() * BINFRAME_REC_LEN / t_hist / 1000);
+  }
+  else
+  {
+    printf("history:     empty\n");
+  }
+  printf("bad frames:  %u\n", c.bad_frames);
+
+  c.leave_binary();
+  return 0;
+}
+
+int main(int argc, char **argv)
+{
+  if(argc > 1)
+  {
+    return bench_device(argv[1]);
+  }
+  return bench_codec();
+}
@@ -0,0 +1,402 @@
+#include "ampel_client.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+
+#define REPLY_TIMEOUT_MS 2000
+
+ampel_client::ampel_client() : bad_frames(0), fd(-1), seq(0)
+{
+}
+
+ampel_client::~ampel_client()
+{
+  close();
+}
+
+bool ampel_client::open(const char *port)
+{
+  struct termios tio;
+
+  fd = ::open(port, O_RDWR | O_NOCTTY);
+  if(fd < 0)
+  {
+    return false;
+  }
+  if(tcgetattr(fd, &tio) == 0)
+  {
+    cfmakeraw(&tio);
+    cfsetspeed(&tio, B9600); // ignored by USB CDC
+    tio.c_cc[VMIN] = 0;
+    tio.c_cc[VTIME] = 0;
+    tcsetattr(fd, TCSANOW, &tio);
+  }
+  tcflush(fd, TCIOFLUSH);
+  return true;
+}
+
+void ampel_client::close(void)
+{
+  if(fd >= 0)
+  {
+    ::close(fd);
+    fd = -1;
+  }
+}
+
+int ampel_client::read_byte(int timeout_ms)
+{
+  struct pollfd p;
+  uint8_t c;
+
+  p.fd = fd;
+  p.events = POLLIN;
+  if(poll(&p, 1, timeout_ms) <= 0)
+  {
+    return -1;
+  }
+  if(::read(fd, &c, 1) != 1)
+  {
+    return -1;
+  }
+  return c;
+}
+
+bool ampel_client::text_command(const std::string &line, std::vector<std::string> &reply, int timeout_ms)
+{
+  std::string l = line + "\n";
+  std::string cur;
+
+  reply.clear();
+  if(::write(fd, l.data(), l.size()) != (ssize_t)l.size())
+  {
+    return false;
+  }
+  for(;;)
+  {
+    int c = read_byte(timeout_ms);
+    if(c < 0)
+    {
+      return !reply.empty();
+    }
+    if(c == '\r')
+    {
+      continue;
+    }
+    if(c != '\n')
+    {
+      cur += (char)c;
+      continue;
+    }
+    if(cur.empty())
+    {
+      continue;
+    }
+    reply.push_back(cur);
+    if((cur == "OK") || (cur.compare(0, 6, "ERROR:") == 0))
+    {
+      return true;
+    }
+    cur.clear();
+  }
+}
+
+bool ampel_client::send_frame(uint8_t type, const std::vector<uint8_t> &payload)
+{
+  uint8_t frame[BINFRAME_MAX];
+  uint8_t enc[BINFRAME_ENC_MAX];
+
+  if(payload.size() > BINFRAME_PAYLOAD)
+  {
+    return false;
+  }
+  frame[0] = type;
+  frame[1] = ++seq;
+  frame[2] = 0;
+  if(!payload.empty())
+  {
+    memcpy(&frame[BINFRAME_HDR], payload.data(), payload.size());
+  }
+  size_t len = binframe_seal(frame, BINFRAME_HDR + payload.size());
+  len = binframe_encode(frame, len, enc);
+  return ::write(fd, enc, len) == (ssize_t)len;
+}
+
+bool ampel_client::read_frame(ampel_frame &f, int timeout_ms)
+{
+  for(;;)
+  {
+    int c = read_byte(timeout_ms);
+    if(c < 0)
+    {
+      return false;
+    }
+    if(c != 0)
+    {
+      if(rx.size() < BINFRAME_ENC_MAX)
+      {
+        rx.push_back((uint8_t)c);
+      }
+      continue;
+    }
+    if(rx.empty())
+    {
+      continue;
+    }
+
+    uint8_t dec[BINFRAME_ENC_MAX];
+    size_t len = binframe_decode(rx.data(), rx.size(), dec);
+    rx.clear();
+    int plen = (len > 0) ? binframe_check(dec, len) : -1;
+    if(plen < 0)
+    {
+      bad_frames++; // e.g. text output of the firmware between frames
+      continue;
+    }
+    f.type = dec[0];
+    f.seq = dec[1];
+    f.flags = dec[2];
+    f.payload.assign(&dec[BINFRAME_HDR], &dec[BINFRAME_HDR + plen]);
+    return true;
+  }
+}
+
+bool ampel_client::request(uint8_t type, const std::vector<uint8_t> &payload, std::vector<ampel_frame> &reply)
+{
+  ampel_frame f;
+
+  reply.clear();
+  if(!send_frame(type, payload))
+  {
+    return false;
+  }
+  while(read_frame(f, REPLY_TIMEOUT_MS))
+  {
+    if(f.type == BF_SAMPLE)
+    {
+      if(f.payload.size() >= BINFRAME_REC_LEN)
+      {
+        binframe_rec_t r;
+        binframe_get_rec(f.payload.data(), &r);
+        samples.push_back(r);
+      }
+      continue;
+    }
+    if(f.seq != seq)
+    {
+      continue; // late reply to an earlier request
+    }
+    if(f.type == BF_ERROR)
+    {
+      reply.push_back(f);
+      return false;
+    }
+    if(f.type != (type | BF_REPLY))
+    {
+      continue;
+    }
+    reply.push_back(f);
+    if((f.flags & BF_FLAG_MORE) == 0)
+    {
+      return true;
+    }
+  }
+  return false;
+}
+
+static void put_tlv(std::vector<uint8_t> &p, uint8_t tag, const void *v, size_t len)
+{
+  p.push_back(tag);
+  p.push_back((uint8_t)len);
+  p.insert(p.end(), (const uint8_t *)v, (const uint8_t *)v + len);
+}
+
+static void parse_settings(const std::vector<ampel_frame> &frames, std::vector<ampel_setting> &out)
+{
+  out.clear();
+  for(size_t i = 0; i < frames.size(); i++)
+  {
+    const std::vector<uint8_t> &p = frames[i].payload;
+    size_t pos = 0;
+    uint8_t tag, len;
+    const uint8_t *v;
+
+    while(binframe_tlv_next(p.data(), p.size(), &pos, &tag, &v, &len))
+    {
+      if(tag == T_KEY)
+      {
+        ampel_setting s;
+        s.key.assign((const char *)v, len);
+        s.tag = 0;
+        s.u = 0;
+        out.push_back(s);
+        continue;
+      }
+      if(out.empty())
+      {
+        continue;
+      }
+      ampel_setting &s = out.back();
+      s.tag = tag;
+      if((tag == T_STR) || (tag == T_ERR))
+      {
+        s.s.assign((const char *)v, len);
+      }
+      else
+      {
+        s.u = 0;
+        for(uint8_t k = 0; (k < len) && (k < 4); k++)
+        {
+          s.u |= (uint32_t)v[k] << (8 * k);
+        }
+      }
+    }
+  }
+}
+
+bool ampel_client::enter_binary(std::string *version)
+{
+  std::vector<std::string> reply;
+  std::vector<ampel_frame> frames;
+
+  if(!text_command("remote on", reply) || (reply.back() != "OK"))
+  {
+    return false;
+  }
+  if(!text_command("mode binary", reply) || (reply.back() != "OK"))
+  {
+    return false;
+  }
+  if(!request(BF_HELLO, std::vector<uint8_t>(), frames) || frames[0].payload.size() < 3)
+  {
+    return false;
+  }
+  if(frames[0].payload[0] != BINFRAME_VERSION)
+  {
+    return false;
+  }
+  if(version)
+  {
+    version->assign(frames[0].payload.begin() + 3, frames[0].payload.end());
+  }
+  return true;
+}
+
+bool ampel_client::leave_binary(void)
+{
+  std::vector<ampel_frame> frames;
+  return request(BF_MODE_TEXT, std::vector<uint8_t>(), frames);
+}
+
+bool ampel_client::get(const std::vector<std::string> &keys, std::vector<ampel_setting> &out)
+{
+  std::vector<uint8_t> p;
+  std::vector<ampel_frame> frames;
+
+  for(size_t i = 0; i < keys.size(); i++)
+  {
+    put_tlv(p, T_KEY, keys[i].data(), keys[i].size());
+  }
+  if(!request(BF_GET, p, frames))
+  {
+    return false;
+  }
+  parse_settings(frames, out);
+  return true;
+}
+
+bool ampel_client::dump(std::vector<ampel_setting> &out)
+{
+  std::vector<ampel_frame> frames;
+
+  if(!request(BF_DUMP, std::vector<uint8_t>(), frames))
+  {
+    return false;
+  }
+  parse_settings(frames, out);
+  return true;
+}
+
+bool ampel_client::set(const std::vector<ampel_setting> &values, std::vector<std::string> &errors)
+{
+  std::vector<uint8_t> p;
+  std::vector<ampel_frame> frames;
+  std::vector<ampel_setting> res;
+
+  errors.clear();
+  for(size_t i = 0; i < values.size(); i++)
+  {
+    const ampel_setting &s = values[i];
+    uint8_t num[4] = { (uint8_t)s.u, (uint8_t)(s.u >> 8), (uint8_t)(s.u >> 16), (uint8_t)(s.u >> 24) };
+    put_tlv(p, T_KEY, s.key.data(), s.key.size());
+    if(s.tag == T_STR)
+    {
+      put_tlv(p, T_STR, s.s.data(), s.s.size());
+    }
+    else
+    {
+      put_tlv(p, s.tag, num, (s.tag == T_BOOL) ? 1 : 4);
+    }
+  }
+  if(!request(BF_SET, p, frames))
+  {
+    return false;
+  }
+  parse_settings(frames, res);
+  for(size_t i = 0; i < res.size(); i++)
+  {
+    errors.push_back(res[i].s);
+  }
+  return true;
+}
+
+bool ampel_client::command(const std::string &cmd, std::string &reply)
+{
+  std::vector<uint8_t> p(cmd.begin(), cmd.end());
+  std::vector<ampel_frame> frames;
+
+  if(!request(BF_CMD, p, frames))
+  {
+    return false;
+  }
+  reply.assign(frames[0].payload.begin(), frames[0].payload.end());
+  while(!reply.empty() && ((reply.back() == '\n') || (reply.back() == '\r')))
+  {
+    reply.erase(reply.size() - 1);
+  }
+  return true;
+}
+
+bool ampel_client::history(uint32_t from, uint16_t max, std::vector<binframe_rec_t> &out)
+{
+  std::vector<uint8_t> p;
+  std::vector<ampel_frame> frames;
+
+  for(int i = 0; i < 4; i++)
+  {
+    p.push_back((uint8_t)(from >> (8 * i)));
+  }
+  p.push_back((uint8_t)max);
+  p.push_back((uint8_t)(max >> 8));
+  if(!request(BF_HISTORY, p, frames))
+  {
+    return false;
+  }
+
+  out.clear();
+  for(size_t i = 0; i < frames.size(); i++)
+  {
+    const std::vector<uint8_t> &pl = frames[i].payload;
+    for(size_t pos = 0; (pos + BINFRAME_REC_LEN) <= pl.size(); pos += BINFRAME_REC_LEN)
+    {
+      binframe_rec_t r;
+      binframe_get_rec(&pl[pos], &r);
+      out.push_back(r);
+    }
+  }
+  return true;
+}
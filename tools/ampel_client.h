@@ -0,0 +1,76 @@
+/*
+  Host client for the binary protocol of the CO2-Ampel (include/binframe.h)
+  over the USB serial port (POSIX). Used by ampel_bench.cpp; link with
+  src/binframe.cpp.
+*/
+
+#ifndef AMPEL_CLIENT_H
+#define AMPEL_CLIENT_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "binframe.h"
+
+struct ampel_setting
+{
+  std::string key;
+  uint8_t tag;   // T_U32, T_BOOL, T_STR, T_IP or T_ERR
+  uint32_t u;    // T_U32, T_BOOL, T_IP (a.b.c.d = bits 0-7 .. 24-31)
+  std::string s; // T_STR, T_ERR message
+};
+
+struct ampel_frame
+{
+  uint8_t type;
+  uint8_t seq;
+  uint8_t flags;
+  std::vector<uint8_t> payload;
+};
+
+class ampel_client
+{
+public:
+  ampel_client();
+  ~ampel_client();
+
+  bool open(const char *port);
+  void close(void);
+
+  // Text protocol: sends a line and returns the reply lines up to the first
+  // "OK"/"ERROR" line or until timeout_ms without data.
+  bool text_command(const std::string &line, std::vector<std::string> &reply, int timeout_ms = 1000);
+
+  // "remote on" + "mode binary" + BF_HELLO. version receives the firmware version.
+  bool enter_binary(std::string *version = NULL);
+  bool leave_binary(void);
+
+  bool get(const std::vector<std::string> &keys, std::vector<ampel_setting> &out);
+  bool dump(std::vector<ampel_setting> &out);
+  // errors receives one entry per key, empty = OK.
+  bool set(const std::vector<ampel_setting> &values, std::vector<std::string> &errors);
+  // Text settings command (begin, commit, abort, save), reply text.
+  bool command(const std::string &cmd, std::string &reply);
+  // Records from seq from on, at most max.
+  bool history(uint32_t from, uint16_t max, std::vector<binframe_rec_t> &out);
+
+  // Samples (BF_SAMPLE) received while waiting for replies.
+  std::vector<binframe_rec_t> samples;
+  // Frames dropped because of a bad CRC or COBS block.
+  uint32_t bad_frames;
+
+  // Raw frame I/O
+  bool send_frame(uint8_t type, const std::vector<uint8_t> &payload);
+  bool read_frame(ampel_frame &f, int timeout_ms);
+
+private:
+  bool request(uint8_t type, const std::vector<uint8_t> &payload, std::vector<ampel_frame> &reply);
+  int read_byte(int timeout_ms);
+
+  int fd;
+  uint8_t seq;
+  std::vector<uint8_t> rx;
+};
+
+#endif
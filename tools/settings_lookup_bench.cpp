@@ -0,0 +1,131 @@
+/*
+  Host micro-benchmark for the settings key lookup (include/cfg_keys.h):
+  linear strcasecmp scan (old find_item) against the binary search on the
+  sorted table, for growing numbers of keys.
+
+  Build and run on the PC:
+    g++ -O2 -std=gnu++11 -Iinclude tools/settings_lookup_bench.cpp -o settings_lookup_bench
+    ./settings_lookup_bench
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "cfg_keys.h"
+#include "settings_schema.h"
+
+struct item
+{
+  const char *key;
+};
+
+// Keys of the firmware table, expanded from the same SETTINGS_SCHEMA as
+// main.cpp; only the key argument is used.
+#define FW_KEY(key, ...) { key },
+static constexpr item fw_items[] =
+{
+  SETTINGS_SCHEMA(FW_KEY, FW_KEY, FW_KEY, FW_KEY)
+};
+static constexpr size_t fw_count = sizeof(fw_items) / sizeof(fw_items[0]);
+static_assert(cfg_keys_sorted(fw_items, 0, fw_count), "fw_items must be sorted by key");
+
+static const item *find_linear(const item *items, size_t count, const char *key)
+{
+  for(size_t i = 0; i < count; i++)
+  {
+    if(strcasecmp(items[i].key, key) == 0)
+    {
+      return &items[i];
+    }
+  }
+  return NULL;
+}
+
+static volatile size_t sink;
+
+template <typename F>
+static double ns_per_lookup(const std::vector<std::string> &queries, unsigned rounds, F find)
+{
+  auto t0 = std::chrono::steady_clock::now();
+  for(unsigned r = 0; r < rounds; r++)
+  {
+    for(const std::string &q : queries)
+    {
+      sink = sink + (size_t)find(q.c_str());
+    }
+  }
+  auto t1 = std::chrono::steady_clock::now();
+  double ns = std::chrono::duration<double, std::nano>(t1 - t0).count();
+  return ns / ((double)rounds * queries.size());
+}
+
+static void run(const std::vector<item> &items, unsigned rounds)
+{
+  std::vector<std::string> queries;
+
+  // every key once (upper case for half of them) plus 10% misses
+  for(size_t i = 0; i < items.size(); i++)
+  {
+    std::string q = items[i].key;
+    if(i & 1)
+    {
+      std::transform(q.begin(), q.end(), q.begin(), ::toupper);
+    }
+    queries.push_back(q);
+    if((i % 10) == 0)
+    {
+      queries.push_back(q + ".x");
+    }
+  }
+  std::random_shuffle(queries.begin(), queries.end());
+
+  for(const std::string &q : queries)
+  {
+    if(find_linear(items.data(), items.size(), q.c_str()) != cfg_key_find(items.data(), items.size(), q.c_str()))
+    {
+      printf("mismatch for %s\n", q.c_str());
+      exit(1);
+    }
+  }
+
+  double lin = ns_per_lookup(queries, rounds, [&](const char *k) { return find_linear(items.data(), items.size(), k); });
+  double bin = ns_per_lookup(queries, rounds, [&](const char *k) { return cfg_key_find(items.data(), items.size(), k); });
+  printf("%6zu keys: linear %8.1f ns, binary %6.1f ns, %5.1fx\n", items.size(), lin, bin, lin / bin);
+}
+
+int main(void)
+{
+  std::vector<item> items(fw_items, fw_items + fw_count);
+  std::vector<std::string> names;
+
+  run(items, 20000);
+
+  for(size_t n : { 100, 300, 1000 })
+  {
+    names.clear();
+    for(size_t i = 0; i < n; i++)
+    {
+      char buf[32];
+      snprintf(buf, sizeof(buf), "group%02zu.key%03zu", i % 20, i);
+      names.push_back(buf);
+    }
+    std::sort(names.begin(), names.end(), [](const std::string &a, const std::string &b)
+    {
+      return strcasecmp(a.c_str(), b.c_str()) < 0;
+    });
+    items.clear();
+    for(const std::string &s : names)
+    {
+      items.push_back(item{ s.c_str() });
+    }
+    run(items, (unsigned)(600000 / n));
+  }
+
+  return 0;
+}